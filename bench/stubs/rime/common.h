@@ -0,0 +1,52 @@
+// 端到端基准用的 librime 桩：只提供 userdb_cleaner.cc 用到的最小接口
+#ifndef RIME_STUB_COMMON_H_
+#define RIME_STUB_COMMON_H_
+
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rime {
+
+template <class T>
+using an = std::shared_ptr<T>;
+
+// 是否把 LOG 输出到 stderr（默认关闭，避免日志开销干扰计时）
+inline bool& stub_log_enabled() {
+  static bool enabled = false;
+  return enabled;
+}
+
+class StubLogLine {
+ public:
+  explicit StubLogLine(const char* severity) : severity_(severity) {}
+  ~StubLogLine() {
+    if (stub_log_enabled()) {
+      std::cerr << severity_ << ' ' << stream_.str() << '\n';
+    }
+  }
+
+  template <class T>
+  StubLogLine& operator<<(const T& value) {
+    if (stub_log_enabled()) {
+      stream_ << value;
+    }
+    return *this;
+  }
+
+ private:
+  const char* severity_;
+  std::ostringstream stream_;
+};
+
+}  // namespace rime
+
+#define LOG(severity) ::rime::StubLogLine(#severity)
+#define DLOG(severity) ::rime::StubLogLine(#severity)
+
+#endif
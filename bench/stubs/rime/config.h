@@ -0,0 +1,31 @@
+#ifndef RIME_STUB_CONFIG_H_
+#define RIME_STUB_CONFIG_H_
+
+#include <rime/common.h>
+
+namespace rime {
+
+class ConfigValue {
+ public:
+  bool GetString(std::string*) const { return false; }
+};
+
+class ConfigList {
+ public:
+  size_t size() const { return 0; }
+  an<ConfigValue> GetValueAt(size_t) { return nullptr; }
+};
+
+// 基准直接构造 CleanOptions，不读取任何配置
+class Config {
+ public:
+  bool LoadFromFile(const std::filesystem::path&) { return false; }
+  bool GetString(const std::string&, std::string*) { return false; }
+  bool GetBool(const std::string&, bool*) { return false; }
+  bool GetInt(const std::string&, int*) { return false; }
+  an<ConfigList> GetList(const std::string&) { return nullptr; }
+};
+
+}  // namespace rime
+
+#endif
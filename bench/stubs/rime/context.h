@@ -0,0 +1,19 @@
+#ifndef RIME_STUB_CONTEXT_H_
+#define RIME_STUB_CONTEXT_H_
+
+#include <string>
+
+namespace rime {
+
+class Context {
+ public:
+  const std::string& input() const { return input_; }
+  void Clear() { input_.clear(); }
+
+ private:
+  std::string input_;
+};
+
+}  // namespace rime
+
+#endif
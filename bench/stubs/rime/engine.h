@@ -0,0 +1,17 @@
+#ifndef RIME_STUB_ENGINE_H_
+#define RIME_STUB_ENGINE_H_
+
+#include <rime/context.h>
+#include <rime/schema.h>
+
+namespace rime {
+
+class Engine {
+ public:
+  Context* context() { return nullptr; }
+  Schema* schema() { return nullptr; }
+};
+
+}  // namespace rime
+
+#endif
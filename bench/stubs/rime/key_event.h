@@ -0,0 +1,10 @@
+#ifndef RIME_STUB_KEY_EVENT_H_
+#define RIME_STUB_KEY_EVENT_H_
+
+namespace rime {
+
+class KeyEvent {};
+
+}  // namespace rime
+
+#endif
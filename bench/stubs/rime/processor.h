@@ -0,0 +1,29 @@
+#ifndef RIME_STUB_PROCESSOR_H_
+#define RIME_STUB_PROCESSOR_H_
+
+#include <rime/common.h>
+
+namespace rime {
+
+class Engine;
+class KeyEvent;
+
+struct Ticket {
+  Engine* engine = nullptr;
+};
+
+enum ProcessResult { kRejected, kAccepted, kNoop };
+
+class Processor {
+ public:
+  explicit Processor(const Ticket& ticket) : engine_(ticket.engine) {}
+  virtual ~Processor() = default;
+  virtual ProcessResult ProcessKeyEvent(const KeyEvent& key_event) = 0;
+
+ protected:
+  Engine* engine_;
+};
+
+}  // namespace rime
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef RIME_STUB_SCHEMA_H_
+#define RIME_STUB_SCHEMA_H_
+
+#include <rime/config.h>
+
+namespace rime {
+
+class Schema {
+ public:
+  Config* config() { return nullptr; }
+};
+
+}  // namespace rime
+
+#endif
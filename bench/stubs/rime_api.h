@@ -0,0 +1,16 @@
+#ifndef RIME_STUB_API_H_
+#define RIME_STUB_API_H_
+
+#include <cstddef>
+
+// 只包含 userdb_cleaner.cc 用到的目录查询接口，由基准程序提供实现
+typedef struct rime_api_t {
+  void (*get_shared_data_dir_s)(char* dir, size_t buffer_size);
+  void (*get_user_data_dir_s)(char* dir, size_t buffer_size);
+  void (*get_sync_dir_s)(char* dir, size_t buffer_size);
+  void (*get_user_data_sync_dir)(char* dir, size_t buffer_size);
+} RimeApi;
+
+RimeApi* rime_get_api();
+
+#endif
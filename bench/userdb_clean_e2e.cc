@@ -0,0 +1,373 @@
+// userdb_clean_e2e.cc
+// 端到端清理基准：在生成的用户目录与多设备 sync 目录上运行与插件相同的
+// process_clean_task，rime API 由本地桩代替，按阶段统计耗时并输出 JSON。
+//
+//   userdb_clean_e2e --size 64M --devices 3 --dicts luna_pinyin,rime_ice --runs 5 --json e2e.json
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <rime_api.h>
+
+#include "lib/clean_options.hpp"
+#include "lib/clean_metrics.hpp"
+#include "userdb_cleaner.hpp"
+#include "userdb_corpus.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+}  // namespace
+
+// 统计清理过程中的堆分配次数；以 malloc/free 实现，GCC 内联后会误报不匹配
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// 桩 API 返回的目录
+struct StubDirs {
+  std::string user_data_dir;
+  std::string sync_dir;
+  std::string local_sync_dir;
+} g_dirs;
+
+void copy_dir(const std::string& dir, char* buffer, size_t size) {
+  std::snprintf(buffer, size, "%s", dir.c_str());
+}
+
+}  // namespace
+
+RimeApi* rime_get_api() {
+  static RimeApi api = {
+      [](char* dir, size_t size) { copy_dir(g_dirs.user_data_dir, dir, size); },
+      [](char* dir, size_t size) { copy_dir(g_dirs.user_data_dir, dir, size); },
+      [](char* dir, size_t size) { copy_dir(g_dirs.sync_dir, dir, size); },
+      [](char* dir, size_t size) { copy_dir(g_dirs.local_sync_dir, dir, size); },
+  };
+  return &api;
+}
+
+namespace {
+
+struct HarnessOptions {
+  fs::path work_dir = fs::temp_directory_path() / "userdb_clean_e2e";
+  int devices = 2;
+  std::vector<std::string> dicts;
+  int runs = 3;
+  std::string json_path;
+  std::string trace_path;
+  std::string label;
+  userdb_corpus::CorpusOptions corpus;
+  userdb::CleanOptions clean;
+};
+
+struct RunResult {
+  double total_ms = 0;
+  double phase_ms[static_cast<size_t>(userdb::CleanPhase::kCount)] = {};
+  uint64_t input_bytes = 0;
+  uint64_t output_bytes = 0;
+  size_t files = 0;
+  size_t threads = 1;
+  uint64_t peak_rss = 0;
+  uint64_t allocations = 0;  // process_clean_task 中的堆分配次数
+};
+
+uint64_t userdb_bytes(const fs::path& sync_dir, size_t* files) {
+  uint64_t total = 0;
+  for (const auto& entry : fs::recursive_directory_iterator(sync_dir)) {
+    const std::string name = entry.path().filename().string();
+    if (entry.is_regular_file() && name.size() > 11 && name.compare(name.size() - 11, 11, ".userdb.txt") == 0) {
+      total += entry.file_size();
+      if (files) ++*files;
+    }
+  }
+  return total;
+}
+
+/**
+ * 重新生成用户目录：sync/<device>/<dict>.userdb.txt 以及待清空的 <dict>.userdb 文件夹
+ */
+bool prepare(const HarnessOptions& options, int run) {
+  fs::path user_dir = options.work_dir / "user";
+  fs::remove_all(user_dir);
+  fs::path sync_dir = user_dir / "sync";
+  std::vector<fs::path> device_dirs;
+  for (int d = 0; d < options.devices; ++d) {
+    device_dirs.push_back(sync_dir / ("device-" + std::to_string(d + 1)));
+    fs::create_directories(device_dirs.back());
+  }
+  userdb_corpus::CorpusStats stats;
+  for (size_t k = 0; k < options.dicts.size(); ++k) {
+    std::vector<fs::path> outputs;
+    for (const auto& dir : device_dirs) {
+      outputs.push_back(dir / (options.dicts[k] + ".userdb.txt"));
+    }
+    if (!userdb_corpus::generate(outputs, options.dicts[k], options.corpus,
+                                 options.corpus.seed * 1000003 + k + static_cast<uint64_t>(run), stats)) {
+      return false;
+    }
+    // 模拟 leveldb 格式的 .userdb 文件夹
+    fs::path folder = user_dir / (options.dicts[k] + ".userdb");
+    fs::create_directories(folder);
+    for (const char* name : {"CURRENT", "LOCK", "LOG", "MANIFEST-000001", "000003.log"}) {
+      std::ofstream(folder / name) << name << '\n';
+    }
+  }
+  g_dirs.user_data_dir = user_dir.string();
+  g_dirs.sync_dir = sync_dir.string();
+  g_dirs.local_sync_dir = device_dirs.front().string();
+  return true;
+}
+
+RunResult run_once(const HarnessOptions& options) {
+  RunResult result;
+  fs::path sync_dir = g_dirs.sync_dir;
+  result.input_bytes = userdb_bytes(sync_dir, &result.files);
+
+  userdb::CleanMetrics metrics;
+  uint64_t allocations = g_allocations.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  rime::process_clean_task(options.clean, &metrics);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  result.allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+
+  result.total_ms = std::chrono::duration<double, std::milli>(elapsed).count();
+  for (size_t i = 0; i < static_cast<size_t>(userdb::CleanPhase::kCount); ++i) {
+    result.phase_ms[i] = metrics.phases.millis(static_cast<userdb::CleanPhase>(i));
+  }
+  result.threads = metrics.threads();
+  result.peak_rss = userdb::peak_rss_bytes();
+  result.output_bytes = userdb_bytes(sync_dir, nullptr);
+  return result;
+}
+
+void write_json(std::ostream& out, const HarnessOptions& options, const std::vector<RunResult>& results) {
+  using userdb::backup_mode_name;
+  using userdb::json_escape;
+  using userdb::merge_rule_name;
+  constexpr size_t kPhases = static_cast<size_t>(userdb::CleanPhase::kCount);
+  out << "{\n  \"label\": \"" << json_escape(options.label) << "\",\n";
+  out << "  \"config\": {\"size\": " << options.corpus.size << ", \"devices\": " << options.devices
+      << ", \"dicts\": " << options.dicts.size()
+      << ", \"invalid_fraction\": " << options.corpus.invalid_fraction
+      << ", \"duplicate_rate\": " << options.corpus.duplicate_rate
+      << ", \"backup_mode\": \"" << backup_mode_name(options.clean.backup_mode) << "\""
+      << ", \"merge_duplicates\": \"" << merge_rule_name(options.clean.merge_rule) << "\""
+      << ", \"consolidate_devices\": " << (options.clean.consolidate_devices ? "true" : "false")
+      << ", \"propagate_deletions\": " << (options.clean.propagate_deletions ? "true" : "false")
+      << ", \"record_deleted_words\": " << (options.clean.record_deleted_words ? "true" : "false")
+      << ", \"bounded_memory\": " << (options.clean.bounded_memory ? "true" : "false")
+      << ", \"drop_page_cache\": " << (options.clean.drop_page_cache ? "true" : "false")
+      << ", \"durable_commit\": " << (options.clean.durable_commit ? "true" : "false") << "},\n";
+  out << "  \"runs\": [\n";
+  for (size_t r = 0; r < results.size(); ++r) {
+    const RunResult& result = results[r];
+    out << "    {\"total_ms\": " << result.total_ms << ", \"files\": " << result.files
+        << ", \"input_bytes\": " << result.input_bytes << ", \"output_bytes\": " << result.output_bytes
+        << ", \"threads\": " << result.threads << ", \"peak_rss_bytes\": " << result.peak_rss << ", \"allocations\": " << result.allocations
+        << ", \"phases_ms\": {";
+    for (size_t i = 0; i < kPhases; ++i) {
+      out << (i ? ", " : "") << "\"" << userdb::phase_name(static_cast<userdb::CleanPhase>(i))
+          << "\": " << result.phase_ms[i];
+    }
+    out << "}}" << (r + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+void print_usage() {
+  std::cerr <<
+      "Usage: userdb_clean_e2e [options]\n"
+      "  --work-dir DIR            scratch directory (default: <tmp>/userdb_clean_e2e)\n"
+      "  --size N[K|M|G]           size of each generated .userdb.txt (default 16M)\n"
+      "  --devices N               device directories under sync (default 2)\n"
+      "  --dicts a,b               dictionary names (default luna_pinyin)\n"
+      "  --invalid-fraction F      fraction of entries with c <= 0 (default 0.05)\n"
+      "  --duplicate-rate F        fraction of duplicated entries (default 0)\n"
+      "  --backup-mode MODE        copy / compressed / chunked (default copy)\n"
+      "  --merge RULE              none / max_c / max_t / sum_c (default none)\n"
+      "  --consolidate             merge device copies into the local device directory\n"
+      "  --propagate               propagate deletions across device copies\n"
+      "  --no-record               do not record deleted words\n"
+      "  --bounded-memory          fixed-size buffers, deleted words streamed to the journal\n"
+      "  --drop-page-cache         evict cleaned files and backups from the page cache\n"
+      "  --no-durable-commit       replace files without syncing them to disk first\n"
+      "  --metrics                 also append userdb_cleaner_metrics.jsonl in the sync directory\n"
+      "  --trace FILE              write a Chrome trace of the last run to FILE\n"
+      "  --runs N                  number of measured runs (default 3)\n"
+      "  --json FILE               write results as JSON\n"
+      "  --label TEXT              label stored in the JSON (e.g. a commit id)\n"
+      "  --verbose                 print the cleaner's log to stderr\n"
+      "  --log-verbose             include per-entry detail in the cleaner's log\n"
+      "  --log-rate N              per-category log rate limit per second (0 = unlimited)\n";
+}
+
+bool parse_size(std::string_view text, uint64_t* size) {
+  if (text.empty()) return false;
+  uint64_t multiplier = 1;
+  switch (text.back()) {
+    case 'K': case 'k': multiplier = 1ull << 10; break;
+    case 'M': case 'm': multiplier = 1ull << 20; break;
+    case 'G': case 'g': multiplier = 1ull << 30; break;
+    default: break;
+  }
+  if (multiplier > 1) text.remove_suffix(1);
+  std::string number(text);
+  char* end = nullptr;
+  double value = std::strtod(number.c_str(), &end);
+  if (end == number.c_str() || *end != '\0' || value <= 0) return false;
+  *size = static_cast<uint64_t>(value * static_cast<double>(multiplier));
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  HarnessOptions options;
+  options.corpus.size = 16 << 20;
+  options.clean.record_metrics = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto value = [&]() -> const char* {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << "\n";
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+    bool ok = true;
+    if (arg == "--work-dir") {
+      options.work_dir = value();
+    } else if (arg == "--size") {
+      ok = parse_size(value(), &options.corpus.size);
+    } else if (arg == "--devices") {
+      options.devices = std::atoi(value());
+      ok = options.devices > 0;
+    } else if (arg == "--dicts") {
+      std::stringstream list(value());
+      std::string name;
+      while (std::getline(list, name, ',')) {
+        if (!name.empty()) options.dicts.push_back(name);
+      }
+    } else if (arg == "--invalid-fraction") {
+      options.corpus.invalid_fraction = std::atof(value());
+    } else if (arg == "--duplicate-rate") {
+      options.corpus.duplicate_rate = std::atof(value());
+    } else if (arg == "--backup-mode") {
+      ok = userdb::parse_backup_mode(value(), &options.clean.backup_mode);
+    } else if (arg == "--merge") {
+      ok = userdb::parse_merge_rule(value(), &options.clean.merge_rule);
+    } else if (arg == "--consolidate") {
+      options.clean.consolidate_devices = true;
+    } else if (arg == "--propagate") {
+      options.clean.propagate_deletions = true;
+    } else if (arg == "--no-record") {
+      options.clean.record_deleted_words = false;
+    } else if (arg == "--bounded-memory") {
+      options.clean.bounded_memory = true;
+    } else if (arg == "--drop-page-cache") {
+      options.clean.drop_page_cache = true;
+    } else if (arg == "--no-durable-commit") {
+      options.clean.durable_commit = false;
+    } else if (arg == "--metrics") {
+      options.clean.record_metrics = true;
+    } else if (arg == "--trace") {
+      options.trace_path = value();
+      options.clean.trace = true;
+    } else if (arg == "--runs") {
+      options.runs = std::atoi(value());
+      ok = options.runs > 0;
+    } else if (arg == "--json") {
+      options.json_path = value();
+    } else if (arg == "--label") {
+      options.label = value();
+    } else if (arg == "--verbose") {
+      rime::stub_log_enabled() = true;
+    } else if (arg == "--log-verbose") {
+      options.clean.log_verbose = true;
+    } else if (arg == "--log-rate") {
+      options.clean.log_rate_limit = std::atoi(value());
+    } else if (arg == "--help" || arg == "-h") {
+      print_usage();
+      return 0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << "Invalid argument: " << arg << "\n";
+      print_usage();
+      return 2;
+    }
+  }
+  if (options.dicts.empty()) {
+    options.dicts.push_back("luna_pinyin");
+  }
+  options.clean.backup_repo = (options.work_dir / "user" / "userdb_backups").string();
+
+  std::vector<RunResult> results;
+  for (int run = 0; run < options.runs; ++run) {
+    if (!prepare(options, run)) {
+      std::cerr << "Failed to generate corpus in " << options.work_dir.string() << "\n";
+      return 1;
+    }
+    results.push_back(run_once(options));
+    const RunResult& result = results.back();
+    std::cerr << "run " << run + 1 << ": " << result.total_ms << " ms, " << result.files << " files, "
+              << result.input_bytes << " -> " << result.output_bytes << " bytes, " << result.allocations
+              << " allocations\n";
+    for (size_t i = 0; i < static_cast<size_t>(userdb::CleanPhase::kCount); ++i) {
+      std::cerr << "  " << userdb::phase_name(static_cast<userdb::CleanPhase>(i)) << ": "
+                << result.phase_ms[i] << " ms\n";
+    }
+  }
+
+  if (!options.json_path.empty()) {
+    std::ofstream out(options.json_path, std::ios::trunc);
+    if (!out.is_open()) {
+      std::cerr << "Failed to open " << options.json_path << "\n";
+      return 1;
+    }
+    write_json(out, options, results);
+  } else {
+    write_json(std::cout, options, results);
+  }
+  if (!options.trace_path.empty()) {
+    std::error_code ec;
+    fs::copy_file(fs::path(g_dirs.sync_dir) / "userdb_cleaner_trace.json", options.trace_path,
+                  fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+      std::cerr << "Failed to copy trace to " << options.trace_path << ": " << ec.message() << "\n";
+    }
+  }
+  fs::remove_all(options.work_dir / "user");
+  return 0;
+}
@@ -0,0 +1,336 @@
+// userdb_cleaner_bench.cc
+// 解析与过滤内核的基准测试，输入为 userdb_corpus 生成的合成语料
+//
+// 每项结果除耗时外还报告：
+//   bytes_per_second  吞吐量
+//   time_per_line     每行耗时
+//   allocs_per_line   每行堆分配次数（替换全局 operator new 计数）
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "file_op_batch.hpp"
+#include "file_sink.hpp"
+#include "mapped_file.hpp"
+#include "page_cache.hpp"
+#include "userdb_file_filter.hpp"
+#include "userdb_filter.hpp"
+#include "userdb_header.hpp"
+#include "userdb_corpus.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+}  // namespace
+
+// 计数用的全局 operator new/delete 以 malloc/free 实现，GCC 内联后会误报不匹配
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+/**
+ * 按大小（MB）生成并缓存语料文件，各基准共用
+ */
+const fs::path& corpus_file(int64_t megabytes) {
+  static std::map<int64_t, fs::path> corpora;
+  auto it = corpora.find(megabytes);
+  if (it != corpora.end()) {
+    return it->second;
+  }
+  fs::path dir = fs::temp_directory_path() / "userdb_cleaner_bench";
+  fs::create_directories(dir);
+  fs::path path = dir / ("bench_" + std::to_string(megabytes) + "m.userdb.txt");
+  userdb_corpus::CorpusOptions options;
+  options.size = static_cast<uint64_t>(megabytes) << 20;
+  options.invalid_fraction = 0.05;
+  options.duplicate_rate = 0.02;
+  userdb_corpus::CorpusStats stats;
+  if (!userdb_corpus::generate({path}, "bench", options, 42, stats)) {
+    std::abort();
+  }
+  return corpora.emplace(megabytes, path).first->second;
+}
+
+// 语料正文（不含文件头）拆分后的行，供单行解析基准使用
+struct CorpusLines {
+  userdb::InputBuffer buffer;
+  std::vector<std::string_view> lines;
+  uint64_t bytes = 0;
+};
+
+const CorpusLines& corpus_lines(int64_t megabytes) {
+  static std::map<int64_t, CorpusLines> cache;
+  auto it = cache.find(megabytes);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  CorpusLines& corpus = cache[megabytes];
+  if (!corpus.buffer.open(corpus_file(megabytes))) {
+    std::abort();
+  }
+  std::string_view content = corpus.buffer.view();
+  std::string_view body = content.substr(userdb::parse_header(content).block.size());
+  userdb::MappedLineReader read(body.data(), body.size());
+  std::string_view line;
+  while (read(line)) {
+    corpus.lines.push_back(line);
+    corpus.bytes += line.size() + 1;
+  }
+  return corpus;
+}
+
+void set_line_counters(benchmark::State& state, uint64_t lines, uint64_t bytes, uint64_t allocations) {
+  const double total_lines = static_cast<double>(lines) * static_cast<double>(state.iterations());
+  state.SetBytesProcessed(static_cast<int64_t>(bytes) * state.iterations());
+  state.counters["time_per_line"] = benchmark::Counter(
+      total_lines, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  state.counters["allocs_per_line"] = total_lines > 0 ? static_cast<double>(allocations) / total_lines : 0.0;
+}
+
+void BM_ParseCValue(benchmark::State& state) {
+  const CorpusLines& corpus = corpus_lines(state.range(0));
+  uint64_t allocations = g_allocations.load();
+  for (auto _ : state) {
+    for (std::string_view line : corpus.lines) {
+      benchmark::DoNotOptimize(userdb::parse_c_value(line));
+    }
+  }
+  allocations = g_allocations.load() - allocations;
+  set_line_counters(state, corpus.lines.size(), corpus.bytes, allocations);
+}
+BENCHMARK(BM_ParseCValue)->Arg(16)->Unit(benchmark::kMillisecond);
+
+void BM_ExtractWordText(benchmark::State& state) {
+  const CorpusLines& corpus = corpus_lines(state.range(0));
+  uint64_t allocations = g_allocations.load();
+  for (auto _ : state) {
+    for (std::string_view line : corpus.lines) {
+      benchmark::DoNotOptimize(userdb::extract_word_text(line));
+    }
+  }
+  allocations = g_allocations.load() - allocations;
+  set_line_counters(state, corpus.lines.size(), corpus.bytes, allocations);
+}
+BENCHMARK(BM_ExtractWordText)->Arg(16)->Unit(benchmark::kMillisecond);
+
+// 不含文件读写的过滤循环：映射读取 + c 值判断 + 丢弃输出
+void BM_FilterLines(benchmark::State& state) {
+  const CorpusLines& corpus = corpus_lines(state.range(0));
+  std::string_view body(corpus.lines.front().data(), corpus.bytes);
+  uint64_t allocations = g_allocations.load();
+  for (auto _ : state) {
+    userdb::MappedLineReader read(body.data(), body.size());
+    auto sink = [](std::string_view line) { benchmark::DoNotOptimize(line); };
+    userdb::NoWordCapture capture;
+    benchmark::DoNotOptimize(userdb::filter_lines(read, userdb::CValuePredicate(), sink, capture));
+  }
+  allocations = g_allocations.load() - allocations;
+  set_line_counters(state, corpus.lines.size(), corpus.bytes, allocations);
+}
+BENCHMARK(BM_FilterLines)->Arg(16)->Unit(benchmark::kMillisecond);
+
+/**
+ * 完整的单文件清理：映射读入、过滤、写出临时文件
+ * 参数：语料大小（MB）、是否记录删除的词条、是否按 max_c 合并重复词条
+ */
+void BM_FilterUserdbFile(benchmark::State& state) {
+  const fs::path& input = corpus_file(state.range(0));
+  fs::path output = input;
+  output += ".cache";
+  userdb::CleanOptions options;
+  options.record_deleted_words = state.range(1) != 0;
+  options.merge_rule = state.range(2) ? userdb::MergeRule::kMaxC : userdb::MergeRule::kNone;
+
+  userdb::StringList deleted_words;
+  userdb::FileFilterStats stats;
+  uint64_t allocations = g_allocations.load();
+  for (auto _ : state) {
+    deleted_words.clear();
+    if (!userdb::filter_userdb_file(input, output, options, deleted_words, &stats)) {
+      state.SkipWithError("filter_userdb_file failed");
+      break;
+    }
+  }
+  allocations = g_allocations.load() - allocations;
+  set_line_counters(state, stats.lines_scanned, stats.bytes_read, allocations);
+  fs::remove(output);
+}
+BENCHMARK(BM_FilterUserdbFile)
+    ->ArgsProduct({{1, 16, 64}, {0, 1}, {0, 1}})
+    ->ArgNames({"mb", "record", "merge"})
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * 写出保留行：逐行 ofstream::write + put 与 FileSink（writev 引用映射内容）的对比
+ * 参数：语料大小（MB）、写出方式（0 ofstream，1 FileSink，2 FileSink + 按输入大小预分配）
+ */
+void BM_WriteKeptLines(benchmark::State& state) {
+  const fs::path& input = corpus_file(state.range(0));
+  fs::path output = input;
+  output += ".out";
+  userdb::MappedFile mapped;
+  if (!mapped.open(input)) {
+    state.SkipWithError("failed to map corpus");
+    return;
+  }
+  std::string_view content = mapped.view();
+  const int64_t mode = state.range(1);
+
+  userdb::FilterStats stats;
+  uint64_t allocations = g_allocations.load();
+  for (auto _ : state) {
+    userdb::MappedLineReader read(content.data(), content.size());
+    userdb::NoWordCapture capture;
+    bool ok = false;
+    if (mode == 0) {
+      std::ofstream out(output, std::ios::binary | std::ios::trunc);
+      userdb::StreamSink sink(out);
+      stats = userdb::filter_lines(read, userdb::CValuePredicate(), sink, capture);
+      out.flush();
+      ok = static_cast<bool>(out);
+    } else {
+      userdb::FileSink sink;
+      ok = sink.open(output, mode == 2 ? content.size() : 0);
+      sink.add_source(content);
+      stats = userdb::filter_lines(read, userdb::CValuePredicate(), sink, capture);
+      ok = sink.close() && ok;
+    }
+    if (!ok) {
+      state.SkipWithError("failed to write output");
+      break;
+    }
+  }
+  allocations = g_allocations.load() - allocations;
+  set_line_counters(state, stats.lines_scanned, stats.bytes_read, allocations);
+  fs::remove(output);
+}
+BENCHMARK(BM_WriteKeptLines)
+    ->ArgsProduct({{64, 1024}, {0, 1, 2}})
+    ->ArgNames({"mb", "sink"})
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * 清理一个文件后留在页缓存中的内容：默认（只有顺序读取提示）与 drop_page_cache 的对比
+ * 参数：语料大小（MB）、是否启用 drop_page_cache
+ * 计数器为最后一次清理后输入与输出文件驻留在页缓存中的 MB（mincore），
+ * 以及第一次清理前输入已驻留的 MB；不是 Linux 时均为 0
+ */
+void BM_PageCacheFootprint(benchmark::State& state) {
+  const fs::path& input = corpus_file(state.range(0));
+  fs::path output = input;
+  output += ".cache";
+  userdb::CleanOptions options;
+  options.record_deleted_words = false;
+  options.drop_page_cache = state.range(1) != 0;
+
+  // 先读一遍，使两种方式从相同的状态开始
+  {
+    userdb::InputBuffer warm;
+    if (warm.open(input)) {
+      benchmark::DoNotOptimize(std::count(warm.view().begin(), warm.view().end(), '\n'));
+    }
+  }
+  const double mb = 1024.0 * 1024.0;
+  const double input_before = static_cast<double>(userdb::cached_bytes(input)) / mb;
+
+  userdb::StringList deleted_words;
+  userdb::FileFilterStats stats;
+  for (auto _ : state) {
+    if (!userdb::filter_userdb_file(input, output, options, deleted_words, &stats)) {
+      state.SkipWithError("filter_userdb_file failed");
+      break;
+    }
+  }
+  state.counters["input_before_mb"] = input_before;
+  state.counters["input_cached_mb"] = static_cast<double>(userdb::cached_bytes(input)) / mb;
+  state.counters["output_cached_mb"] = static_cast<double>(userdb::cached_bytes(output)) / mb;
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(stats.bytes_read));
+  fs::remove(output);
+}
+BENCHMARK(BM_PageCacheFootprint)
+    ->ArgsProduct({{64, 1024}, {0, 1}})
+    ->ArgNames({"mb", "drop"})
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * 删除大量小文件：逐个 fs::remove 与 FileOpBatch（io_uring 成批提交）的对比
+ * 参数：文件数、分布的子目录数、删除方式（0 逐个删除，1 FileOpBatch，不论 CPU 数都使用 io_uring）；
+ * 不支持 io_uring 时方式 1 同样逐个删除
+ * 同一目录中的删除在内核中互斥，分布在多个子目录（如备份分块）时成批提交的收益更明显
+ */
+void BM_UnlinkFiles(benchmark::State& state) {
+  const int64_t count = state.range(0);
+  const int64_t dirs = state.range(1);
+  const int64_t mode = state.range(2);
+  fs::path dir = fs::temp_directory_path() / "userdb_cleaner_bench" / "unlink";
+  std::vector<fs::path> files;
+  for (int64_t i = 0; i < count; ++i) {
+    files.push_back(dir / std::to_string(i % dirs) / ("file_" + std::to_string(i) + ".userdb.txt"));
+  }
+  bool used_io_uring = false;
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (int64_t i = 0; i < dirs; ++i) {
+      fs::create_directories(dir / std::to_string(i));
+    }
+    for (const auto& file : files) {
+      std::ofstream(file) << "# Rime user dictionary\n";
+    }
+    state.ResumeTiming();
+    size_t removed = 0;
+    if (mode == 0) {
+      for (const auto& file : files) {
+        removed += fs::remove(file) ? 1 : 0;
+      }
+    } else {
+      userdb::FileOpBatch batch(true);
+      for (const auto& file : files) {
+        batch.unlink(file);
+      }
+      removed = batch.run_count();
+      used_io_uring = batch.used_io_uring();
+    }
+    if (removed != files.size()) {
+      state.SkipWithError("failed to remove files");
+      break;
+    }
+  }
+  state.counters["io_uring"] = used_io_uring ? 1 : 0;
+  state.SetItemsProcessed(state.iterations() * count);
+  fs::remove_all(dir);
+}
+BENCHMARK(BM_UnlinkFiles)
+    ->ArgsProduct({{64, 4096}, {1, 64}, {0, 1}})
+    ->ArgNames({"files", "dirs", "batch"})
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
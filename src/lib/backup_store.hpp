@@ -0,0 +1,274 @@
+#ifndef BACKUP_STORE_HPP_
+#define BACKUP_STORE_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#ifdef USERDB_CLEANER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "clean_options.hpp"
+#include "file_op_batch.hpp"
+#include "page_cache.hpp"
+
+namespace userdb {
+
+/**
+ * 备份写入端：清理过程中按顺序接收原文件内容，commit 成功后备份才生效
+ */
+class BackupWriter {
+ public:
+  virtual ~BackupWriter() = default;
+  virtual bool write(std::string_view data) = 0;
+  virtual bool commit() = 0;
+
+  // commit 成功后把写出的备份文件从页缓存中丢弃：备份只在恢复时读取
+  void set_drop_page_cache(bool drop) { drop_page_cache_ = drop; }
+
+ protected:
+  bool drop_page_cache_ = false;
+};
+
+/**
+ * 备份文件名中的时间戳，如 20240131-235959-123（按字典序即按时间排序）
+ */
+inline std::string backup_timestamp() {
+  auto now = std::chrono::system_clock::now();
+  auto time_t = std::chrono::system_clock::to_time_t(now);
+  auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+      now.time_since_epoch()).count() % 1000;
+  std::tm tm;
+#if defined(_WIN32) || defined(_WIN64)
+  localtime_s(&tm, &time_t);
+#else
+  localtime_r(&time_t, &tm);
+#endif
+  char buffer[64];
+  std::snprintf(buffer, sizeof(buffer), "%04d%02d%02d-%02d%02d%02d-%03d",
+                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(millis));
+  return buffer;
+}
+
+/**
+ * 某个 .userdb.txt 的历史备份文件名前缀：xxx.userdb.txt -> xxx.userdb_backup.
+ */
+inline std::string backup_prefix_for(const std::filesystem::path& userdb_file) {
+  std::string filename = userdb_file.filename().string();
+  const std::string suffix = ".userdb.txt";
+  if (filename.size() > suffix.size() &&
+      filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0) {
+    filename.resize(filename.size() - suffix.size());
+  }
+  return filename + ".userdb_backup.";
+}
+
+// 未压缩的备份（未编译 zlib 时的回退）
+class PlainBackupWriter : public BackupWriter {
+ public:
+  ~PlainBackupWriter() override {
+    if (out_.is_open()) {
+      out_.close();
+      std::error_code ec;
+      std::filesystem::remove(partial_path_, ec);
+    }
+  }
+
+  bool open(const std::filesystem::path& path) {
+    path_ = path;
+    partial_path_ = path;
+    partial_path_ += ".partial";
+    out_.open(partial_path_, std::ios::binary | std::ios::trunc);
+    return out_.is_open();
+  }
+
+  bool write(std::string_view data) override {
+    out_.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out_);
+  }
+
+  bool commit() override {
+    out_.flush();
+    bool ok = static_cast<bool>(out_);
+    out_.close();
+    std::error_code ec;
+    if (ok) {
+      std::filesystem::rename(partial_path_, path_, ec);
+    }
+    if (!ok || ec) {
+      std::filesystem::remove(partial_path_, ec);
+      return false;
+    }
+    if (drop_page_cache_) {
+      drop_page_cache(path_);
+    }
+    return true;
+  }
+
+ private:
+  std::filesystem::path path_;
+  std::filesystem::path partial_path_;
+  std::ofstream out_;
+};
+
+#ifdef USERDB_CLEANER_HAVE_ZLIB
+// gzip 流式压缩备份，可直接用 gunzip 解压
+class GzipBackupWriter : public BackupWriter {
+ public:
+  ~GzipBackupWriter() override {
+    if (initialized_) {
+      deflateEnd(&stream_);
+    }
+    if (out_.is_open()) {
+      out_.close();
+      std::error_code ec;
+      std::filesystem::remove(partial_path_, ec);
+    }
+  }
+
+  bool open(const std::filesystem::path& path) {
+    path_ = path;
+    partial_path_ = path;
+    partial_path_ += ".partial";
+    out_.open(partial_path_, std::ios::binary | std::ios::trunc);
+    if (!out_.is_open()) {
+      return false;
+    }
+    // windowBits 15 + 16 输出 gzip 格式；备份重在速度，使用最快的压缩级别
+    initialized_ = deflateInit2(&stream_, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+                                Z_DEFAULT_STRATEGY) == Z_OK;
+    return initialized_;
+  }
+
+  bool write(std::string_view data) override {
+    while (!data.empty()) {
+      // avail_in 为 uInt，超大块分段送入
+      size_t part = std::min<size_t>(data.size(), 1u << 30);
+      stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+      stream_.avail_in = static_cast<uInt>(part);
+      if (!deflate_all(Z_NO_FLUSH)) {
+        return false;
+      }
+      data.remove_prefix(part);
+    }
+    return true;
+  }
+
+  bool commit() override {
+    stream_.next_in = nullptr;
+    stream_.avail_in = 0;
+    bool ok = deflate_all(Z_FINISH);
+    deflateEnd(&stream_);
+    initialized_ = false;
+    out_.flush();
+    ok = ok && static_cast<bool>(out_);
+    out_.close();
+    std::error_code ec;
+    if (ok) {
+      std::filesystem::rename(partial_path_, path_, ec);
+    }
+    if (!ok || ec) {
+      std::filesystem::remove(partial_path_, ec);
+      return false;
+    }
+    if (drop_page_cache_) {
+      drop_page_cache(path_);
+    }
+    return true;
+  }
+
+ private:
+  bool deflate_all(int flush) {
+    char buffer[64 * 1024];
+    int result;
+    do {
+      stream_.next_out = reinterpret_cast<Bytef*>(buffer);
+      stream_.avail_out = sizeof(buffer);
+      result = deflate(&stream_, flush);
+      if (result == Z_STREAM_ERROR) {
+        return false;
+      }
+      out_.write(buffer, static_cast<std::streamsize>(sizeof(buffer) - stream_.avail_out));
+      if (!out_) {
+        return false;
+      }
+    } while (stream_.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+    return true;
+  }
+
+  std::filesystem::path path_;
+  std::filesystem::path partial_path_;
+  std::ofstream out_;
+  z_stream stream_{};
+  bool initialized_ = false;
+};
+#endif
+
+/**
+ * 为 .userdb.txt 创建一代新的带时间戳备份
+ * 压缩模式下生成 xxx.userdb_backup.<时间戳>.txt.gz（未编译 zlib 时为未压缩的 .txt）
+ */
+inline std::unique_ptr<BackupWriter> open_backup_writer(const std::filesystem::path& userdb_file) {
+  std::filesystem::path base = userdb_file.parent_path() /
+      (backup_prefix_for(userdb_file) + backup_timestamp() + ".txt");
+#ifdef USERDB_CLEANER_HAVE_ZLIB
+  auto writer = std::make_unique<GzipBackupWriter>();
+  base += ".gz";
+#else
+  auto writer = std::make_unique<PlainBackupWriter>();
+#endif
+  if (!writer->open(base)) {
+    return nullptr;
+  }
+  return writer;
+}
+
+/**
+ * 只保留 dir 下以 prefix 开头的最近 generations 代备份（按文件名中的时间戳排序），
+ * 返回删除的数量；写入中的 .partial 文件不计入
+ */
+inline int rotate_generations(const std::filesystem::path& dir, const std::string& prefix, int generations) {
+  std::vector<std::filesystem::path> backups;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+    std::string name = entry.path().filename().string();
+    if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+    std::string_view rest = std::string_view(name).substr(prefix.size());
+    if (rest == "txt" || rest.find(".partial") != std::string_view::npos) continue;
+    backups.push_back(entry.path());
+  }
+  if (generations < 1) generations = 1;
+  if (backups.size() <= static_cast<size_t>(generations)) {
+    return 0;
+  }
+  std::sort(backups.begin(), backups.end());
+  FileOpBatch batch;
+  for (size_t i = 0; i + generations < backups.size(); ++i) {
+    batch.unlink(backups[i]);
+  }
+  return static_cast<int>(batch.run_count());
+}
+
+/**
+ * 只保留最近 generations 代带时间戳的备份，返回删除的备份数量
+ * （不影响复制模式下的 xxx.userdb_backup.txt）
+ */
+inline int rotate_backups(const std::filesystem::path& userdb_file, int generations) {
+  std::filesystem::path dir = userdb_file.has_parent_path() ? userdb_file.parent_path() : ".";
+  return rotate_generations(dir, backup_prefix_for(userdb_file), generations);
+}
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef BATCH_CHECKPOINT_HPP_
+#define BATCH_CHECKPOINT_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+
+#include "userdb_snapshot.hpp"
+
+namespace userdb {
+
+/**
+ * 文件指纹：大小与修改时间，如 "123456-1700000000000000000"；文件不存在时返回空串
+ * 清理后记录输出文件的指纹，重启时指纹不变说明文件清理后未被改动，可以跳过
+ */
+inline std::string file_fingerprint(const std::filesystem::path& path) {
+  std::error_code ec;
+  uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return "";
+  }
+  int64_t mtime = file_mtime(path, ec);
+  if (ec) {
+    return "";
+  }
+  return std::to_string(size) + "-" + std::to_string(mtime);
+}
+
+/**
+ * 批量清理的检查点：每完成一个文件追加一行 tenant<TAB>file<TAB>fingerprint
+ *
+ * 每行以一次 fflush 写出（追加模式下为一次 write），进程崩溃时至多留下不完整的末行，
+ * 读取时忽略。租户全部完成后追加 file 为空、fingerprint 为 "done" 的一行。
+ * 文件在清理结果成批提交（同步并改名，见 durable_commit.hpp）之后才记录，批的大小与间隔
+ * 见 userdb_batch.cc 的 kCommitBatchFiles；崩溃时已写完但尚未提交的文件与正在清理的文件一起重新清理。
+ * 清理先写备份与临时文件再重命名，同一进程重复清理是安全的。
+ */
+class BatchCheckpoint {
+ public:
+  static constexpr std::string_view kTenantDone = "done";
+
+  BatchCheckpoint() = default;
+  ~BatchCheckpoint() { close(); }
+
+  BatchCheckpoint(const BatchCheckpoint&) = delete;
+  BatchCheckpoint& operator=(const BatchCheckpoint&) = delete;
+
+  /**
+   * 读取已有记录并打开文件以追加，文件不存在时新建
+   */
+  bool open(const std::filesystem::path& path) {
+    close();
+    std::lock_guard<std::mutex> lock(mutex_);
+    {
+      std::ifstream in(path, std::ios::binary);
+      std::string line;
+      while (std::getline(in, line)) {
+        // 不以换行结尾的末行是崩溃时未写完的记录
+        if (in.eof()) {
+          break;
+        }
+        if (!line.empty()) {
+          done_.insert(line);
+        }
+      }
+      loaded_ = done_.size();
+    }
+    file_ = std::fopen(path.string().c_str(), "ab");
+    return file_ != nullptr;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_) {
+      std::fclose(file_);
+      file_ = nullptr;
+    }
+  }
+
+  bool contains(std::string_view tenant, std::string_view file, std::string_view fingerprint) const {
+    if (fingerprint.empty()) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_.count(make_line(tenant, file, fingerprint)) != 0;
+  }
+
+  bool tenant_done(std::string_view tenant) const { return contains(tenant, "", kTenantDone); }
+
+  /**
+   * 追加一条记录；路径中含制表符或换行符时不记录（重启后重新清理）
+   */
+  bool record(std::string_view tenant, std::string_view file, std::string_view fingerprint) {
+    if (fingerprint.empty() || !plain(tenant) || !plain(file) || !plain(fingerprint)) {
+      return false;
+    }
+    std::string line = make_line(tenant, file, fingerprint);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_) {
+      return false;
+    }
+    std::string record = line + "\n";
+    bool ok = std::fwrite(record.data(), 1, record.size(), file_) == record.size() && std::fflush(file_) == 0;
+    done_.insert(std::move(line));
+    return ok;
+  }
+
+  // 打开时读到的记录数
+  size_t loaded() const { return loaded_; }
+
+ private:
+  static std::string make_line(std::string_view tenant, std::string_view file, std::string_view fingerprint) {
+    std::string line;
+    line.reserve(tenant.size() + file.size() + fingerprint.size() + 2);
+    line.append(tenant).append(1, '\t').append(file).append(1, '\t').append(fingerprint);
+    return line;
+  }
+
+  static bool plain(std::string_view field) {
+    return field.find_first_of("\t\r\n") == std::string_view::npos;
+  }
+
+  mutable std::mutex mutex_;
+  std::unordered_set<std::string> done_;
+  size_t loaded_ = 0;
+  std::FILE* file_ = nullptr;
+};
+
+}  // namespace userdb
+
+#endif
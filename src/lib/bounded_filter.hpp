@@ -0,0 +1,307 @@
+#ifndef BOUNDED_FILTER_HPP_
+#define BOUNDED_FILTER_HPP_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "backup_store.hpp"
+#include "clean_options.hpp"
+#include "page_cache.hpp"
+#include "userdb_file_filter.hpp"
+#include "userdb_filter.hpp"
+#include "userdb_header.hpp"
+
+namespace userdb {
+
+// 固定内存模式下读、写缓冲区各自的大小，超过该长度的行分段原样写出
+constexpr size_t kBoundedBufferSize = 1 << 20;
+
+/**
+ * 流式写出删除的词条，不在内存中保留词条；格式与 log_deleted_words 相同。
+ * 每个文件删除的词条先由过滤过程写入旁边的暂存文件，该文件替换成功后才 publish 到日志，
+ * 失败或放弃替换的文件 discard，其词条不会出现在日志中。
+ * 第一次 publish 时以追加方式打开日志并写入标题行。同一租户的多个文件可在不同线程中清理，写入互斥。
+ */
+class DeletedWordJournal {
+ public:
+  static constexpr size_t kBufferSize = 64 * 1024;
+
+  /**
+   * @param title 标题行，如 "2024-01-31 23:59:59 Deleted words:"
+   * @param temp_suffix 暂存文件的后缀（见 CleanOptions::temp_suffix）
+   */
+  DeletedWordJournal(std::filesystem::path path, std::string title, std::string temp_suffix = ".cache")
+      : path_(std::move(path)), title_(std::move(title)), temp_suffix_(std::move(temp_suffix)) {}
+  ~DeletedWordJournal() { close(); }
+
+  DeletedWordJournal(const DeletedWordJournal&) = delete;
+  DeletedWordJournal& operator=(const DeletedWordJournal&) = delete;
+
+  /**
+   * 清理 target 时删除的词条的暂存文件：<target>.deleted<临时文件后缀>
+   */
+  std::filesystem::path staging_path(const std::filesystem::path& target) const {
+    std::filesystem::path staged = target;
+    staged += ".deleted" + temp_suffix_;
+    return staged;
+  }
+
+  /**
+   * target 替换成功后调用：把暂存的词条追加到日志并删除暂存文件；没有暂存文件时什么也不做
+   */
+  void publish(const std::filesystem::path& target) {
+    std::filesystem::path staged = staging_path(target);
+    {
+      std::ifstream in(staged, std::ios::binary);
+      if (!in.is_open()) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!opened_) {
+        opened_ = true;
+        buffer_.resize(kBufferSize);
+        out_.rdbuf()->pubsetbuf(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        out_.open(path_, std::ios::app);
+        out_ << title_ << "\n";
+      }
+      std::vector<char> block(kBufferSize);
+      while (in.read(block.data(), static_cast<std::streamsize>(block.size())) || in.gcount() > 0) {
+        size_t n = static_cast<size_t>(in.gcount());
+        out_.write(block.data(), static_cast<std::streamsize>(n));
+        count_ += static_cast<size_t>(std::count(block.data(), block.data() + n, '\n'));
+      }
+    }
+    std::error_code ec;
+    std::filesystem::remove(staged, ec);
+  }
+
+  /**
+   * target 没有被替换（失败或放弃）时调用：删除暂存文件，其中的词条不进入日志
+   */
+  void discard(const std::filesystem::path& target) {
+    std::error_code ec;
+    std::filesystem::remove(staging_path(target), ec);
+  }
+
+  /**
+   * 写出结尾的空行并关闭；返回全部写入是否成功（没有词条时为 true）
+   */
+  bool close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (out_.is_open()) {
+      out_ << "\n";
+      out_.close();
+    }
+    return !opened_ || !out_.fail();
+  }
+
+  size_t count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+  }
+
+  const std::filesystem::path& path() const { return path_; }
+
+ private:
+  const std::filesystem::path path_;
+  const std::string title_;
+  const std::string temp_suffix_;
+  mutable std::mutex mutex_;
+  std::vector<char> buffer_;
+  std::ofstream out_;
+  bool opened_ = false;
+  size_t count_ = 0;
+};
+
+/**
+ * 以固定大小的缓冲区过滤 .userdb.txt，内存占用与文件大小、行长与删除的词条数无关
+ *
+ * 输入按块读入，块内完整的行逐行判断；整个缓冲区中没有换行符的超长行不做判断，
+ * 分段原样写出（计入保留与 lines_oversized）。不支持合并重复词条与跨设备删除，
+ * 调用方应先以 restrict_to_bounded_memory 关闭这些选项。
+ * @param journal 非空时被删除的词条写入其暂存文件，由调用方在替换成功后 publish
+ * @param backup 非空时读入的原始字节同时写入该备份（调用方负责 commit）
+ */
+inline bool filter_userdb_file_bounded(const std::filesystem::path& input,
+                                       const std::filesystem::path& output,
+                                       const CleanOptions& options,
+                                       DeletedWordJournal* journal,
+                                       FileFilterStats* stats = nullptr,
+                                       BackupWriter* backup = nullptr,
+                                       size_t buffer_size = kBoundedBufferSize) {
+#if defined(_WIN32) || defined(_WIN64)
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> in(_wfopen(input.c_str(), L"rb"), &std::fclose);
+#else
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> in(std::fopen(input.c_str(), "rb"), &std::fclose);
+#endif
+  if (!in) {
+    return false;
+  }
+#if !defined(_WIN32) && !defined(_WIN64)
+  advise_sequential(fileno(in.get()));
+#endif
+  std::vector<char> deleted_buffer;
+  std::ofstream deleted;
+  if (journal) {
+    deleted_buffer.resize(DeletedWordJournal::kBufferSize);
+    deleted.rdbuf()->pubsetbuf(deleted_buffer.data(), static_cast<std::streamsize>(deleted_buffer.size()));
+    deleted.open(journal->staging_path(input), std::ios::binary | std::ios::trunc);
+    if (!deleted.is_open()) {
+      return false;
+    }
+  }
+  std::vector<char> out_buffer(buffer_size);
+  std::ofstream out;
+  out.rdbuf()->pubsetbuf(out_buffer.data(), static_cast<std::streamsize>(out_buffer.size()));
+  out.open(output, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return false;
+  }
+
+  FileFilterStats result;
+  auto write = [&](std::string_view data) {
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    result.bytes_written += data.size();
+  };
+
+  // 文件头（开头连续的 '#' 行）原样写出，其中的 tick 决定是否剪除
+  bool in_header = true;
+  uint64_t tick = 0;
+  bool has_tick = false;
+  bool prune = false;
+  IdlePrunePredicate<CValuePredicate> pruned(CValuePredicate(), 0.0);
+  auto end_header = [&]() {
+    in_header = false;
+    prune = options.prune_idle_ticks > 0 && has_tick && tick > options.prune_idle_ticks;
+    if (prune) {
+      pruned = IdlePrunePredicate<CValuePredicate>(CValuePredicate(),
+                                                   static_cast<double>(tick - options.prune_idle_ticks));
+    }
+  };
+  auto process = [&](std::string_view line) {
+    if (in_header) {
+      if (!line.empty() && line.front() == '#') {
+        UserdbHeader field;
+        field.block = line;
+        parse_header_fields(field);
+        if (field.has_tick) {
+          tick = field.tick;
+          has_tick = true;
+        }
+        write(line);
+        write("\n");
+        return;
+      }
+      end_header();
+    }
+    if (line.empty()) {
+      return;
+    }
+    ++result.lines_scanned;
+    if (prune ? pruned(line) : CValuePredicate()(line)) {
+      write(line);
+      write("\n");
+      ++result.lines_kept;
+    } else {
+      if (journal) {
+        deleted << "  - " << extract_word_text(line) << "\n";
+      }
+      ++result.lines_dropped;
+    }
+  };
+
+  std::vector<char> buffer(buffer_size);
+  size_t size = 0;
+  bool passing = false;  // 正在分段写出一个超长行
+  bool backup_ok = true;
+  while (true) {
+    size_t n = std::fread(buffer.data() + size, 1, buffer.size() - size, in.get());
+    if (n == 0 && std::ferror(in.get())) {
+      return false;
+    }
+    if (n > 0 && backup && backup_ok) {
+      backup_ok = backup->write(std::string_view(buffer.data() + size, n));
+    }
+    result.bytes_read += n;
+    size += n;
+    const bool eof = n == 0;
+
+    size_t pos = 0;
+    while (pos < size) {
+      const char* newline = static_cast<const char*>(std::memchr(buffer.data() + pos, '\n', size - pos));
+      if (!newline) {
+        break;
+      }
+      size_t end = static_cast<size_t>(newline - buffer.data());
+      if (passing) {
+        write(std::string_view(buffer.data() + pos, end - pos + 1));
+        passing = false;
+      } else {
+        process(std::string_view(buffer.data() + pos, end - pos));
+      }
+      pos = end + 1;
+    }
+
+    if (passing) {
+      write(std::string_view(buffer.data() + pos, size - pos));
+      pos = size;
+    } else if (pos == 0 && size == buffer.size()) {
+      // 整个缓冲区都不含换行符：无法判断的超长行原样保留
+      if (in_header && buffer.front() != '#') {
+        end_header();
+      }
+      if (!in_header) {
+        ++result.lines_scanned;
+        ++result.lines_kept;
+        ++result.lines_oversized;
+      }
+      write(std::string_view(buffer.data(), size));
+      passing = true;
+      pos = size;
+    }
+
+    if (eof) {
+      // 末行没有换行符时补上
+      if (passing) {
+        write("\n");
+      } else if (pos < size) {
+        process(std::string_view(buffer.data() + pos, size - pos));
+      }
+      break;
+    }
+    std::memmove(buffer.data(), buffer.data() + pos, size - pos);
+    size -= pos;
+  }
+
+  out.flush();
+  if (journal) {
+    deleted.close();
+  }
+  if (!out || !backup_ok || !deleted.good()) {
+    return false;
+  }
+  if (options.drop_page_cache) {
+    out.close();
+    drop_page_cache(output);
+#if !defined(_WIN32) && !defined(_WIN64)
+    drop_cached_range(fileno(in.get()));
+#endif
+  }
+  if (stats) {
+    *stats = result;
+  }
+  return true;
+}
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef CHUNK_STORE_HPP_
+#define CHUNK_STORE_HPP_
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "backup_store.hpp"
+#include "file_op_batch.hpp"
+#include "mapped_file.hpp"
+#include "sha256.hpp"
+#include "userdb_filter.hpp"
+
+namespace userdb {
+
+// ---------------------------------------------------------------------------
+// 分块去重备份仓库
+//
+// 同一 .userdb.txt 相邻两次的备份几乎完全相同。按内容定义的边界（Gear 滚动哈希，
+// FastCDC 归一化分块）把文件切成变长分块，每个分块以其 SHA-256 命名只存一份：
+//   <仓库>/chunks/ab/abcdef...       分块原始内容
+//   <仓库>/manifests/<设备>/xxx.userdb_backup.<时间戳>.manifest
+// 每一代备份只是一份清单，依次列出组成文件的分块。插入或修改几行只会改变
+// 附近的一两个分块，其余分块在各代之间共享。
+// ---------------------------------------------------------------------------
+
+constexpr size_t kChunkMinSize = 2 * 1024;
+constexpr size_t kChunkAvgSize = 8 * 1024;
+constexpr size_t kChunkMaxSize = 64 * 1024;
+
+namespace detail {
+
+struct GearTable {
+  uint64_t values[256];
+};
+
+// 用 splitmix64 在编译期生成固定的 Gear 表，保证各版本切分结果一致
+constexpr GearTable make_gear_table() {
+  GearTable table{};
+  uint64_t seed = 0x5255444243444331ull;
+  for (auto& value : table.values) {
+    seed += 0x9e3779b97f4a7c15ull;
+    uint64_t z = seed;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    value = z ^ (z >> 31);
+  }
+  return table;
+}
+
+constexpr GearTable kGearTable = make_gear_table();
+
+// Gear 哈希的高位受最近字节影响最充分，掩码取高位；
+// 平均长度之前用更严格的掩码（15 位），之后用更宽松的掩码（11 位）
+constexpr uint64_t kMaskStrict = ~0ull << (64 - 15);
+constexpr uint64_t kMaskLoose = ~0ull << (64 - 11);
+
+}  // namespace detail
+
+/**
+ * 在 data 开头寻找分块边界
+ * @return 分块长度；找不到边界时返回 min(size, kChunkMaxSize)
+ */
+inline size_t find_chunk_boundary(const char* data, size_t size) {
+  if (size <= kChunkMinSize) {
+    return size;
+  }
+  size_t limit = size < kChunkMaxSize ? size : kChunkMaxSize;
+  size_t normal = limit < kChunkAvgSize ? limit : kChunkAvgSize;
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+  uint64_t hash = 0;
+  size_t i = kChunkMinSize;
+  for (; i < normal; ++i) {
+    hash = (hash << 1) + detail::kGearTable.values[bytes[i]];
+    if ((hash & detail::kMaskStrict) == 0) return i + 1;
+  }
+  for (; i < limit; ++i) {
+    hash = (hash << 1) + detail::kGearTable.values[bytes[i]];
+    if ((hash & detail::kMaskLoose) == 0) return i + 1;
+  }
+  return limit;
+}
+
+inline std::filesystem::path chunk_path(const std::filesystem::path& repo, const std::string& hex) {
+  return repo / "chunks" / hex.substr(0, 2) / hex;
+}
+
+/**
+ * .userdb.txt 在仓库中的清单目录：<仓库>/manifests/<所在设备目录名>
+ */
+inline std::filesystem::path manifest_dir_for(const std::filesystem::path& repo,
+                                              const std::filesystem::path& userdb_file) {
+  return repo / "manifests" / userdb_file.parent_path().filename();
+}
+
+/**
+ * 原子地写出一个文件：先写入同目录下的临时文件，再改名
+ */
+inline bool write_file_atomically(const std::filesystem::path& path, std::string_view data) {
+  std::filesystem::path temp = path;
+  temp += ".partial." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      return false;
+    }
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.flush();
+    if (!out) {
+      out.close();
+      std::error_code ec;
+      std::filesystem::remove(temp, ec);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * 把备份内容切块写入仓库，commit 时写出本代清单
+ * 仓库中已有的分块不会重复写入，各线程可同时向同一仓库写入不同文件的备份
+ */
+class ChunkedBackupWriter : public BackupWriter {
+ public:
+  bool open(const std::filesystem::path& repo, const std::filesystem::path& userdb_file) {
+    repo_ = repo;
+    manifest_path_ = manifest_dir_for(repo, userdb_file) /
+        (backup_prefix_for(userdb_file) + backup_timestamp() + ".manifest");
+    std::error_code ec;
+    std::filesystem::create_directories(manifest_path_.parent_path(), ec);
+    manifest_ = "# userdb backup manifest\n#@/source\t" +
+                userdb_file.parent_path().filename().string() + "/" +
+                userdb_file.filename().string() + "\n";
+    return !ec;
+  }
+
+  bool write(std::string_view data) override {
+    pending_.append(data.data(), data.size());
+    return emit(false);
+  }
+
+  bool commit() override {
+    if (!emit(true)) {
+      return false;
+    }
+    manifest_ += "#@/size\t" + std::to_string(total_size_) + "\n";
+    manifest_ += entries_;
+    if (!write_file_atomically(manifest_path_, manifest_)) {
+      return false;
+    }
+    if (drop_page_cache_) {
+      drop_page_cache(manifest_path_);
+    }
+    return true;
+  }
+
+  uint64_t chunks_written() const { return chunks_written_; }
+  uint64_t bytes_written() const { return bytes_written_; }
+
+ private:
+  // 切出所有边界已确定的分块；final 为 true 时剩余内容作为最后一块
+  bool emit(bool final) {
+    size_t pos = 0;
+    while (pos < pending_.size()) {
+      size_t remaining = pending_.size() - pos;
+      size_t cut = find_chunk_boundary(pending_.data() + pos, remaining);
+      // 边界落在缓冲区末尾且尚未达到最大长度时，后续数据可能改变结果
+      if (cut == remaining && remaining < kChunkMaxSize && !final) {
+        break;
+      }
+      if (!store(std::string_view(pending_).substr(pos, cut))) {
+        return false;
+      }
+      pos += cut;
+    }
+    pending_.erase(0, pos);
+    return true;
+  }
+
+  bool store(std::string_view chunk) {
+    std::string hex = Sha256::hex(chunk);
+    entries_ += hex;
+    entries_ += '\t';
+    entries_ += std::to_string(chunk.size());
+    entries_ += '\n';
+    total_size_ += chunk.size();
+    if (!stored_.insert(hex).second) {
+      return true;
+    }
+    std::filesystem::path path = chunk_path(repo_, hex);
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec)) {
+      return true;
+    }
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (!write_file_atomically(path, chunk)) {
+      return false;
+    }
+    if (drop_page_cache_) {
+      drop_page_cache(path);
+    }
+    ++chunks_written_;
+    bytes_written_ += chunk.size();
+    return true;
+  }
+
+  std::filesystem::path repo_;
+  std::filesystem::path manifest_path_;
+  std::string pending_;
+  std::string manifest_;
+  std::string entries_;
+  std::unordered_set<std::string> stored_;
+  uint64_t total_size_ = 0;
+  uint64_t chunks_written_ = 0;
+  uint64_t bytes_written_ = 0;
+};
+
+/**
+ * 依次读取清单中的分块（hex, size）
+ */
+template <class Fn>
+bool for_each_manifest_chunk(std::string_view manifest, Fn&& fn) {
+  MappedLineReader read(manifest.data(), manifest.size());
+  std::string_view line;
+  while (read(line)) {
+    if (line.empty() || line[0] == '#') continue;
+    size_t tab = line.find('\t');
+    if (tab != 64) {
+      return false;
+    }
+    std::string_view field = line.substr(tab + 1);
+    uint64_t size = 0;
+    auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), size);
+    if (ec != std::errc() || !fn(line.substr(0, tab), size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * 按清单从仓库还原一代备份，逐块校验长度与 SHA-256
+ * 先写入 output 旁的临时文件，全部校验通过后才改名为 output，失败时 output 保持原样
+ */
+inline bool restore_chunked_backup(const std::filesystem::path& repo,
+                                   const std::filesystem::path& manifest_path,
+                                   const std::filesystem::path& output) {
+  InputBuffer manifest;
+  if (!manifest.open(manifest_path)) {
+    return false;
+  }
+  std::filesystem::path temp = output;
+  temp += ".partial";
+  std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return false;
+  }
+  bool ok = for_each_manifest_chunk(manifest.view(), [&](std::string_view hex, uint64_t size) {
+    InputBuffer chunk;
+    if (!chunk.open(chunk_path(repo, std::string(hex)))) {
+      return false;
+    }
+    std::string_view data = chunk.view();
+    if (data.size() != size || Sha256::hex(data) != hex) {
+      return false;
+    }
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+  });
+  out.close();
+  std::error_code ec;
+  if (ok && out) {
+    std::filesystem::rename(temp, output, ec);
+    if (!ec) {
+      return true;
+    }
+  }
+  std::filesystem::remove(temp, ec);
+  return false;
+}
+
+/**
+ * 只保留某个 .userdb.txt 最近 generations 代清单，返回删除的清单数量
+ * 不再被引用的分块由 collect_chunk_garbage 统一回收
+ */
+inline int rotate_chunked_backups(const std::filesystem::path& repo,
+                                  const std::filesystem::path& userdb_file, int generations) {
+  return rotate_generations(manifest_dir_for(repo, userdb_file), backup_prefix_for(userdb_file), generations);
+}
+
+struct ChunkGcStats {
+  uint64_t chunks_kept = 0;
+  uint64_t chunks_removed = 0;
+  uint64_t bytes_removed = 0;
+};
+
+/**
+ * 标记-清除：删除不被任何清单引用的分块，以及一天前中断写入留下的临时文件
+ * 须在没有备份正在写入该仓库时调用
+ */
+inline ChunkGcStats collect_chunk_garbage(const std::filesystem::path& repo) {
+  ChunkGcStats stats;
+  std::unordered_set<std::string> referenced;
+  std::error_code ec;
+  for (std::filesystem::recursive_directory_iterator it(repo / "manifests", ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (!it->is_regular_file(ec) || it->path().extension() != ".manifest") continue;
+    InputBuffer manifest;
+    if (!manifest.open(it->path()) ||
+        !for_each_manifest_chunk(manifest.view(), [&](std::string_view hex, uint64_t) {
+          referenced.emplace(hex);
+          return true;
+        })) {
+      // 无法完整读取某个清单时不回收任何分块，以免误删
+      return stats;
+    }
+  }
+  if (ec) {
+    return stats;
+  }
+
+  // 先列出再删除，避免边遍历边修改目录；删除成批提交
+  std::vector<std::filesystem::path> garbage;
+  std::vector<uint64_t> sizes;
+  auto stale_before = std::filesystem::file_time_type::clock::now() - std::chrono::hours(24);
+  for (std::filesystem::recursive_directory_iterator it(repo / "chunks", ec), end; !ec && it != end;
+       it.increment(ec)) {
+    std::error_code entry_ec;
+    if (!it->is_regular_file(entry_ec)) continue;
+    std::string name = it->path().filename().string();
+    bool collect = false;
+    if (name.size() > 64 && name.find(".partial.") == 64) {
+      collect = std::filesystem::last_write_time(it->path(), entry_ec) < stale_before && !entry_ec;
+    } else if (referenced.count(name) > 0) {
+      ++stats.chunks_kept;
+    } else {
+      collect = true;
+    }
+    if (collect) {
+      uint64_t size = it->file_size(entry_ec);
+      garbage.push_back(it->path());
+      sizes.push_back(entry_ec ? 0 : size);
+    }
+  }
+  FileOpBatch batch;
+  for (const auto& path : garbage) {
+    batch.unlink(path);
+  }
+  std::vector<std::error_code> results = batch.run();
+  for (size_t i = 0; i < garbage.size(); ++i) {
+    if (!results[i]) {
+      stats.bytes_removed += sizes[i];
+      stats.chunks_removed += garbage[i].filename().string().size() == 64 ? 1 : 0;
+    }
+  }
+  return stats;
+}
+
+}  // namespace userdb
+
+#endif
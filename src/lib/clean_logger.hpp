@@ -0,0 +1,311 @@
+#ifndef CLEAN_LOGGER_HPP_
+#define CLEAN_LOGGER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace userdb {
+
+enum class LogLevel {
+  kVerbose,  // 逐条明细（包含/跳过的文件、删除的词条等），默认不输出
+  kInfo,
+  kWarning,
+  kError,
+};
+
+// 限速按类别分别计算
+enum class LogCategory {
+  kGeneral,      // 任务开始、汇总、部署等
+  kDiscovery,    // 查找 .userdb 文件夹与 .userdb.txt 文件
+  kPurge,        // 清空 .userdb 文件夹
+  kFile,         // 逐文件清理与合并
+  kBackup,       // 备份与备份仓库
+  kDeletedWord,  // 逐条删除的词条
+  kCount,
+};
+
+inline const char* log_category_name(LogCategory category) {
+  switch (category) {
+    case LogCategory::kGeneral: return "general";
+    case LogCategory::kDiscovery: return "discovery";
+    case LogCategory::kPurge: return "purge";
+    case LogCategory::kFile: return "file";
+    case LogCategory::kBackup: return "backup";
+    case LogCategory::kDeletedWord: return "deleted_word";
+    default: return "unknown";
+  }
+}
+
+/**
+ * 清理路径使用的日志：
+ *   - start() 后消息进入有界队列，由后台线程写到 sink；未启动时同步写出
+ *   - kVerbose 消息仅在 set_verbose(true) 时输出；明细是显式要求的，不限速也不丢弃
+ *   - kInfo 按类别以令牌桶限速，kWarning / kError 不限速
+ *   - 队列已满时丢弃 kInfo / kWarning 消息，kVerbose 与 kError 消息等待队列腾出空间
+ *   - 有消息被丢弃时，每秒至多输出一行汇总，stop() 时输出剩余的汇总
+ */
+class CleanLogger {
+ public:
+  using Sink = std::function<void(LogLevel, const std::string&)>;
+
+  explicit CleanLogger(Sink sink, size_t capacity = 4096) : sink_(std::move(sink)), capacity_(capacity) {}
+
+  ~CleanLogger() { stop(); }
+
+  CleanLogger(const CleanLogger&) = delete;
+  CleanLogger& operator=(const CleanLogger&) = delete;
+
+  void set_sink(Sink sink) {
+    std::lock_guard<std::mutex> sink_lock(sink_mutex_);
+    sink_ = std::move(sink);
+  }
+
+  void set_verbose(bool verbose) { verbose_.store(verbose, std::memory_order_relaxed); }
+  bool verbose() const { return verbose_.load(std::memory_order_relaxed); }
+
+  /**
+   * 每个类别每秒最多 per_second 条，允许突发 per_second 条；0 表示不限速
+   */
+  void set_rate_limit(double per_second) {
+    std::lock_guard<std::mutex> lock(rate_mutex_);
+    per_second_ = per_second;
+    auto now = std::chrono::steady_clock::now();
+    for (auto& bucket : buckets_) {
+      bucket.tokens = per_second;
+      bucket.refilled = now;
+    }
+  }
+
+  void start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+      return;
+    }
+    stopping_ = false;
+    running_ = true;
+    last_summary_ = std::chrono::steady_clock::now();
+    worker_ = std::thread([this]() { run(); });
+  }
+
+  /**
+   * 写出队列中剩余的消息与丢弃汇总，然后停止后台线程
+   */
+  void stop() {
+    {
+      // 此后提交的消息同步写出，后台线程只需写完已入队的消息
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (running_) {
+        stopping_ = true;
+        running_ = false;
+      }
+    }
+    cv_.notify_all();
+    not_full_.notify_all();
+    if (worker_.joinable()) {
+      worker_.join();
+    }
+    report_drops();
+  }
+
+  /**
+   * 判断消息是否需要格式化；被限速的消息计入丢弃数
+   */
+  bool admit(LogLevel level, LogCategory category) {
+    if (level == LogLevel::kVerbose) {
+      return verbose();
+    }
+    if (level >= LogLevel::kWarning) {
+      return true;
+    }
+    std::lock_guard<std::mutex> lock(rate_mutex_);
+    if (per_second_ <= 0) {
+      return true;
+    }
+    Bucket& bucket = buckets_[static_cast<size_t>(category)];
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+    bucket.refilled = now;
+    bucket.tokens = std::min(per_second_, bucket.tokens + elapsed * per_second_);
+    if (bucket.tokens >= 1.0) {
+      bucket.tokens -= 1.0;
+      return true;
+    }
+    rate_dropped_[static_cast<size_t>(category)].fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  void submit(LogLevel level, LogCategory category, std::string message) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!running_) {
+      lock.unlock();
+      std::lock_guard<std::mutex> sink_lock(sink_mutex_);
+      sink_(level, message);
+      return;
+    }
+    if (queue_.size() >= capacity_) {
+      if (level != LogLevel::kError && level != LogLevel::kVerbose) {
+        queue_dropped_[static_cast<size_t>(category)].fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      not_full_.wait(lock, [&]() { return queue_.size() < capacity_ || !running_; });
+      if (!running_) {
+        lock.unlock();
+        std::lock_guard<std::mutex> sink_lock(sink_mutex_);
+        sink_(level, message);
+        return;
+      }
+    }
+    queue_.push_back({level, std::move(message)});
+    lock.unlock();
+    cv_.notify_one();
+  }
+
+  uint64_t dropped() const { return total_dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Entry {
+    LogLevel level;
+    std::string message;
+  };
+
+  struct Bucket {
+    double tokens = 0;
+    std::chrono::steady_clock::time_point refilled = std::chrono::steady_clock::now();
+  };
+
+  static constexpr size_t kCategories = static_cast<size_t>(LogCategory::kCount);
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait_for(lock, std::chrono::seconds(1), [&]() { return stopping_ || !queue_.empty(); });
+      std::deque<Entry> batch;
+      batch.swap(queue_);
+      bool stopping = stopping_;
+      lock.unlock();
+      not_full_.notify_all();
+      {
+        std::lock_guard<std::mutex> sink_lock(sink_mutex_);
+        for (const auto& entry : batch) {
+          sink_(entry.level, entry.message);
+        }
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_summary_ >= std::chrono::seconds(1)) {
+        last_summary_ = now;
+        report_drops();
+      }
+      lock.lock();
+      if (stopping && queue_.empty()) {
+        break;
+      }
+    }
+  }
+
+  // 汇总自上次汇总以来丢弃的消息，如 "... deleted_word: 1200 rate limited, file: 3 queue full"
+  void report_drops() {
+    std::string summary;
+    uint64_t total = 0;
+    for (size_t i = 0; i < kCategories; ++i) {
+      const char* name = log_category_name(static_cast<LogCategory>(i));
+      uint64_t limited = rate_dropped_[i].exchange(0, std::memory_order_relaxed);
+      uint64_t full = queue_dropped_[i].exchange(0, std::memory_order_relaxed);
+      if (limited) {
+        summary += (summary.empty() ? "" : ", ") + std::string(name) + ": " + std::to_string(limited) + " rate limited";
+      }
+      if (full) {
+        summary += (summary.empty() ? "" : ", ") + std::string(name) + ": " + std::to_string(full) + " queue full";
+      }
+      total += limited + full;
+    }
+    if (total == 0) {
+      return;
+    }
+    total_dropped_.fetch_add(total, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> sink_lock(sink_mutex_);
+    sink_(LogLevel::kWarning, "Dropped " + std::to_string(total) + " log messages (" + summary + ")");
+  }
+
+  Sink sink_;
+  const size_t capacity_;
+  std::atomic<bool> verbose_{false};
+
+  std::mutex rate_mutex_;
+  double per_second_ = 0;
+  Bucket buckets_[kCategories];
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable not_full_;
+  std::deque<Entry> queue_;
+  bool running_ = false;
+  bool stopping_ = false;
+  std::thread worker_;
+  std::chrono::steady_clock::time_point last_summary_;
+
+  std::mutex sink_mutex_;
+  std::atomic<uint64_t> rate_dropped_[kCategories] = {};
+  std::atomic<uint64_t> queue_dropped_[kCategories] = {};
+  std::atomic<uint64_t> total_dropped_{0};
+};
+
+/**
+ * 一条日志的格式化缓冲，析构时提交给 CleanLogger
+ */
+class LogMessage {
+ public:
+  LogMessage(CleanLogger& logger, LogLevel level, LogCategory category)
+      : logger_(logger), level_(level), category_(category) {}
+
+  ~LogMessage() { logger_.submit(level_, category_, stream_.str()); }
+
+  std::ostream& stream() { return stream_; }
+
+ private:
+  CleanLogger& logger_;
+  LogLevel level_;
+  LogCategory category_;
+  std::ostringstream stream_;
+};
+
+// 把 "cond ? (void)0 : stream << ..." 两个分支统一为 void
+struct LogVoidify {
+  void operator&(std::ostream&) {}
+};
+
+/**
+ * 在 start() 与 stop() 之间启用异步写出
+ */
+class ScopedAsyncLog {
+ public:
+  explicit ScopedAsyncLog(CleanLogger& logger) : logger_(logger) { logger_.start(); }
+  ~ScopedAsyncLog() { logger_.stop(); }
+
+  ScopedAsyncLog(const ScopedAsyncLog&) = delete;
+  ScopedAsyncLog& operator=(const ScopedAsyncLog&) = delete;
+
+ private:
+  CleanLogger& logger_;
+};
+
+}  // namespace userdb
+
+// 被限速或未启用的消息不做格式化
+#define USERDB_LOG(logger, level, category)                       \
+  !(logger).admit(level, category) ? (void)0                      \
+                                   : ::userdb::LogVoidify() &     \
+                                         ::userdb::LogMessage(logger, level, category).stream()
+
+#endif
@@ -0,0 +1,276 @@
+#ifndef CLEAN_METRICS_HPP_
+#define CLEAN_METRICS_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "clean_options.hpp"
+#include "phase_timer.hpp"
+#include "userdb_file_filter.hpp"
+
+namespace userdb {
+
+// 单个 .userdb.txt 的清理结果
+struct FileMetrics {
+  std::string file;  // <设备目录>/<文件名>
+  uint64_t bytes_read = 0;
+  uint64_t bytes_written = 0;
+  uint64_t lines_scanned = 0;
+  uint64_t lines_deleted = 0;
+  uint64_t lines_merged = 0;
+  uint64_t nanos = 0;
+  bool skipped = false;  // 快照显示无需清理
+  bool ok = true;
+
+  static FileMetrics from_stats(const std::filesystem::path& path, const FileFilterStats& stats) {
+    FileMetrics metrics;
+    metrics.file = path.parent_path().filename().string() + "/" + path.filename().string();
+    metrics.bytes_read = stats.bytes_read;
+    metrics.bytes_written = stats.bytes_written;
+    metrics.lines_scanned = stats.lines_scanned;
+    metrics.lines_deleted = stats.lines_dropped;
+    metrics.lines_merged = stats.lines_merged;
+    return metrics;
+  }
+};
+
+/**
+ * 进程峰值常驻内存（字节），无法获取时返回 0
+ */
+inline uint64_t peak_rss_bytes() {
+#if defined(_WIN32) || defined(_WIN64)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return static_cast<uint64_t>(counters.PeakWorkingSetSize);
+  }
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+inline std::string json_escape(std::string_view text) {
+  std::string out;
+  out.reserve(text.size());
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buffer[8];
+      std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned char>(c));
+      out += buffer;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+inline const char* merge_rule_name(MergeRule rule) {
+  switch (rule) {
+    case MergeRule::kMaxC: return "max_c";
+    case MergeRule::kMaxT: return "max_t";
+    case MergeRule::kSumC: return "sum_c";
+    default: return "none";
+  }
+}
+
+inline const char* backup_mode_name(BackupMode mode) {
+  switch (mode) {
+    case BackupMode::kCompressed: return "compressed";
+    case BackupMode::kChunked: return "chunked";
+    default: return "copy";
+  }
+}
+
+/**
+ * 一次清理任务的指标：各阶段耗时、逐文件统计与进程资源占用
+ * 各文件可在不同线程中并行记录
+ */
+class CleanMetrics {
+ public:
+  PhaseTimings phases;
+
+  void add_file(FileMetrics file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_.push_back(std::move(file));
+  }
+
+  void use_threads(size_t threads) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_ = std::max(threads_, threads);
+  }
+
+  void set_folder_files_deleted(int count) { folder_files_deleted_ = count; }
+  void set_total_nanos(uint64_t nanos) { total_nanos_ = nanos; }
+
+  const std::vector<FileMetrics>& files() const { return files_; }
+  size_t threads() const { return threads_; }
+  uint64_t total_nanos() const { return total_nanos_; }
+
+  /**
+   * 输出为一行 JSON（不含换行符）
+   * @param time 记录时间，如 2024-01-31 23:59:59
+   */
+  std::string to_json(const CleanOptions& options, std::string_view time) const {
+    FileMetrics total;
+    for (const auto& file : files_) {
+      total.bytes_read += file.bytes_read;
+      total.bytes_written += file.bytes_written;
+      total.lines_scanned += file.lines_scanned;
+      total.lines_deleted += file.lines_deleted;
+      total.lines_merged += file.lines_merged;
+    }
+
+    std::string json = "{\"time\":\"" + json_escape(time) + "\"";
+    auto field = [&](const char* name, uint64_t value) {
+      json += ",\"";
+      json += name;
+      json += "\":";
+      json += std::to_string(value);
+    };
+    auto millis = [&](const char* name, uint64_t nanos) {
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(nanos) / 1e6);
+      json += ",\"";
+      json += name;
+      json += "\":";
+      json += buffer;
+    };
+    millis("duration_ms", total_nanos_);
+    millis("deployer_ms", phases.nanos(CleanPhase::kDeployer));
+    field("peak_rss_bytes", peak_rss_bytes());
+    field("threads", threads_);
+    field("folder_files_deleted", static_cast<uint64_t>(folder_files_deleted_ < 0 ? 0 : folder_files_deleted_));
+    field("files", files_.size());
+    field("bytes_read", total.bytes_read);
+    field("bytes_written", total.bytes_written);
+    field("lines_scanned", total.lines_scanned);
+    field("lines_deleted", total.lines_deleted);
+    field("lines_merged", total.lines_merged);
+
+    json += ",\"options\":{\"merge_duplicates\":\"";
+    json += merge_rule_name(options.merge_rule);
+    json += "\",\"backup_mode\":\"";
+    json += backup_mode_name(options.backup_mode);
+    json += "\",\"consolidate_devices\":";
+    json += options.consolidate_devices ? "true" : "false";
+    json += ",\"propagate_deletions\":";
+    json += options.propagate_deletions ? "true" : "false";
+    json += ",\"binary_snapshot\":";
+    json += options.binary_snapshot ? "true" : "false";
+    json += "}";
+
+    json += ",\"phases_ms\":{";
+    for (size_t i = 0; i < static_cast<size_t>(CleanPhase::kCount); ++i) {
+      char buffer[64];
+      CleanPhase phase = static_cast<CleanPhase>(i);
+      std::snprintf(buffer, sizeof(buffer), "%s\"%s\":%.3f", i ? "," : "", phase_name(phase),
+                    phases.millis(phase));
+      json += buffer;
+    }
+    json += "}";
+
+    json += ",\"per_file\":[";
+    for (size_t i = 0; i < files_.size(); ++i) {
+      const FileMetrics& file = files_[i];
+      json += i ? ",{" : "{";
+      json += "\"file\":\"" + json_escape(file.file) + "\"";
+      field("bytes_read", file.bytes_read);
+      field("bytes_written", file.bytes_written);
+      field("lines_scanned", file.lines_scanned);
+      field("lines_deleted", file.lines_deleted);
+      field("lines_merged", file.lines_merged);
+      millis("ms", file.nanos);
+      if (file.skipped) json += ",\"skipped\":true";
+      if (!file.ok) json += ",\"ok\":false";
+      json += "}";
+    }
+    json += "]}";
+    return json;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<FileMetrics> files_;
+  size_t threads_ = 1;
+  int folder_files_deleted_ = 0;
+  uint64_t total_nanos_ = 0;
+};
+
+/**
+ * 记录单个文件的清理耗时与结果，析构时写入 CleanMetrics
+ * 未调用 succeed / skip 即离开作用域的文件记为失败
+ */
+class ScopedFileMetrics {
+ public:
+  ScopedFileMetrics(CleanMetrics& metrics, const std::filesystem::path& path)
+      : metrics_(metrics), path_(path), start_(std::chrono::steady_clock::now()) {
+    file_.ok = false;
+  }
+
+  ~ScopedFileMetrics() {
+    if (file_.file.empty()) {
+      file_.file = path_.parent_path().filename().string() + "/" + path_.filename().string();
+    }
+    file_.nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_).count());
+    metrics_.add_file(std::move(file_));
+  }
+
+  void succeed(const FileFilterStats& stats) { file_ = FileMetrics::from_stats(path_, stats); }
+
+  void skip() {
+    file_.skipped = true;
+    file_.ok = true;
+  }
+
+  ScopedFileMetrics(const ScopedFileMetrics&) = delete;
+  ScopedFileMetrics& operator=(const ScopedFileMetrics&) = delete;
+
+ private:
+  CleanMetrics& metrics_;
+  std::filesystem::path path_;
+  std::chrono::steady_clock::time_point start_;
+  FileMetrics file_;
+};
+
+/**
+ * 以追加方式写入一行 JSON 指标
+ */
+inline bool append_metrics_line(const std::filesystem::path& path, const std::string& line) {
+  std::ofstream out(path, std::ios::app | std::ios::binary);
+  if (!out.is_open()) {
+    return false;
+  }
+  out << line << '\n';
+  return static_cast<bool>(out);
+}
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef CLEAN_OPTIONS_HPP_
+#define CLEAN_OPTIONS_HPP_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace userdb {
+
+// 重复词条（编码<TAB>词条相同）的合并规则
+enum class MergeRule {
+  kNone,  // 不合并，保留全部重复行
+  kMaxC,  // 保留 c 最大的一行
+  kMaxT,  // 保留 t 最大（最近使用）的一行
+  kSumC,  // 以 t 最大的一行为准，c 取所有重复行之和
+};
+
+/**
+ * 解析配置中的合并规则名称（none / max_c / max_t / sum_c）
+ */
+inline bool parse_merge_rule(std::string_view name, MergeRule* rule) {
+  if (name == "none") {
+    *rule = MergeRule::kNone;
+  } else if (name == "max_c") {
+    *rule = MergeRule::kMaxC;
+  } else if (name == "max_t") {
+    *rule = MergeRule::kMaxT;
+  } else if (name == "sum_c") {
+    *rule = MergeRule::kSumC;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// 清理前备份原文件的方式
+enum class BackupMode {
+  kCopy,        // 复制为 xxx.userdb_backup.txt（每次覆盖）
+  kCompressed,  // 清理时流式压缩为带时间戳的 .txt.gz，保留最近若干代
+  kChunked,     // 分块去重写入备份仓库，每代只增加一份清单和变化的分块
+};
+
+/**
+ * 解析配置中的备份方式名称（copy / compressed / chunked）
+ */
+inline bool parse_backup_mode(std::string_view name, BackupMode* mode) {
+  if (name == "copy") {
+    *mode = BackupMode::kCopy;
+  } else if (name == "compressed") {
+    *mode = BackupMode::kCompressed;
+  } else if (name == "chunked") {
+    *mode = BackupMode::kChunked;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// 一次清理任务的配置
+struct CleanOptions {
+  std::vector<std::string> cleanup_list;    // 需要清理的userdb列表，为空则清理全部
+  bool full_information_display = false;    // 是否显示完整清理信息
+  bool record_deleted_words = true;         // 是否记录被删除的词条，关闭后走不捕获词条的快速路径
+  MergeRule merge_rule = MergeRule::kNone;  // 同一文件内重复词条的合并规则
+  bool consolidate_devices = false;         // 是否把各设备下的同名 .userdb.txt 合并为一个文件
+  bool propagate_deletions = false;         // 是否把某个设备上删除的词条从其他设备的副本中一并删除
+  uint64_t prune_idle_ticks = 0;            // 删除 t 落后文件头 tick 超过该值的词条，0 表示不剪除
+  bool binary_snapshot = false;             // 是否在 .userdb.txt 旁维护二进制快照 .userdb.snap
+  BackupMode backup_mode = BackupMode::kCopy;  // 备份方式
+  int backup_generations = 5;               // 带时间戳的备份保留的代数
+  std::string backup_repo;                  // chunked 模式下的备份仓库目录
+  bool record_metrics = true;               // 是否把每次清理的指标追加到 userdb_cleaner_metrics.jsonl
+  bool trace = false;                       // 是否把本次清理的 trace 写入 userdb_cleaner_trace.json
+  bool log_verbose = false;                 // 是否输出逐条明细日志（包含/跳过的文件、删除的词条等）
+  int log_rate_limit = 100;                 // 每类日志（明细除外）每秒最多输出的条数，0 表示不限速
+  bool bounded_memory = false;              // 固定内存模式：定长缓冲区读写，删除的词条经暂存文件写入日志
+  bool drop_page_cache = false;             // 写完的输出与备份回写后从页缓存中丢弃，不挤占输入法常用的页
+  bool durable_commit = true;               // 替换原文件前把所有新文件一起同步到磁盘，崩溃后不会留下空文件
+  std::string temp_suffix = ".cache";       // 输出与快照临时文件的后缀；多个进程分担批量任务时各不相同
+};
+
+/**
+ * 固定内存模式下关闭内存占用随词条数增长的功能：合并重复词条（去重表）、
+ * 合并设备副本与跨设备删除（已删除词条集合）、二进制快照（内存中的索引）
+ * @return 被关闭的配置项名称
+ */
+inline std::vector<std::string_view> restrict_to_bounded_memory(CleanOptions& options) {
+  std::vector<std::string_view> disabled;
+  if (options.merge_rule != MergeRule::kNone) {
+    options.merge_rule = MergeRule::kNone;
+    disabled.push_back("merge_duplicates");
+  }
+  if (options.consolidate_devices) {
+    options.consolidate_devices = false;
+    disabled.push_back("consolidate_devices");
+  }
+  if (options.propagate_deletions) {
+    options.propagate_deletions = false;
+    disabled.push_back("propagate_deletions");
+  }
+  if (options.binary_snapshot) {
+    options.binary_snapshot = false;
+    disabled.push_back("binary_snapshot");
+  }
+  return disabled;
+}
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef DURABLE_COMMIT_HPP_
+#define DURABLE_COMMIT_HPP_
+
+#include <algorithm>
+#include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "file_op_batch.hpp"
+#include "parallel_for.hpp"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace userdb {
+
+/**
+ * 把文件内容（不含元数据）同步到磁盘
+ */
+inline std::error_code sync_file(const std::filesystem::path& path) {
+#if defined(_WIN32) || defined(_WIN64)
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return std::error_code(static_cast<int>(GetLastError()), std::system_category());
+  }
+  DWORD error = FlushFileBuffers(file) ? 0 : GetLastError();
+  CloseHandle(file);
+  return std::error_code(static_cast<int>(error), std::system_category());
+#else
+  int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::error_code(errno, std::system_category());
+  }
+#if defined(__linux__)
+  int result = ::fdatasync(fd);
+#else
+  int result = ::fsync(fd);
+#endif
+  int error = result == 0 ? 0 : errno;
+  ::close(fd);
+  return std::error_code(error, std::system_category());
+#endif
+}
+
+/**
+ * 同步目录项，使其中的改名与删除落盘；Windows 上目录无法单独同步，为空操作
+ */
+inline std::error_code sync_directory(const std::filesystem::path& dir) {
+#if defined(_WIN32) || defined(_WIN64)
+  (void)dir;
+  return {};
+#else
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::error_code(errno, std::system_category());
+  }
+  int error = ::fsync(fd) == 0 ? 0 : errno;
+  ::close(fd);
+  return std::error_code(error, std::system_category());
+#endif
+}
+
+/**
+ * 成批持久地替换文件
+ *
+ * 清理时各输出先写入临时文件并在此登记，全部写完后一次提交：
+ *   1. 并行同步所有临时文件的内容（日志型文件系统会把同时到达的同步合并为少数几次日志提交）
+ *   2. 把临时文件改名为目标文件（FileOpBatch 成批执行）
+ *   3. 对目标文件所在的每个目录同步一次，使改名落盘
+ *   4. 删除随替换登记的文件（如合并后其他设备的副本），再同步这些文件所在的目录
+ * 崩溃时目标文件要么是原内容，要么是完整的新内容，不会留下空文件；其他设备的副本只在合并结果
+ * 落盘之后才删除，不会两者都丢失。代价约为两次刷盘，而不是每个文件各一次。
+ * 不使用 syncfs：它会连同整个文件系统上无关的脏数据一起写回。
+ * sync 为 false 时只成批改名，不做同步。各线程可同时登记。
+ */
+class DurableCommit {
+ public:
+  // 同步是 I/O 等待，线程数不受 CPU 数限制
+  static constexpr size_t kSyncThreads = 8;
+
+  /**
+   * 单个替换的结果
+   * renamed 为 true 时目标文件已被替换；此时 error 非空表示目录同步失败，改名可能在崩溃后丢失
+   * renamed 为 false 时目标文件保持原样，error 为同步临时文件或改名的错误
+   */
+  struct Result {
+    std::filesystem::path target;
+    bool renamed = false;
+    std::error_code error;
+  };
+
+  explicit DurableCommit(bool sync = true) : sync_(sync) {}
+
+  DurableCommit(const DurableCommit&) = delete;
+  DurableCommit& operator=(const DurableCommit&) = delete;
+
+  /**
+   * 登记一个写完的临时文件，提交时改名为 target
+   * @param remove_after 改名落盘后删除的文件（不存在时忽略）；改名或同步失败时保留
+   */
+  void replace(std::filesystem::path temp, std::filesystem::path target,
+               std::vector<std::filesystem::path> remove_after = {}) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(Entry{std::move(temp), std::move(target), std::move(remove_after)});
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  /**
+   * 放弃全部登记的替换：删除临时文件，目标文件与随替换登记的文件保持原样
+   * @return 被放弃的目标文件
+   */
+  std::vector<std::filesystem::path> discard() {
+    std::vector<Entry> entries;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      entries.swap(entries_);
+    }
+    FileOpBatch cleanup;
+    std::vector<std::filesystem::path> targets;
+    for (auto& entry : entries) {
+      cleanup.unlink(entry.temp);
+      targets.push_back(std::move(entry.target));
+    }
+    cleanup.run();
+    return targets;
+  }
+
+  /**
+   * 提交全部登记的替换并清空登记，返回与登记顺序对应的结果
+   * 同步或改名失败时目标文件保持原样，临时文件被删除，随替换登记的文件保留；
+   * 改名成功而目录同步失败时目标文件已替换，随替换登记的文件同样保留
+   */
+  std::vector<Result> commit() {
+    std::vector<Entry> entries;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      entries.swap(entries_);
+    }
+    std::vector<Result> results(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      results[i].target = entries[i].target;
+    }
+    if (entries.empty()) {
+      return results;
+    }
+
+    if (sync_) {
+      parallel_for(entries.size(), [&](size_t i) { results[i].error = sync_file(entries[i].temp); }, kSyncThreads);
+    }
+
+    // Windows 上 std::filesystem::rename 同样直接替换已有的目标文件（MOVEFILE_REPLACE_EXISTING）
+    FileOpBatch cleanup;
+    FileOpBatch renames;
+    std::vector<size_t> renamed;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (results[i].error) {
+        cleanup.unlink(entries[i].temp);
+      } else {
+        renames.rename(entries[i].temp, entries[i].target);
+        renamed.push_back(i);
+      }
+    }
+    std::vector<std::error_code> rename_results = renames.run();
+
+    std::set<std::filesystem::path> dirs;
+    for (size_t k = 0; k < renamed.size(); ++k) {
+      Entry& entry = entries[renamed[k]];
+      if (rename_results[k]) {
+        results[renamed[k]].error = rename_results[k];
+        cleanup.unlink(entry.temp);
+      } else {
+        results[renamed[k]].renamed = true;
+        dirs.insert(entry.target.parent_path());
+      }
+    }
+    cleanup.run();
+
+    // 改名已经生效，目录同步失败只能如实报告；此时不删除随替换登记的文件
+    std::vector<std::filesystem::path> dir_list(dirs.begin(), dirs.end());
+    std::vector<std::error_code> dir_results = sync_directories(dir_list);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (!results[i].renamed) continue;
+      size_t d = static_cast<size_t>(std::distance(dir_list.begin(),
+          std::lower_bound(dir_list.begin(), dir_list.end(), entries[i].target.parent_path())));
+      results[i].error = dir_results[d];
+    }
+
+    // 删除不落盘时崩溃后文件会重新出现，下次清理会再次合并，不影响结果，因此只同步不报告
+    FileOpBatch removals;
+    std::set<std::filesystem::path> removal_dirs;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (results[i].error) continue;
+      for (auto& path : entries[i].remove_after) {
+        removal_dirs.insert(path.parent_path());
+        removals.unlink(path);
+      }
+    }
+    removals.run();
+    sync_directories(std::vector<std::filesystem::path>(removal_dirs.begin(), removal_dirs.end()));
+    return results;
+  }
+
+ private:
+  // 并行同步各目录；不同步时全部视为成功
+  std::vector<std::error_code> sync_directories(const std::vector<std::filesystem::path>& dirs) const {
+    std::vector<std::error_code> results(dirs.size());
+    if (sync_) {
+      parallel_for(dirs.size(), [&](size_t i) { results[i] = sync_directory(dirs[i]); }, kSyncThreads);
+    }
+    return results;
+  }
+
+  struct Entry {
+    std::filesystem::path temp;
+    std::filesystem::path target;
+    std::vector<std::filesystem::path> remove_after;
+  };
+
+  const bool sync_;
+  mutable std::mutex mutex_;
+  std::vector<Entry> entries_;
+};
+
+}  // namespace userdb
+
+#endif
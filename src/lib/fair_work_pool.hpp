@@ -0,0 +1,219 @@
+#ifndef FAIR_WORK_POOL_HPP_
+#define FAIR_WORK_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.hpp"
+
+namespace userdb {
+
+/**
+ * 多组任务共用的工作窃取线程池
+ *
+ * 每组（如一个租户）的任务先进入该组的 FIFO，按组轮转取出交给工作线程，
+ * 同时在途的任务不超过 window 个，因此任务很多的组也只能按轮次占用线程，
+ * 不会让其他组饿死。交给工作线程的任务放入各线程自己的双端队列：
+ * 线程从队尾取自己的任务，空闲时从其他线程的队首窃取，以平衡耗时不均的任务。
+ *
+ * 任务可以在执行时继续 post 新任务（如先扫描目录，再为每个文件派发任务）；
+ * 从外部 post 只能在 run() 之前。
+ */
+class FairWorkPool {
+ public:
+  using Task = std::function<void()>;
+
+  /**
+   * @param groups 组数
+   * @param threads 线程数（含调用 run() 的线程），0 表示按硬件并发数
+   * @param window 同时在途的任务数，0 表示线程数的两倍
+   */
+  explicit FairWorkPool(size_t groups, size_t threads = 0, size_t window = 0)
+      : groups_(groups),
+        threads_(parallel_for_threads(static_cast<size_t>(-1), threads)),
+        window_(window ? window : threads_ * 2) {
+    for (size_t i = 0; i < threads_; ++i) {
+      workers_.push_back(std::make_unique<WorkerQueue>());
+    }
+  }
+
+  FairWorkPool(const FairWorkPool&) = delete;
+  FairWorkPool& operator=(const FairWorkPool&) = delete;
+
+  void post(size_t group, Task task) {
+    {
+      std::lock_guard<std::mutex> lock(feed_mutex_);
+      groups_[group].push_back(std::move(task));
+    }
+    feed();
+  }
+
+  /**
+   * 执行全部任务（包括执行过程中派发的任务）后返回；首个异常在所有线程结束后重新抛出
+   */
+  void run() {
+    feed();
+    if (finished()) {
+      return;
+    }
+    std::vector<std::thread> pool;
+    pool.reserve(threads_ - 1);
+    for (size_t i = 1; i < threads_; ++i) {
+      pool.emplace_back([this, i]() { work(i); });
+    }
+    work(0);
+    for (auto& thread : pool) {
+      thread.join();
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+  size_t threads() const { return threads_; }
+  uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // 按组轮转取出任务分给各工作线程，直到在途任务达到 window_ 或各组为空
+  void feed() {
+    std::vector<std::pair<size_t, Task>> picked;
+    {
+      std::lock_guard<std::mutex> lock(feed_mutex_);
+      while (in_flight_ < window_) {
+        bool found = false;
+        for (size_t scanned = 0; scanned < groups_.size(); ++scanned) {
+          auto& group = groups_[cursor_];
+          cursor_ = (cursor_ + 1) % groups_.size();
+          if (!group.empty()) {
+            picked.emplace_back(next_worker_++ % threads_, std::move(group.front()));
+            group.pop_front();
+            found = true;
+            break;
+          }
+        }
+        if (!found) {
+          break;
+        }
+        ++in_flight_;
+      }
+    }
+    if (picked.empty()) {
+      return;
+    }
+    for (auto& [worker, task] : picked) {
+      std::lock_guard<std::mutex> lock(workers_[worker]->mutex);
+      workers_[worker]->tasks.push_back(std::move(task));
+    }
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    queued_ += picked.size();
+    idle_cv_.notify_all();
+  }
+
+  bool pop(size_t self, Task& task) {
+    {
+      WorkerQueue& own = *workers_[self];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < threads_; ++i) {
+      WorkerQueue& victim = *workers_[(self + i) % threads_];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        steals_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool finished() {
+    std::lock_guard<std::mutex> lock(feed_mutex_);
+    if (in_flight_ > 0) {
+      return false;
+    }
+    for (const auto& group : groups_) {
+      if (!group.empty()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void work(size_t self) {
+    while (true) {
+      Task task;
+      if (!pop(self, task)) {
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_cv_.wait(lock, [&]() { return queued_ > 0 || done_; });
+        if (done_) {
+          return;
+        }
+        continue;
+      }
+      {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        --queued_;
+      }
+      try {
+        task();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (!error_) error_ = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(feed_mutex_);
+        --in_flight_;
+      }
+      feed();
+      if (finished()) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        done_ = true;
+        idle_cv_.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::deque<Task>> groups_;
+  const size_t threads_;
+  const size_t window_;
+  std::vector<std::unique_ptr<WorkerQueue>> workers_;
+
+  std::mutex feed_mutex_;
+  size_t cursor_ = 0;
+  size_t next_worker_ = 0;
+  size_t in_flight_ = 0;
+
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+  size_t queued_ = 0;
+  bool done_ = false;
+
+  std::atomic<uint64_t> steals_{0};
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+};
+
+}  // namespace userdb
+
+#endif
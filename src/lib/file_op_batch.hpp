@@ -0,0 +1,331 @@
+#ifndef FILE_OP_BATCH_HPP_
+#define FILE_OP_BATCH_HPP_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/version.h>
+// IORING_OP_UNLINKAT / IORING_OP_RENAMEAT 自 5.11 起提供
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+#define USERDB_HAVE_IO_URING 1
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace userdb {
+
+#if defined(USERDB_HAVE_IO_URING)
+
+/**
+ * 只用于提交 unlinkat / renameat 的最小 io_uring（直接使用系统调用，不依赖 liburing）
+ */
+class IoUring {
+ public:
+  explicit IoUring(unsigned entries) {
+    io_uring_params params{};
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return;  // 内核不支持或被禁用（容器中常见）
+    }
+    fd_ = fd;
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    single_mmap_ = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap_) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ring_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      sq_ring_ = nullptr;
+      close();
+      return;
+    }
+    cq_ring_ = single_mmap_ ? sq_ring_
+                            : ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                                     IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      close();
+      return;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                        IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      close();
+      return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    char* sq = static_cast<char*>(sq_ring_);
+    char* cq = static_cast<char*>(cq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    entries_ = params.sq_entries;
+  }
+  ~IoUring() { close(); }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  bool ok() const { return sqes_ != nullptr; }
+  unsigned entries() const { return entries_; }
+
+  /**
+   * 取一个空闲的提交项并清零；调用方填写后由 submit_and_wait 一并提交
+   */
+  io_uring_sqe* next_sqe() {
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    *sqe = io_uring_sqe{};
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++queued_;
+    return sqe;
+  }
+
+  /**
+   * 提交已排队的项并等待全部完成，每个完成项调用 on_complete(user_data, res)
+   * @return 提交失败时的 errno（此后未完成的项不再回调），成功为 0
+   */
+  template <class OnComplete>
+  int submit_and_wait(OnComplete&& on_complete) {
+    unsigned to_submit = queued_;
+    unsigned pending = queued_;
+    queued_ = 0;
+    while (pending > 0) {
+      int n = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        int error = errno;
+        close();
+        return error;
+      }
+      to_submit -= static_cast<unsigned>(n);
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        on_complete(cqe.user_data, cqe.res);
+        --pending;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+  }
+
+ private:
+  void close() {
+    if (sqes_) {
+      ::munmap(sqes_, sqes_size_);
+      sqes_ = nullptr;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_size_);
+    }
+    if (sq_ring_) {
+      ::munmap(sq_ring_, sq_size_);
+    }
+    sq_ring_ = cq_ring_ = nullptr;
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  int fd_ = -1;
+  bool single_mmap_ = false;
+  size_t sq_size_ = 0;
+  size_t cq_size_ = 0;
+  size_t sqes_size_ = 0;
+  void* sq_ring_ = nullptr;
+  void* cq_ring_ = nullptr;
+  io_uring_sqe* sqes_ = nullptr;
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+  unsigned entries_ = 0;
+  unsigned queued_ = 0;
+};
+
+#endif
+
+/**
+ * 成批执行的删除与重命名
+ *
+ * 操作先排队，run 时一起执行：Linux（5.11+）上通过 io_uring 一次提交一批 unlinkat / renameat，
+ * 由内核工作线程并发完成；其他平台、内核不支持、io_uring 被禁用或操作很少时逐个同步执行。
+ * 只有一个 CPU 时工作线程无法并发，提交与唤醒的开销反而使总耗时增加，默认不使用 io_uring。
+ * 同一批中的操作可能以任意顺序完成，互相依赖的操作（如先删除目录中的文件再删除目录）应分批执行。
+ */
+class FileOpBatch {
+ public:
+  // 少于该数量的操作直接同步执行，建立 io_uring 的开销不划算
+  static constexpr size_t kMinRingOps = 8;
+  static constexpr unsigned kRingEntries = 128;
+
+  explicit FileOpBatch(bool use_io_uring = std::thread::hardware_concurrency() > 1) : use_io_uring_(use_io_uring) {}
+
+  // 删除文件（不存在时结果为 no_such_file_or_directory）
+  void unlink(const std::filesystem::path& path) { ops_.push_back(Op{Kind::kUnlink, path, {}}); }
+  // 删除空目录
+  void remove_directory(const std::filesystem::path& path) { ops_.push_back(Op{Kind::kRemoveDirectory, path, {}}); }
+  // 重命名，目标存在时被替换
+  void rename(const std::filesystem::path& from, const std::filesystem::path& to) {
+    ops_.push_back(Op{Kind::kRename, from, to});
+  }
+
+  size_t size() const { return ops_.size(); }
+  bool empty() const { return ops_.empty(); }
+
+  /**
+   * 执行排队的全部操作并清空队列
+   * @return 与排队顺序对应的结果
+   */
+  std::vector<std::error_code> run() {
+    std::vector<Op> ops;
+    ops.swap(ops_);
+    std::vector<std::error_code> results(ops.size());
+    size_t done = 0;
+#if defined(USERDB_HAVE_IO_URING)
+    if (use_io_uring_ && ops.size() >= kMinRingOps) {
+      done = run_ring(ops, results);
+    }
+#endif
+    for (size_t i = done; i < ops.size(); ++i) {
+      results[i] = run_sync(ops[i]);
+    }
+    return results;
+  }
+
+  /**
+   * 执行并返回成功的操作数
+   */
+  size_t run_count() {
+    size_t succeeded = 0;
+    for (const auto& ec : run()) {
+      succeeded += ec ? 0 : 1;
+    }
+    return succeeded;
+  }
+
+  // 最近一次 run 是否经由 io_uring 执行
+  bool used_io_uring() const { return used_io_uring_; }
+
+ private:
+  enum class Kind {
+    kUnlink,
+    kRemoveDirectory,
+    kRename,
+  };
+
+  struct Op {
+    Kind kind;
+    std::filesystem::path path;
+    std::filesystem::path target;
+  };
+
+  static std::error_code run_sync(const Op& op) {
+    std::error_code ec;
+    switch (op.kind) {
+      case Kind::kUnlink:
+      case Kind::kRemoveDirectory:
+        if (!std::filesystem::remove(op.path, ec) && !ec) {
+          ec = std::make_error_code(std::errc::no_such_file_or_directory);
+        }
+        break;
+      case Kind::kRename:
+        std::filesystem::rename(op.path, op.target, ec);
+        break;
+    }
+    return ec;
+  }
+
+#if defined(USERDB_HAVE_IO_URING)
+  /**
+   * 以 io_uring 执行，返回已得到结果的前缀长度；其余操作由调用方同步执行
+   */
+  size_t run_ring(const std::vector<Op>& ops, std::vector<std::error_code>& results) {
+    used_io_uring_ = false;
+    IoUring ring(kRingEntries);
+    if (!ring.ok()) {
+      return 0;
+    }
+    size_t begin = 0;
+    while (begin < ops.size()) {
+      size_t end = std::min(ops.size(), begin + ring.entries());
+      for (size_t i = begin; i < end; ++i) {
+        const Op& op = ops[i];
+        io_uring_sqe* sqe = ring.next_sqe();
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(op.path.c_str());
+        sqe->user_data = i;
+        if (op.kind == Kind::kRename) {
+          sqe->opcode = IORING_OP_RENAMEAT;
+          sqe->len = static_cast<uint32_t>(AT_FDCWD);
+          sqe->addr2 = reinterpret_cast<uint64_t>(op.target.c_str());
+        } else {
+          sqe->opcode = IORING_OP_UNLINKAT;
+          sqe->unlink_flags = op.kind == Kind::kRemoveDirectory ? AT_REMOVEDIR : 0;
+        }
+      }
+      std::vector<int> codes(end - begin, 0);
+      int error = ring.submit_and_wait([&](uint64_t index, int res) {
+        codes[index - begin] = res;
+      });
+      if (error != 0) {
+        // 提交失败：本批结果不确定，如实报告
+        for (size_t i = begin; i < end; ++i) {
+          results[i] = std::error_code(error, std::system_category());
+        }
+        return end;
+      }
+      for (size_t i = begin; i < end; ++i) {
+        int res = codes[i - begin];
+        if (res == -EINVAL || res == -EOPNOTSUPP) {
+          // 较旧的内核不认识该操作码，改为同步执行
+          results[i] = run_sync(ops[i]);
+        } else {
+          results[i] = res < 0 ? std::error_code(-res, std::system_category()) : std::error_code();
+        }
+      }
+      used_io_uring_ = true;
+      begin = end;
+    }
+    return ops.size();
+  }
+#endif
+
+  bool use_io_uring_;
+  bool used_io_uring_ = false;
+  std::vector<Op> ops_;
+};
+
+}  // namespace userdb
+
+#endif
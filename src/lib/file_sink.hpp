@@ -0,0 +1,284 @@
+#ifndef FILE_SINK_HPP_
+#define FILE_SINK_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <string_view>
+#include <vector>
+
+#include "page_cache.hpp"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace userdb {
+
+/**
+ * 批量写出保留行的输出文件，代替逐行 ostream::write + put
+ *
+ * 保留的行连同其后的换行符通常就在输入（映射的文件）中：登记为来源的内存里的行不做拷贝，
+ * 相邻的保留行合并为一段，以 iovec 直接引用；其他行（合并改写的行、流式读取的行）
+ * 拷贝进 4 KiB 对齐的暂存缓冲区。段数或待写字节数达到上限、暂存缓冲区写满时以一次 writev 写出。
+ * 来源内存须在 close 之前保持有效。Windows 下逐段 fwrite。
+ * 启用 drop_page_cache 时每写满一个窗口就开始回写，上一个窗口回写完成后从页缓存中丢弃，
+ * 写出整个文件所占的页缓存不超过两个窗口。
+ */
+class FileSink {
+ public:
+  static constexpr size_t kAlignment = 4096;
+  static constexpr size_t kStagingSize = 256 * 1024;
+  static constexpr size_t kMaxSegments = 512;            // 不超过 IOV_MAX（Linux 为 1024）
+  static constexpr size_t kFlushBytes = 8 * 1024 * 1024;  // 引用来源的待写字节达到该值时写出
+  static constexpr uint64_t kWritebackWindow = 8 * 1024 * 1024;
+
+  FileSink() : staging_(static_cast<char*>(::operator new(kStagingSize, std::align_val_t(kAlignment)))) {
+    segments_.reserve(kMaxSegments);
+  }
+  ~FileSink() {
+    close();
+    ::operator delete(staging_, std::align_val_t(kAlignment));
+  }
+
+  FileSink(const FileSink&) = delete;
+  FileSink& operator=(const FileSink&) = delete;
+
+  /**
+   * @param preallocate 非零时（Linux）按该大小预分配磁盘空间，close 时截去未写满的部分
+   */
+  bool open(const std::filesystem::path& path, uint64_t preallocate = 0) {
+    close();
+    written_ = 0;
+    writeback_ = 0;
+    dropped_ = 0;
+    preallocated_ = false;
+#if defined(_WIN32) || defined(_WIN64)
+    (void)preallocate;
+    file_ = _wfopen(path.c_str(), L"wb");
+    ok_ = file_ != nullptr;
+#else
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    ok_ = fd_ >= 0;
+#if defined(__linux__)
+    // 不支持的文件系统上直接跳过（posix_fallocate 会退化为逐块写零）
+    if (ok_ && preallocate > 0) {
+      preallocated_ = ::fallocate(fd_, 0, 0, static_cast<off_t>(preallocate)) == 0;
+    }
+#else
+    (void)preallocate;
+#endif
+#endif
+    return ok_;
+  }
+
+  /**
+   * 写完的内容回写后从页缓存中丢弃（Linux），在 open 之前或之后设置均可
+   */
+  void set_drop_page_cache(bool drop) { drop_page_cache_ = drop; }
+
+  /**
+   * 登记一块在 close 之前保持有效的输入内存，其中的行直接引用而不拷贝
+   */
+  void add_source(std::string_view source) { sources_.push_back(source); }
+
+  // 写出一行并追加换行符
+  void operator()(std::string_view line) {
+    if (in_source(line.data(), line.size() + 1) && line.data()[line.size()] == '\n') {
+      reference(line.data(), line.size() + 1);
+      return;
+    }
+    copy(line);
+    copy("\n");
+  }
+
+  // 原样写出
+  void write(std::string_view data) {
+    if (in_source(data.data(), data.size())) {
+      reference(data.data(), data.size());
+    } else {
+      copy(data);
+    }
+  }
+
+  /**
+   * 写出剩余内容并关闭，返回全部写入是否成功
+   */
+  bool close() {
+    if (!is_open()) {
+      return ok_;
+    }
+    flush();
+#if defined(_WIN32) || defined(_WIN64)
+    ok_ = std::fclose(file_) == 0 && ok_;
+    file_ = nullptr;
+#else
+    if (preallocated_ && ok_) {
+      ok_ = ::ftruncate(fd_, static_cast<off_t>(written_)) == 0;
+    }
+    if (drop_page_cache_ && ok_) {
+      drop_cached_range(fd_);
+    }
+    ok_ = ::close(fd_) == 0 && ok_;
+    fd_ = -1;
+#endif
+    sources_.clear();
+    return ok_;
+  }
+
+  bool ok() const { return ok_; }
+  uint64_t written() const { return written_; }
+
+ private:
+  struct Segment {
+    const char* data;
+    size_t size;
+  };
+
+  bool is_open() const {
+#if defined(_WIN32) || defined(_WIN64)
+    return file_ != nullptr;
+#else
+    return fd_ >= 0;
+#endif
+  }
+
+  bool in_source(const char* data, size_t size) const {
+    for (std::string_view source : sources_) {
+      if (data >= source.data() && size <= source.size() &&
+          static_cast<size_t>(data - source.data()) <= source.size() - size) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // 引用来源中的一段，紧接上一段时合并
+  void reference(const char* data, size_t size) {
+    if (!segments_.empty() && segments_.back().data + segments_.back().size == data) {
+      segments_.back().size += size;
+    } else {
+      push(data, size);
+    }
+    pending_ += size;
+    if (pending_ >= kFlushBytes) {
+      flush();
+    }
+  }
+
+  void copy(std::string_view data) {
+    // 先腾出段位：写入暂存区后再写出会让后续拷贝覆盖尚未写出的内容
+    if (data.size() > kStagingSize - staged_ || segments_.size() == kMaxSegments) {
+      flush();
+      if (data.size() > kStagingSize) {
+        // 超过暂存缓冲区的内容不一定长期有效，立即写出
+        push(data.data(), data.size());
+        flush();
+        return;
+      }
+    }
+    char* target = staging_ + staged_;
+    std::memcpy(target, data.data(), data.size());
+    staged_ += data.size();
+    if (!segments_.empty() && segments_.back().data + segments_.back().size == target) {
+      segments_.back().size += data.size();
+    } else {
+      push(target, data.size());
+    }
+  }
+
+  void push(const char* data, size_t size) {
+    if (segments_.size() == kMaxSegments) {
+      flush();
+    }
+    segments_.push_back(Segment{data, size});
+  }
+
+  void flush() {
+    if (ok_ && !segments_.empty()) {
+      ok_ = write_segments();
+    }
+    segments_.clear();
+    staged_ = 0;
+    pending_ = 0;
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (drop_page_cache_ && ok_ && written_ - writeback_ >= kWritebackWindow) {
+      // 上一个窗口此时多半已回写完毕，等待并丢弃；新写出的部分开始回写
+      if (writeback_ > dropped_) {
+        drop_cached_range(fd_, dropped_, writeback_ - dropped_);
+        dropped_ = writeback_;
+      }
+      start_writeback(fd_, writeback_, written_ - writeback_);
+      writeback_ = written_;
+    }
+#endif
+  }
+
+  bool write_segments() {
+#if defined(_WIN32) || defined(_WIN64)
+    for (const Segment& segment : segments_) {
+      if (std::fwrite(segment.data, 1, segment.size, file_) != segment.size) {
+        return false;
+      }
+      written_ += segment.size;
+    }
+    return true;
+#else
+    iovec iov[kMaxSegments];
+    size_t count = segments_.size();
+    for (size_t i = 0; i < count; ++i) {
+      iov[i].iov_base = const_cast<char*>(segments_[i].data);
+      iov[i].iov_len = segments_[i].size;
+    }
+    size_t first = 0;
+    while (first < count) {
+      ssize_t n = ::writev(fd_, iov + first, static_cast<int>(count - first));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      written_ += static_cast<uint64_t>(n);
+      // 部分写入：跳过已写完的段，调整写了一半的段
+      size_t left = static_cast<size_t>(n);
+      while (first < count && left >= iov[first].iov_len) {
+        left -= iov[first].iov_len;
+        ++first;
+      }
+      if (first < count) {
+        iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+        iov[first].iov_len -= left;
+      }
+    }
+    return true;
+#endif
+  }
+
+#if defined(_WIN32) || defined(_WIN64)
+  std::FILE* file_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+  bool ok_ = false;
+  bool preallocated_ = false;
+  bool drop_page_cache_ = false;
+  uint64_t written_ = 0;
+  uint64_t writeback_ = 0;  // 已开始回写的位置
+  uint64_t dropped_ = 0;    // 已从页缓存中丢弃的位置
+  char* staging_;
+  size_t staged_ = 0;
+  size_t pending_ = 0;
+  std::vector<Segment> segments_;
+  std::vector<std::string_view> sources_;
+};
+
+}  // namespace userdb
+
+#endif
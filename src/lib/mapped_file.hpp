@@ -0,0 +1,172 @@
+#ifndef MAPPED_FILE_HPP_
+#define MAPPED_FILE_HPP_
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "page_cache.hpp"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace userdb {
+
+// 只读内存映射文件（RAII），空文件视为打开成功但无数据
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool open(const std::filesystem::path& path) {
+    close();
+#if defined(_WIN32) || defined(_WIN64)
+    file_ = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ,
+                        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_ == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_, &file_size)) {
+      close();
+      return false;
+    }
+    size_ = static_cast<size_t>(file_size.QuadPart);
+    if (size_ == 0) {
+      return true;
+    }
+    mapping_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ == NULL) {
+      close();
+      return false;
+    }
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+      close();
+      return false;
+    }
+#else
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      close();
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) {
+      return true;
+    }
+    void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (addr == MAP_FAILED) {
+      close();
+      return false;
+    }
+    data_ = static_cast<const char*>(addr);
+#endif
+    return true;
+  }
+
+  /**
+   * 声明将顺序读取整个映射：加大预读，读过的页不会被当作常用页保留
+   * @param drop_on_close 为 true 时关闭后把文件从页缓存中丢弃
+   */
+  void advise_sequential(bool drop_on_close = false) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (data_) {
+      ::madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+    }
+    drop_on_close_ = drop_on_close;
+#else
+    (void)drop_on_close;
+#endif
+  }
+
+  void close() {
+#if defined(_WIN32) || defined(_WIN64)
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (data_) ::munmap(const_cast<char*>(data_), size_);
+    // 仍被映射的页不会被丢弃，须在 munmap 之后
+    if (fd_ >= 0 && drop_on_close_) drop_cached_range(fd_);
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    drop_on_close_ = false;
+#endif
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  bool is_open() const {
+#if defined(_WIN32) || defined(_WIN64)
+    return file_ != INVALID_HANDLE_VALUE;
+#else
+    return fd_ >= 0;
+#endif
+  }
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  std::string_view view() const { return std::string_view(data_, size_); }
+
+ private:
+#if defined(_WIN32) || defined(_WIN64)
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = NULL;
+#else
+  int fd_ = -1;
+  bool drop_on_close_ = false;
+#endif
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// 输入缓冲：优先内存映射，映射失败时整体读入内存
+class InputBuffer {
+ public:
+  bool open(const std::filesystem::path& path) {
+    if (mapped_.open(path)) {
+      view_ = mapped_.view();
+      return true;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+      return false;
+    }
+    content_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    view_ = content_;
+    return true;
+  }
+
+  std::string_view view() const { return view_; }
+
+  // 见 MappedFile::advise_sequential；整体读入内存时不做处理
+  void advise_sequential(bool drop_on_close = false) { mapped_.advise_sequential(drop_on_close); }
+
+ private:
+  MappedFile mapped_;
+  std::string content_;
+  std::string_view view_;
+};
+
+}  // namespace userdb
+
+#endif
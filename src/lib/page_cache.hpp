@@ -0,0 +1,121 @@
+#ifndef PAGE_CACHE_HPP_
+#define PAGE_CACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace userdb {
+
+// ---------------------------------------------------------------------------
+// 页缓存提示
+//
+// 一次完整的清理把每个 .userdb.txt 读写一遍，这些页留在页缓存中会挤掉输入法自身
+// 常用的词典页，清理后打字变慢。读取时声明顺序访问（读过的页不会被提升为常用页），
+// 启用 drop_page_cache 时写完的输出与备份先回写再从页缓存中丢弃。
+// 只在 Linux 上生效，其他平台为空操作（Windows 的映射已使用 FILE_FLAG_SEQUENTIAL_SCAN）。
+// ---------------------------------------------------------------------------
+
+/**
+ * 声明将顺序读取整个文件：加大预读，读过的页优先回收
+ */
+inline void advise_sequential(int fd) {
+#if defined(__linux__)
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+  (void)fd;
+#endif
+}
+
+/**
+ * 开始回写 [offset, offset + length) 中的脏页，不等待完成
+ */
+inline void start_writeback(int fd, uint64_t offset, uint64_t length) {
+#if defined(__linux__)
+  ::sync_file_range(fd, static_cast<off64_t>(offset), static_cast<off64_t>(length), SYNC_FILE_RANGE_WRITE);
+#else
+  (void)fd;
+  (void)offset;
+  (void)length;
+#endif
+}
+
+/**
+ * 等待 [offset, offset + length) 回写完成后将其从页缓存中丢弃；length 为 0 表示到文件末尾
+ * 脏页不会被 POSIX_FADV_DONTNEED 丢弃，因此先回写。这里不保证落盘（不刷新元数据与磁盘缓存）
+ */
+inline void drop_cached_range(int fd, uint64_t offset = 0, uint64_t length = 0) {
+#if defined(__linux__)
+  ::sync_file_range(fd, static_cast<off64_t>(offset), static_cast<off64_t>(length),
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+  ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+  (void)fd;
+  (void)offset;
+  (void)length;
+#endif
+}
+
+/**
+ * 将已写完的文件整个从页缓存中丢弃
+ */
+inline bool drop_page_cache(const std::filesystem::path& path) {
+#if defined(__linux__)
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  drop_cached_range(fd);
+  ::close(fd);
+  return true;
+#else
+  (void)path;
+  return false;
+#endif
+}
+
+/**
+ * 文件当前驻留在页缓存中的字节数（按页计，mincore），不支持时返回 0
+ */
+inline uint64_t cached_bytes(const std::filesystem::path& path) {
+#if defined(__linux__)
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  uint64_t cached = 0;
+  if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+    size_t size = static_cast<size_t>(st.st_size);
+    // 只建立映射而不访问，mincore 不会把页读入
+    void* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED) {
+      const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+      std::vector<unsigned char> resident((size + page - 1) / page);
+      if (::mincore(addr, size, resident.data()) == 0) {
+        for (unsigned char r : resident) {
+          cached += (r & 1) ? page : 0;
+        }
+      }
+      ::munmap(addr, size);
+    }
+  }
+  ::close(fd);
+  return cached;
+#else
+  (void)path;
+  return 0;
+#endif
+}
+
+}  // namespace userdb
+
+#endif
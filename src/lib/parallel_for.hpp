@@ -0,0 +1,61 @@
+#ifndef PARALLEL_FOR_HPP_
+#define PARALLEL_FOR_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace userdb {
+
+/**
+ * parallel_for 处理 count 个任务时实际使用的线程数（含调用线程）
+ */
+inline size_t parallel_for_threads(size_t count, size_t max_threads = 0) {
+  size_t threads = max_threads ? max_threads : std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  return threads > count ? count : threads;
+}
+
+/**
+ * 用最多 max_threads 个线程（0 表示按硬件并发数）并行执行 fn(0..count-1)
+ * 任务按下标动态领取；首个异常在所有线程结束后重新抛出
+ */
+template <class Fn>
+void parallel_for(size_t count, Fn&& fn, size_t max_threads = 0) {
+  size_t threads = parallel_for_threads(count, max_threads);
+  if (threads == 0) return;
+
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&]() {
+    for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1);
+  for (size_t i = 1; i < threads; ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}  // namespace userdb
+
+#endif
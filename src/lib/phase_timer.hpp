@@ -0,0 +1,87 @@
+#ifndef PHASE_TIMER_HPP_
+#define PHASE_TIMER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace userdb {
+
+// 一次清理任务的各个阶段
+enum class CleanPhase {
+  kDiscovery,  // 查找 .userdb 文件夹与 .userdb.txt 文件
+  kPurge,      // 清空 .userdb 文件夹
+  kBackup,     // 备份原文件（流式备份只计提交部分）
+  kFilter,     // 过滤、合并词条并写出临时文件
+  kRename,     // 用临时文件替换原文件，刷新快照
+  kJournal,    // 把删除的词条追加到 userdb_cleaner.txt
+  kSummary,    // 汇总日志与结果通知
+  kDeployer,   // 清理前后调用 WeaselDeployer /sync
+  kCount,
+};
+
+inline const char* phase_name(CleanPhase phase) {
+  switch (phase) {
+    case CleanPhase::kDiscovery: return "discovery";
+    case CleanPhase::kPurge: return "purge";
+    case CleanPhase::kBackup: return "backup";
+    case CleanPhase::kFilter: return "filter";
+    case CleanPhase::kRename: return "rename";
+    case CleanPhase::kJournal: return "journal";
+    case CleanPhase::kSummary: return "summary";
+    case CleanPhase::kDeployer: return "deployer";
+    default: return "unknown";
+  }
+}
+
+/**
+ * 各阶段累计耗时；多个线程并行处理文件时各线程的耗时累加
+ */
+class PhaseTimings {
+ public:
+  void add(CleanPhase phase, uint64_t nanos) {
+    nanos_[static_cast<size_t>(phase)].fetch_add(nanos, std::memory_order_relaxed);
+  }
+
+  uint64_t nanos(CleanPhase phase) const {
+    return nanos_[static_cast<size_t>(phase)].load(std::memory_order_relaxed);
+  }
+
+  double millis(CleanPhase phase) const { return static_cast<double>(nanos(phase)) / 1e6; }
+
+ private:
+  std::atomic<uint64_t> nanos_[static_cast<size_t>(CleanPhase::kCount)] = {};
+};
+
+/**
+ * 作用域计时：析构时把耗时计入对应阶段，timings 为空时不计时
+ */
+class ScopedPhase {
+ public:
+  ScopedPhase(PhaseTimings* timings, CleanPhase phase) : timings_(timings), phase_(phase) {
+    if (timings_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ScopedPhase() {
+    if (timings_) {
+      auto elapsed = std::chrono::steady_clock::now() - start_;
+      timings_->add(phase_, static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+  }
+
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+ private:
+  PhaseTimings* timings_;
+  CleanPhase phase_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef STRING_ARENA_HPP_
+#define STRING_ARENA_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace userdb {
+
+/**
+ * 只增不减的字符串存储：文本依次拷贝进成块分配的内存，整体一次释放
+ *
+ * 返回的 string_view 在 clear 或析构之前一直有效（移动后仍有效）。
+ * 块大小从 256 字节起倍增到 64 KiB，超过块大小的字符串单独占一块，
+ * 记录几个词条的列表不会占用整块内存。
+ */
+class StringArena {
+ public:
+  StringArena() = default;
+
+  StringArena(StringArena&&) noexcept = default;
+  StringArena& operator=(StringArena&&) noexcept = default;
+  StringArena(const StringArena&) = delete;
+  StringArena& operator=(const StringArena&) = delete;
+
+  std::string_view store(std::string_view text) {
+    if (text.empty()) {
+      return {};
+    }
+    if (text.size() > left_) {
+      grow(text.size());
+    }
+    char* data = cursor_;
+    std::memcpy(data, text.data(), text.size());
+    cursor_ += text.size();
+    left_ -= text.size();
+    bytes_ += text.size();
+    return std::string_view(data, text.size());
+  }
+
+  /**
+   * 相同的文本只保存一次，返回同一个 string_view；inserted 报告是否首次出现
+   */
+  std::string_view intern(std::string_view text, bool* inserted = nullptr) {
+    auto it = interned_.find(text);
+    bool fresh = it == interned_.end();
+    if (inserted) {
+      *inserted = fresh;
+    }
+    if (!fresh) {
+      return *it;
+    }
+    return *interned_.insert(store(text)).first;
+  }
+
+  void clear() {
+    blocks_.clear();
+    interned_.clear();
+    cursor_ = nullptr;
+    left_ = 0;
+    next_block_ = kMinBlock;
+    bytes_ = 0;
+  }
+
+  // 分配过的块数，即存储文本所用的堆分配次数
+  size_t blocks() const { return blocks_.size(); }
+  // 已保存的文本字节数
+  size_t bytes() const { return bytes_; }
+
+ private:
+  static constexpr size_t kMinBlock = 256;
+  static constexpr size_t kMaxBlock = 64 * 1024;
+
+  void grow(size_t need) {
+    size_t size = std::max(need, next_block_);
+    blocks_.push_back(std::make_unique<char[]>(size));
+    cursor_ = blocks_.back().get();
+    left_ = size;
+    next_block_ = std::min(next_block_ * 2, kMaxBlock);
+  }
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  std::unordered_set<std::string_view> interned_;
+  char* cursor_ = nullptr;
+  size_t left_ = 0;
+  size_t next_block_ = kMinBlock;
+  size_t bytes_ = 0;
+};
+
+/**
+ * 文本保存在自带 StringArena 中的字符串列表，用于删除的词条与清理的词典名
+ *
+ * 与 std::vector<std::string> 相比，每个元素不再单独分配内存（超出 SSO 的词条各一次），
+ * 列表销毁时所有文本随块一起释放。并行清理的每个文件各用一个列表，
+ * 最后按文件顺序 append 到结果中，工作线程之间不共享分配器。
+ */
+class StringList {
+ public:
+  using const_iterator = std::vector<std::string_view>::const_iterator;
+
+  StringList() = default;
+
+  StringList(StringList&&) noexcept = default;
+  StringList& operator=(StringList&&) noexcept = default;
+  StringList(const StringList&) = delete;
+  StringList& operator=(const StringList&) = delete;
+
+  void push_back(std::string_view text) { items_.push_back(arena_.store(text)); }
+
+  /**
+   * 文本尚未加入过时追加，返回是否追加
+   */
+  bool push_unique(std::string_view text) {
+    bool inserted = false;
+    std::string_view stored = arena_.intern(text, &inserted);
+    if (inserted) {
+      items_.push_back(stored);
+    }
+    return inserted;
+  }
+
+  void append(const StringList& other) {
+    items_.reserve(items_.size() + other.size());
+    for (std::string_view text : other) {
+      push_back(text);
+    }
+  }
+
+  /**
+   * 截断到前 size 个元素；被截掉的文本留在块中，直到列表销毁
+   */
+  void truncate(size_t size) {
+    if (size < items_.size()) {
+      items_.resize(size);
+    }
+  }
+
+  void clear() {
+    items_.clear();
+    arena_.clear();
+  }
+
+  std::string_view operator[](size_t i) const { return items_[i]; }
+  size_t size() const { return items_.size(); }
+  bool empty() const { return items_.empty(); }
+  const_iterator begin() const { return items_.begin(); }
+  const_iterator end() const { return items_.end(); }
+
+  const StringArena& arena() const { return arena_; }
+
+ private:
+  StringArena arena_;
+  std::vector<std::string_view> items_;
+};
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef TENANT_LEASE_HPP_
+#define TENANT_LEASE_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "sha256.hpp"
+
+namespace userdb {
+
+/**
+ * 多个进程（可在不同主机上）通过共享目录瓜分批量清理的租户，无需协调服务
+ *
+ * 每个租户对应 <dir>/<hash>.lock 与 <dir>/<hash>.done：
+ *   - 认领：以独占方式创建 .lock（fopen "wx"，即 O_CREAT | O_EXCL），内容为 owner<TAB>到期时间<TAB>租户
+ *   - 续约：先为 .lock 建一个自己独有的硬链接把它钉住，核对仍属于自己后，把写好新到期时间的临时文件
+ *     重命名覆盖 .lock，再删除该链接。抢占方拿走 .lock 后发现链接数大于 1 即放回，因此核对与覆盖之间
+ *     不会被抢占；.lock 始终存在，其他进程也不会趁续约时新建租约
+ *   - 完成：创建 .done 后，同样钉住并核对 .lock 属于自己再删除，其他进程不再认领该租户
+ *   - 抢占：.lock 已过期时把它重命名为自己独有的名字（多个进程同时抢占时只有一个成功），
+ *     再核对重命名得到的内容仍是读到的过期租约且没有被钉住：若已被他人续约、抢占或正在续约，
+ *     则以硬链接放回（目标存在时失败），否则删除后重新独占创建
+ *
+ * 到期时间为系统时钟的秒数，跨主机使用时各主机的时钟误差应远小于租约时长。
+ * 租约过期的租户会被其他进程重新清理。原持有者可能仍在运行（如长时间停顿），两者不能同时改写文件：
+ * 各持有者的临时文件名带有 file_tag()，不会写同一个临时文件；原持有者每次提交前先续约，
+ * 续约失败即放弃该租户其余的文件与尚未提交的结果。
+ */
+class LeaseDirectory {
+ public:
+  enum class Claim {
+    kClaimed,  // 已认领，可以清理
+    kHeld,     // 其他进程持有未过期的租约
+    kDone,     // 已被清理完成
+  };
+
+  LeaseDirectory(std::filesystem::path dir, std::string owner, int lease_seconds)
+      : dir_(std::move(dir)), owner_(std::move(owner)), lease_seconds_(lease_seconds) {}
+
+  bool prepare() {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    return std::filesystem::is_directory(dir_, ec);
+  }
+
+  Claim claim(std::string_view tenant) {
+    std::filesystem::path lock = lock_path(tenant);
+    for (int attempt = 0; attempt < 3; ++attempt) {
+      std::error_code ec;
+      if (std::filesystem::exists(done_path(tenant), ec)) {
+        return Claim::kDone;
+      }
+      if (create_exclusive(lock, tenant)) {
+        // 检查 .done 之后、创建之前持有者可能刚完成并删除了租约
+        if (std::filesystem::exists(done_path(tenant), ec)) {
+          std::filesystem::remove(lock, ec);
+          return Claim::kDone;
+        }
+        return Claim::kClaimed;
+      }
+      std::string seen;
+      if (!read_file(lock, &seen)) {
+        continue;  // 持有者刚好释放，重试创建
+      }
+      if (!expired(lock, seen)) {
+        return Claim::kHeld;
+      }
+      if (!steal(lock, seen)) {
+        return Claim::kHeld;
+      }
+    }
+    return Claim::kHeld;
+  }
+
+  /**
+   * 延长租约；租约已被其他进程抢占时返回 false
+   */
+  bool renew(std::string_view tenant) {
+    std::filesystem::path lock = lock_path(tenant);
+    std::filesystem::path next = lock;
+    next += "." + file_tag() + ".renew";
+    {
+      std::ofstream out(next, std::ios::binary | std::ios::trunc);
+      out << lease_line(tenant);
+      if (!out) {
+        return false;
+      }
+    }
+    std::error_code ec;
+    std::filesystem::path pinned = pin_own(lock);
+    if (pinned.empty()) {
+      std::filesystem::remove(next, ec);
+      return false;
+    }
+    // 钉住期间没有进程能抢占，覆盖的一定是刚核对过的自己的租约
+    std::filesystem::rename(next, lock, ec);
+    bool renewed = !ec;
+    std::filesystem::remove(next, ec);
+    std::filesystem::remove(pinned, ec);
+    return renewed;
+  }
+
+  /**
+   * 释放租约；done 为 true 时先标记该租户已完成
+   */
+  void release(std::string_view tenant, bool done) {
+    std::error_code ec;
+    if (done) {
+      std::ofstream(done_path(tenant), std::ios::binary | std::ios::trunc) << owner_ << "\t" << tenant << "\n";
+    }
+    std::filesystem::path lock = lock_path(tenant);
+    std::filesystem::path pinned = pin_own(lock);
+    if (!pinned.empty()) {
+      std::filesystem::remove(lock, ec);
+      std::filesystem::remove(pinned, ec);
+    }
+  }
+
+  int lease_seconds() const { return lease_seconds_; }
+
+  /**
+   * 由 owner 得到的可用作文件名的标识（只含字母、数字、- 与 _）
+   */
+  std::string file_tag() const {
+    std::string name;
+    for (char c : owner_) {
+      bool ok = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '_';
+      name += ok ? c : '_';
+    }
+    return name;
+  }
+
+ private:
+  std::filesystem::path lock_path(std::string_view tenant) const { return dir_ / (key(tenant) + ".lock"); }
+  std::filesystem::path done_path(std::string_view tenant) const { return dir_ / (key(tenant) + ".done"); }
+
+  static std::string key(std::string_view tenant) { return Sha256::hex(tenant).substr(0, 32); }
+
+  static int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  std::string lease_line(std::string_view tenant) const {
+    return owner_ + "\t" + std::to_string(now_seconds() + lease_seconds_) + "\t" + std::string(tenant) + "\n";
+  }
+
+  static std::string owner_of(const std::string& content) { return content.substr(0, content.find('\t')); }
+
+  bool expired(const std::filesystem::path& lock, const std::string& content) const {
+    size_t tab = content.find('\t');
+    if (tab != std::string::npos && !content.empty() && content.back() == '\n') {
+      return std::strtoll(content.c_str() + tab + 1, nullptr, 10) <= now_seconds();
+    }
+    // 持有者可能正在写入，按文件的修改时间判断
+    std::error_code ec;
+    auto written = std::filesystem::last_write_time(lock, ec);
+    if (ec) {
+      return false;
+    }
+    return std::filesystem::file_time_type::clock::now() - written > std::chrono::seconds(lease_seconds_);
+  }
+
+  static bool read_file(const std::filesystem::path& path, std::string* content) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      return false;
+    }
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    *content = buffer.str();
+    return true;
+  }
+
+  bool create_exclusive(const std::filesystem::path& lock, std::string_view tenant) {
+#if defined(_WIN32) || defined(_WIN64)
+    std::FILE* file = _wfopen(lock.c_str(), L"wbx");
+#else
+    std::FILE* file = std::fopen(lock.c_str(), "wbx");
+#endif
+    if (!file) {
+      return false;
+    }
+    std::string line = lease_line(tenant);
+    bool ok = std::fwrite(line.data(), 1, line.size(), file) == line.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+      std::error_code ec;
+      std::filesystem::remove(lock, ec);
+    }
+    return ok;
+  }
+
+  /**
+   * 为 .lock 建一个本进程独有的硬链接并核对持有者是自己，返回该链接；不是自己的租约时返回空
+   * 链接存在期间 .lock 的链接数大于 1，steal 不会抢占它，核对之后可以放心覆盖或删除 .lock
+   */
+  std::filesystem::path pin_own(const std::filesystem::path& lock) {
+    std::filesystem::path pinned = lock;
+    pinned += "." + file_tag() + ".pin";
+    std::error_code ec;
+    std::filesystem::remove(pinned, ec);  // 上次崩溃时留下的
+    std::filesystem::create_hard_link(lock, pinned, ec);
+    if (ec) {
+      return {};  // 租约已被释放或正被抢占
+    }
+    std::string content;
+    if (read_file(pinned, &content) && owner_of(content) == owner_) {
+      return pinned;
+    }
+    std::filesystem::remove(pinned, ec);
+    return {};
+  }
+
+  bool steal(const std::filesystem::path& lock, const std::string& seen) {
+    std::filesystem::path moved = lock;
+    moved += "." + file_tag() + ".stale";
+    std::error_code ec;
+    std::filesystem::rename(lock, moved, ec);
+    if (ec) {
+      return false;  // 其他进程已先一步抢占或释放
+    }
+    // 持有者正在续约或释放时 .lock 另有一个链接（pin_own），不抢占
+    std::string taken;
+    bool same = read_file(moved, &taken) && taken == seen && std::filesystem::hard_link_count(moved, ec) == 1;
+    if (!same) {
+      // 拿走的是别人刚写入或正在续约的租约，放回原处；原处已有新租约时放弃
+      std::filesystem::create_hard_link(moved, lock, ec);
+      std::filesystem::remove(moved, ec);
+      return false;
+    }
+    std::filesystem::remove(moved, ec);
+    return true;
+  }
+
+  const std::filesystem::path dir_;
+  const std::string owner_;
+  const int lease_seconds_;
+};
+
+}  // namespace userdb
+
+#endif
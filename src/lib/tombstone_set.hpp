@@ -0,0 +1,162 @@
+#ifndef TOMBSTONE_SET_HPP_
+#define TOMBSTONE_SET_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "userdb_dedup.hpp"
+#include "userdb_filter.hpp"
+
+namespace userdb {
+
+/**
+ * 已删除词条（c <= 0）键的紧凑集合，连同删除时的 t
+ * 只保存词条键的 64 位哈希与 t（每个键 16 字节），开放寻址、线性探测。
+ * 不同键哈希碰撞的概率可以忽略（百万级词条约 1e-8）。
+ * 同一键在多处被删除时保留最大的 t。
+ */
+class TombstoneSet {
+ public:
+  TombstoneSet() : slots_(1024, 0), times_(1024, 0.0) {}
+
+  void insert(std::string_view key, double t) { insert_hash(normalize(hash_key(key)), t); }
+
+  /**
+   * 查找键被删除时的 t，未被删除时返回 false
+   */
+  bool find(std::string_view key, double* t) const {
+    uint64_t hash = normalize(hash_key(key));
+    size_t mask = slots_.size() - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+      if (slots_[i] == hash) {
+        *t = times_[i];
+        return true;
+      }
+      if (slots_[i] == 0) return false;
+    }
+  }
+
+  /**
+   * t 为 record_t 的记录是否被删除：删除不早于该记录时成立，之后重新输入的词条保留
+   */
+  bool deletes(std::string_view key, double record_t) const {
+    double t;
+    return find(key, &t) && t >= record_t;
+  }
+
+  void merge(const TombstoneSet& other) {
+    for (size_t i = 0; i < other.slots_.size(); ++i) {
+      if (other.slots_[i] != 0) insert_hash(other.slots_[i], other.times_[i]);
+    }
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  /**
+   * 收集一个文件内容中所有 c <= 0 的词条键
+   */
+  void collect(std::string_view content) {
+    MappedLineReader read(content.data(), content.size());
+    std::string_view line;
+    while (read(line)) {
+      std::string_view key = record_key(line);
+      if (!key.empty() && parse_c_value(line) <= 0.0) {
+        insert(key, parse_t_value(line));
+      }
+    }
+  }
+
+ private:
+  // 0 表示空槽
+  static uint64_t normalize(uint64_t hash) { return hash == 0 ? 1 : hash; }
+
+  void insert_hash(uint64_t hash, double t) {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+      if (slots_[i] == hash) {
+        if (t > times_[i]) times_[i] = t;
+        return;
+      }
+      if (slots_[i] == 0) {
+        slots_[i] = hash;
+        times_[i] = t;
+        ++size_;
+        break;
+      }
+    }
+    if (size_ * 10 > slots_.size() * 7) {
+      grow();
+    }
+  }
+
+  void grow() {
+    std::vector<uint64_t> slots(slots_.size() * 2, 0);
+    std::vector<double> times(slots.size(), 0.0);
+    size_t mask = slots.size() - 1;
+    for (size_t j = 0; j < slots_.size(); ++j) {
+      if (slots_[j] == 0) continue;
+      size_t i = static_cast<size_t>(slots_[j]) & mask;
+      while (slots[i] != 0) {
+        i = (i + 1) & mask;
+      }
+      slots[i] = slots_[j];
+      times[i] = times_[j];
+    }
+    slots_.swap(slots);
+    times_.swap(times);
+  }
+
+  std::vector<uint64_t> slots_;
+  std::vector<double> times_;
+  size_t size_ = 0;
+};
+
+/**
+ * 按词典区分的已删除词条：键为文件名（<dict>.userdb.txt），同一词典的各设备副本共用一个集合，
+ * 一个词典中的删除不会影响其他词典
+ */
+class DictionaryTombstones {
+ public:
+  TombstoneSet& operator[](const std::filesystem::path& file) { return sets_[file.filename().string()]; }
+
+  // file 所属词典的集合，没有任何删除时返回空
+  const TombstoneSet* find(const std::filesystem::path& file) const {
+    auto it = sets_.find(file.filename().string());
+    return it == sets_.end() || it->second.empty() ? nullptr : &it->second;
+  }
+
+  size_t size() const {
+    size_t total = 0;
+    for (const auto& entry : sets_) total += entry.second.size();
+    return total;
+  }
+
+ private:
+  std::map<std::string, TombstoneSet> sets_;
+};
+
+// c > 0 且未在同一词典的其他副本上以不早于本条的 t 被删除的行保留
+class TombstonePredicate {
+ public:
+  explicit TombstonePredicate(const TombstoneSet& tombstones) : tombstones_(tombstones) {}
+
+  bool operator()(std::string_view line) const {
+    if (parse_c_value(line) <= 0.0) {
+      return false;
+    }
+    std::string_view key = record_key(line);
+    return key.empty() || !tombstones_.deletes(key, parse_t_value(line));
+  }
+
+ private:
+  const TombstoneSet& tombstones_;
+};
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace userdb {
+
+// 一个已结束的区间，对应 Chrome trace-event 的 "X" 事件
+struct TraceEvent {
+  const char* name;
+  std::string detail;  // 附加信息（如文件名），写入 args.detail
+  uint64_t start_ns;   // 相对 start() 的时间
+  uint64_t duration_ns;
+  uint32_t thread;
+};
+
+/**
+ * 进程内唯一的 trace 记录器
+ * 未启用时各区间只做一次 enabled() 判断；启用后区间结束时加锁追加事件
+ */
+class TraceRecorder {
+ public:
+  static TraceRecorder& instance() {
+    static TraceRecorder recorder;
+    return recorder;
+  }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  /**
+   * 清空已有事件并开始记录
+   */
+  void start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+    epoch_ = std::chrono::steady_clock::now();
+    enabled_.store(true, std::memory_order_release);
+  }
+
+  void stop() { enabled_.store(false, std::memory_order_release); }
+
+  std::chrono::steady_clock::time_point epoch() const { return epoch_; }
+
+  void add(TraceEvent event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+  }
+
+  /**
+   * 当前线程的编号，首次调用时分配；0 为最先记录事件的线程
+   */
+  uint32_t thread_id() {
+    thread_local uint32_t id = next_thread_.fetch_add(1, std::memory_order_relaxed);
+    return id;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_.size();
+  }
+
+  /**
+   * 以 Chrome trace-event JSON 格式写出，可直接在 Perfetto / chrome://tracing 中打开
+   */
+  bool write_json(const std::filesystem::path& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"userdb_cleaner\"}}";
+    std::vector<bool> named;
+    char buffer[96];
+    for (const auto& event : events_) {
+      if (event.thread >= named.size()) {
+        named.resize(event.thread + 1, false);
+      }
+      if (!named[event.thread]) {
+        named[event.thread] = true;
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"args\":{\"name\":\"thread-" << event.thread << "\"}}";
+      }
+      std::snprintf(buffer, sizeof(buffer), "\"ts\":%.3f,\"dur\":%.3f",
+                    static_cast<double>(event.start_ns) / 1e3, static_cast<double>(event.duration_ns) / 1e3);
+      out << ",\n{\"name\":\"";
+      write_escaped(out, event.name);
+      out << "\",\"cat\":\"userdb\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread << "," << buffer;
+      if (!event.detail.empty()) {
+        out << ",\"args\":{\"detail\":\"";
+        write_escaped(out, event.detail);
+        out << "\"}";
+      }
+      out << "}";
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+  }
+
+ private:
+  TraceRecorder() = default;
+
+  static void write_escaped(std::ostream& out, std::string_view text) {
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        out << '\\' << c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+        out << escaped;
+      } else {
+        out << c;
+      }
+    }
+  }
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<uint32_t> next_thread_{0};
+  std::chrono::steady_clock::time_point epoch_;
+  mutable std::mutex mutex_;
+  std::vector<TraceEvent> events_;
+};
+
+/**
+ * 作用域区间：构造时判断一次是否在记录，未记录时析构只检查空指针
+ * detail 以可调用对象传入，仅在记录时求值，避免未启用时构造字符串
+ */
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name) {
+    TraceRecorder& recorder = TraceRecorder::instance();
+    if (recorder.enabled()) {
+      begin(recorder, name);
+    }
+  }
+
+  template <class DetailFn>
+  TraceSpan(const char* name, DetailFn&& detail) {
+    TraceRecorder& recorder = TraceRecorder::instance();
+    if (recorder.enabled()) {
+      begin(recorder, name);
+      detail_ = std::forward<DetailFn>(detail)();
+    }
+  }
+
+  ~TraceSpan() {
+    if (recorder_) {
+      auto now = std::chrono::steady_clock::now();
+      auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(start_ - recorder_->epoch()).count();
+      auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_).count();
+      recorder_->add({name_, std::move(detail_), static_cast<uint64_t>(since_epoch < 0 ? 0 : since_epoch),
+                      static_cast<uint64_t>(duration), recorder_->thread_id()});
+    }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  void begin(TraceRecorder& recorder, const char* name) {
+    recorder_ = &recorder;
+    name_ = name;
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  TraceRecorder* recorder_ = nullptr;
+  const char* name_ = nullptr;
+  std::string detail_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace userdb
+
+#define USERDB_TRACE_CONCAT_INNER(a, b) a##b
+#define USERDB_TRACE_CONCAT(a, b) USERDB_TRACE_CONCAT_INNER(a, b)
+
+// 以当前函数名为区间名
+#define USERDB_TRACE_SCOPE() \
+  ::userdb::TraceSpan USERDB_TRACE_CONCAT(userdb_trace_span_, __LINE__)(__func__)
+// 指定区间名
+#define USERDB_TRACE_SCOPE_NAMED(name) \
+  ::userdb::TraceSpan USERDB_TRACE_CONCAT(userdb_trace_span_, __LINE__)(name)
+// 指定区间名与附加信息，detail 表达式仅在记录时求值
+#define USERDB_TRACE_SCOPE_DETAIL(name, detail) \
+  ::userdb::TraceSpan USERDB_TRACE_CONCAT(userdb_trace_span_, __LINE__)(name, [&]() -> std::string { return detail; })
+
+#endif
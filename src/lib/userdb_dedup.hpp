@@ -0,0 +1,220 @@
+#ifndef USERDB_DEDUP_HPP_
+#define USERDB_DEDUP_HPP_
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clean_options.hpp"
+#include "userdb_filter.hpp"
+
+namespace userdb {
+
+/**
+ * 64 位 FNV-1a 哈希
+ */
+inline uint64_t hash_key(std::string_view key) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char ch : key) {
+    hash ^= ch;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * 替换行中的 c 值，其余内容保持不变
+ */
+inline std::string replace_c_value(std::string_view line, double c_value) {
+  char buffer[32];
+  auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), c_value);
+  std::string_view formatted(buffer, ec == std::errc() ? static_cast<size_t>(ptr - buffer) : 0);
+
+  size_t pos = line.rfind("c=");
+  if (pos == std::string_view::npos) {
+    return std::string(line);
+  }
+  pos += 2;
+  size_t end = pos;
+  while (end < line.size() &&
+         !std::isspace(static_cast<unsigned char>(line[end]))) {
+    end++;
+  }
+  std::string result;
+  result.reserve(line.size() + formatted.size());
+  result.append(line.substr(0, pos));
+  result.append(formatted);
+  result.append(line.substr(end));
+  return result;
+}
+
+/**
+ * 按合并规则累积同一词条的多条记录
+ */
+struct MergedRecord {
+  std::string_view line;  // 当前选中的行
+  double c = 0.0;
+  double t = 0.0;
+  double sum_c = 0.0;
+  uint32_t count = 0;  // 出现次数
+
+  void add(std::string_view candidate, double c_value, double t_value, MergeRule rule) {
+    if (count++ == 0) {
+      line = candidate;
+      c = c_value;
+      t = t_value;
+      sum_c = c_value;
+      return;
+    }
+    switch (rule) {
+      case MergeRule::kMaxC:
+        if (c_value > c) {
+          line = candidate;
+          c = c_value;
+          t = t_value;
+        }
+        break;
+      case MergeRule::kMaxT:
+        if (t_value > t) {
+          line = candidate;
+          c = c_value;
+          t = t_value;
+        }
+        break;
+      case MergeRule::kSumC:
+        // 以 t 最大的行为准，c 值在写出时替换为总和
+        sum_c += c_value;
+        if (t_value > t) {
+          line = candidate;
+          c = c_value;
+          t = t_value;
+        }
+        break;
+      case MergeRule::kNone:
+        break;
+    }
+  }
+
+  void add(std::string_view candidate, MergeRule rule) {
+    add(candidate, parse_c_value(candidate), parse_t_value(candidate), rule);
+  }
+
+  /**
+   * 合并后的输出行；sum_c 规则下需要重写 c 值，结果存放在 buffer 中
+   */
+  std::string_view output(MergeRule rule, std::string& buffer) const {
+    if (rule == MergeRule::kSumC && count > 1) {
+      buffer = replace_c_value(line, sum_c);
+      return buffer;
+    }
+    return line;
+  }
+};
+
+/**
+ * 去重输出端：收集保留的行，按合并规则合并重复词条，
+ * 最后按首次出现的顺序写出
+ *
+ * 词条键与行内容均为指向输入缓冲区的 string_view，
+ * 因此输入（如映射的文件）必须在 flush 之前保持有效。
+ * 哈希表采用开放寻址（线性探测），容量为 2 的幂。
+ */
+class DedupSink {
+ public:
+  explicit DedupSink(MergeRule rule) : rule_(rule), slots_(1024) {}
+
+  void operator()(std::string_view line) {
+    std::string_view key = record_key(line);
+    if (key.empty()) {
+      // 非词条行（如元数据）原样保留
+      order_.push_back(kPassthrough | passthrough_.size());
+      passthrough_.push_back(line);
+      return;
+    }
+
+    uint64_t hash = hash_key(key);
+    size_t mask = slots_.size() - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+      Slot& slot = slots_[i];
+      if (slot.entry == 0) {
+        slot.hash = hash;
+        slot.entry = static_cast<uint32_t>(entries_.size() + 1);
+        order_.push_back(entries_.size());
+        entries_.push_back(Entry{key, MergedRecord()});
+        entries_.back().record.add(line, rule_);
+        if (entries_.size() * 10 > slots_.size() * 7) {
+          grow();
+        }
+        return;
+      }
+      if (slot.hash == hash && entries_[slot.entry - 1].key == key) {
+        entries_[slot.entry - 1].record.add(line, rule_);
+        ++merged_count_;
+        return;
+      }
+    }
+  }
+
+  // 被合并掉的重复行数
+  uint64_t merged_count() const { return merged_count_; }
+
+  /**
+   * 按首次出现的顺序写出全部行，返回写出的字节数（含换行符）
+   */
+  template <class Sink>
+  uint64_t flush(Sink& write) {
+    uint64_t bytes = 0;
+    std::string rewritten;
+    for (uint64_t item : order_) {
+      std::string_view line;
+      if (item & kPassthrough) {
+        line = passthrough_[static_cast<size_t>(item & ~kPassthrough)];
+      } else {
+        line = entries_[static_cast<size_t>(item)].record.output(rule_, rewritten);
+      }
+      write(line);
+      bytes += line.size() + 1;
+    }
+    return bytes;
+  }
+
+ private:
+  struct Slot {
+    uint64_t hash = 0;
+    uint32_t entry = 0;  // entries_ 下标 + 1，0 表示空槽
+  };
+
+  struct Entry {
+    std::string_view key;
+    MergedRecord record;
+  };
+
+  static constexpr uint64_t kPassthrough = 1ull << 63;
+
+  void grow() {
+    std::vector<Slot> slots(slots_.size() * 2);
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : slots_) {
+      if (slot.entry == 0) continue;
+      size_t i = static_cast<size_t>(slot.hash) & mask;
+      while (slots[i].entry != 0) {
+        i = (i + 1) & mask;
+      }
+      slots[i] = slot;
+    }
+    slots_.swap(slots);
+  }
+
+  MergeRule rule_;
+  std::vector<Slot> slots_;
+  std::vector<Entry> entries_;
+  std::vector<std::string_view> passthrough_;
+  std::vector<uint64_t> order_;  // 输出顺序：词条下标，或带 kPassthrough 标记的非词条行下标
+  uint64_t merged_count_ = 0;
+};
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef USERDB_FILE_FILTER_HPP_
+#define USERDB_FILE_FILTER_HPP_
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "backup_store.hpp"
+#include "clean_options.hpp"
+#include "file_sink.hpp"
+#include "mapped_file.hpp"
+#include "tombstone_set.hpp"
+#include "userdb_dedup.hpp"
+#include "userdb_filter.hpp"
+#include "userdb_header.hpp"
+
+namespace userdb {
+
+// 单个文件的清理结果
+struct FileFilterStats : FilterStats {
+  uint64_t lines_merged = 0;     // 被合并掉的重复行数
+  uint64_t lines_oversized = 0;  // 固定内存模式下超过缓冲区而原样保留的行数
+};
+
+/**
+ * 在读取映射内容的同时把原始字节分块送入备份，
+ * 使备份压缩与过滤在同一遍扫描中完成
+ */
+class BackupTeeReader {
+ public:
+  static constexpr size_t kChunkSize = 256 * 1024;
+
+  BackupTeeReader(std::string_view content, size_t body_offset, BackupWriter& backup)
+      : content_(content),
+        read_(content.data() + body_offset, content.size() - body_offset),
+        backup_(backup) {}
+
+  bool operator()(std::string_view& line) {
+    if (!read_(line)) {
+      return false;
+    }
+    pos_ = static_cast<size_t>(line.data() - content_.data()) + line.size() + 1;
+    if (pos_ - fed_ >= kChunkSize) {
+      feed();
+    }
+    return true;
+  }
+
+  /**
+   * 送入剩余内容，返回备份写入是否全部成功
+   */
+  bool finish() {
+    pos_ = content_.size();
+    feed();
+    return ok_;
+  }
+
+ private:
+  void feed() {
+    if (pos_ > content_.size()) pos_ = content_.size();
+    if (ok_ && pos_ > fed_) {
+      ok_ = backup_.write(content_.substr(fed_, pos_ - fed_));
+    }
+    fed_ = pos_;
+  }
+
+  std::string_view content_;
+  MappedLineReader read_;
+  BackupWriter& backup_;
+  size_t pos_ = 0;
+  size_t fed_ = 0;
+  bool ok_ = true;
+};
+
+/**
+ * 在选定的读取器、判断与词条捕获策略上运行过滤，并按合并规则决定是否经过去重
+ */
+template <class Reader, class Predicate, class Capture, class Sink>
+FileFilterStats filter_to_sink(Reader& reader, const Predicate& keep, Capture& capture,
+                               MergeRule rule, Sink& sink) {
+  FileFilterStats stats;
+  if (rule == MergeRule::kNone) {
+    static_cast<FilterStats&>(stats) = filter_lines(reader, keep, sink, capture);
+    return stats;
+  }
+  DedupSink dedup(rule);
+  static_cast<FilterStats&>(stats) = filter_lines(reader, keep, dedup, capture);
+  stats.lines_merged = dedup.merged_count();
+  stats.lines_kept -= stats.lines_merged;
+  stats.bytes_written = dedup.flush(sink);
+  return stats;
+}
+
+/**
+ * 过滤单个 .userdb.txt 文件，结果写入 output
+ * 按配置在文件级别选择特化实例，逐行循环内没有运行时分支；无法映射时的流式回退走类型擦除的通用路径
+ * @param deleted_words 配置要求记录词条时，被删除的词条追加到这里
+ * @param tombstones 非空时，其中的词条即使 c > 0 也会被删除
+ * @param backup 非空时，原文件内容在过滤的同时写入该备份（调用方负责 commit）
+ */
+inline bool filter_userdb_file(const std::filesystem::path& input,
+                               const std::filesystem::path& output,
+                               const CleanOptions& options,
+                               StringList& deleted_words,
+                               FileFilterStats* stats = nullptr,
+                               const TombstoneSet* tombstones = nullptr,
+                               BackupWriter* backup = nullptr) {
+  // 输出不会超过输入，按输入大小预分配，写完后截去多余部分
+  std::error_code size_ec;
+  uint64_t input_size = std::filesystem::file_size(input, size_ec);
+  FileSink out;
+  out.set_drop_page_cache(options.drop_page_cache);
+  if (!out.open(output, size_ec ? 0 : input_size)) {
+    return false;
+  }
+
+  auto run_with = [&](auto& reader, const auto& keep) {
+    if (options.record_deleted_words) {
+      WordCapture capture(deleted_words);
+      return filter_to_sink(reader, keep, capture, options.merge_rule, out);
+    }
+    NoWordCapture capture;
+    return filter_to_sink(reader, keep, capture, options.merge_rule, out);
+  };
+
+  // 剪除规则依赖文件头中的 tick，返回是否剪除及保留的最小 t
+  auto prune_rule = [&](const UserdbHeader& header, double* min_tick) {
+    bool prune = options.prune_idle_ticks > 0 && header.has_tick &&
+                 header.tick > options.prune_idle_ticks;
+    *min_tick = prune ? static_cast<double>(header.tick - options.prune_idle_ticks) : 0.0;
+    return prune;
+  };
+
+  // 文件头按原样一次写出，逐行循环只处理文件头之后的词条
+  auto run = [&](auto& reader, const UserdbHeader& header) {
+    uint64_t header_bytes = write_header(out, header.block);
+
+    double min_tick;
+    bool prune = prune_rule(header, &min_tick);
+    auto run_pruned = [&](const auto& keep) {
+      if (prune) {
+        using Base = std::decay_t<decltype(keep)>;
+        return run_with(reader, IdlePrunePredicate<Base>(keep, min_tick));
+      }
+      return run_with(reader, keep);
+    };
+
+    FileFilterStats result = tombstones ? run_pruned(TombstonePredicate(*tombstones))
+                                        : run_pruned(CValuePredicate());
+    result.bytes_read += header.block.size();
+    result.bytes_written += header_bytes;
+    return result;
+  };
+  bool backup_ok = true;
+  auto run_mapped = [&](std::string_view content) {
+    out.add_source(content);
+    UserdbHeader header = parse_header(content);
+    if (backup) {
+      BackupTeeReader reader(content, header.block.size(), *backup);
+      FileFilterStats result = run(reader, header);
+      backup_ok = reader.finish();
+      return result;
+    }
+    std::string_view body = content.substr(header.block.size());
+    MappedLineReader reader(body.data(), body.size());
+    return run(reader, header);
+  };
+
+  FileFilterStats result;
+  MappedFile mapped;
+  InputBuffer buffer;
+  if (mapped.open(input)) {
+    mapped.advise_sequential(options.drop_page_cache);
+    result = run_mapped(mapped.view());
+  } else {
+    std::ifstream in(input, std::ios::binary);
+    if (!in.is_open()) {
+      return false;
+    }
+    if (options.merge_rule == MergeRule::kNone && !backup) {
+      std::string header_storage;
+      UserdbHeader header = read_header(in, header_storage);
+      uint64_t header_bytes = write_header(out, header.block);
+      AnyLinePredicate keep = CValuePredicate();
+      if (tombstones) {
+        keep = TombstonePredicate(*tombstones);
+      }
+      double min_tick;
+      if (prune_rule(header, &min_tick)) {
+        keep = IdlePrunePredicate<AnyLinePredicate>(keep, min_tick);
+      }
+      AnyLineCapture capture = NoWordCapture();
+      if (options.record_deleted_words) {
+        capture = WordCapture(deleted_words);
+      }
+      StreamLineReader stream(in);
+      AnyLineReader reader = std::ref(stream);
+      result = filter_to_sink(reader, keep, capture, MergeRule::kNone, out);
+      result.bytes_read += header.block.size();
+      result.bytes_written += header_bytes;
+    } else {
+      // 去重与流式备份需要完整的原始内容，无法映射时整体读入内存
+      in.close();
+      if (!buffer.open(input)) {
+        return false;
+      }
+      buffer.advise_sequential(options.drop_page_cache);
+      result = run_mapped(buffer.view());
+    }
+  }
+
+  // 映射与读入的缓冲区在 close 之前保持有效
+  if (!out.close() || !backup_ok) {
+    return false;
+  }
+  if (stats) {
+    *stats = result;
+  }
+  return true;
+}
+
+}  // namespace userdb
+
+#endif
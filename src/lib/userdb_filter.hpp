@@ -0,0 +1,252 @@
+#ifndef USERDB_FILTER_HPP_
+#define USERDB_FILTER_HPP_
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "string_arena.hpp"
+
+namespace userdb {
+
+/**
+ * 从行中提取 c 值并解析
+ */
+inline double parse_c_value(std::string_view line) {
+  // 从后往前查找"c="
+  size_t pos = line.rfind("c=");
+  if (pos == std::string_view::npos)
+    return 1.0;  // 未找到 c 字段, 保留该行
+
+  // 移动到c值起始位置 (跳过"c=")
+  pos += 2;
+
+  // 查找c值结束位置 (空格/制表符/行尾)
+  size_t end = pos;
+  while (end < line.size() &&
+         !std::isspace(static_cast<unsigned char>(line[end]))) {
+    end++;
+  }
+
+  double value = -1.0;
+  auto [ptr, ec] = std::from_chars(line.data() + pos, line.data() + end, value);
+
+  // 检查解析是否成功
+  if (ec != std::errc() || ptr != line.data() + end) {
+    try {
+      return std::stod(std::string(line.substr(pos, end - pos)));
+    } catch (...) {
+      return 1.0;  // 解析失败, 保留该行
+    }
+  }
+  return value;
+}
+
+/**
+ * 从词条行中提取词条文本
+ * 格式示例: biàn biàn 	便便	c=1 d=0.00687406 t=31469
+ * 返回: 便便
+ */
+inline std::string_view extract_word_text(std::string_view line) {
+  // 查找第一个制表符
+  size_t first_tab = line.find('\t');
+  if (first_tab == std::string_view::npos) {
+    return line;  // 没有制表符，返回整行
+  }
+
+  // 查找第二个制表符
+  size_t second_tab = line.find('\t', first_tab + 1);
+  if (second_tab == std::string_view::npos) {
+    // 没有第二个制表符，返回第一个制表符后的内容
+    return line.substr(first_tab + 1);
+  }
+
+  // 返回两个制表符之间的内容（词条文本）
+  return line.substr(first_tab + 1, second_tab - first_tab - 1);
+}
+
+/**
+ * 从词条行中提取数值字段（如 "d="、"t="），未找到或解析失败返回 fallback
+ */
+inline double parse_number_field(std::string_view line, std::string_view name, double fallback) {
+  size_t pos = line.rfind(name);
+  if (pos == std::string_view::npos) {
+    return fallback;
+  }
+  pos += name.size();
+  size_t end = pos;
+  while (end < line.size() &&
+         !std::isspace(static_cast<unsigned char>(line[end]))) {
+    end++;
+  }
+  double value = fallback;
+  auto [ptr, ec] = std::from_chars(line.data() + pos, line.data() + end, value);
+  if (ec != std::errc()) {
+    return fallback;
+  }
+  return value;
+}
+
+/**
+ * 从词条行中提取 t 值（最近使用时间），未找到或解析失败返回 0
+ */
+inline double parse_t_value(std::string_view line) {
+  return parse_number_field(line, "t=", 0.0);
+}
+
+/**
+ * 提取词条键（编码<TAB>词条），不是词条格式的行返回空
+ */
+inline std::string_view record_key(std::string_view line) {
+  size_t first_tab = line.find('\t');
+  if (first_tab == std::string_view::npos) {
+    return std::string_view();
+  }
+  size_t second_tab = line.find('\t', first_tab + 1);
+  if (second_tab == std::string_view::npos) {
+    return std::string_view();
+  }
+  return line.substr(0, second_tab);
+}
+
+// ---------------------------------------------------------------------------
+// 过滤核心的策略（policy）
+//
+// filter_lines 以 Reader / Predicate / Sink / Capture 四个策略为模板参数：
+//   Reader:    bool(std::string_view& line)，读取下一行（不含换行符），读完返回 false
+//   Predicate: bool(std::string_view line)，返回 true 表示保留该行
+//   Sink:      void(std::string_view line)，写出保留的行
+//   Capture:   void(std::string_view line)，处理被删除的行（如记录词条）
+// 映射读取的各种组合按文件级别的配置分别特化，逐行循环完全内联；
+// 无法映射时的流式回退很少发生，读取、判断与捕获都使用下方的 Any* 类型擦除策略，只实例化一次。
+// ---------------------------------------------------------------------------
+
+// 基于内存映射的行读取器
+class MappedLineReader {
+ public:
+  MappedLineReader(const char* data, size_t size)
+      : cur_(data), end_(data + size) {}
+
+  bool operator()(std::string_view& line) {
+    if (cur_ == end_) {
+      return false;
+    }
+    const char* newline = static_cast<const char*>(
+        std::memchr(cur_, '\n', static_cast<size_t>(end_ - cur_)));
+    const char* stop = newline ? newline : end_;
+    line = std::string_view(cur_, static_cast<size_t>(stop - cur_));
+    cur_ = newline ? newline + 1 : end_;
+    return true;
+  }
+
+ private:
+  const char* cur_;
+  const char* end_;
+};
+
+// 基于 std::istream 的行读取器（映射失败时的回退路径）
+class StreamLineReader {
+ public:
+  explicit StreamLineReader(std::istream& in) : in_(in) {
+    line_.reserve(256);
+  }
+
+  bool operator()(std::string_view& line) {
+    if (!std::getline(in_, line_)) {
+      return false;
+    }
+    line = line_;
+    return true;
+  }
+
+ private:
+  std::istream& in_;
+  std::string line_;
+};
+
+// 仅依据 c 值判断：c > 0 的行保留
+struct CValuePredicate {
+  bool operator()(std::string_view line) const {
+    return parse_c_value(line) > 0.0;
+  }
+};
+
+// 写入 std::ostream，每行追加换行符
+class StreamSink {
+ public:
+  explicit StreamSink(std::ostream& out) : out_(out) {}
+
+  void operator()(std::string_view line) {
+    out_.write(line.data(), static_cast<std::streamsize>(line.size()));
+    out_.put('\n');
+  }
+
+ private:
+  std::ostream& out_;
+};
+
+// 不记录被删除的词条
+struct NoWordCapture {
+  void operator()(std::string_view) const {}
+};
+
+// 记录被删除行中的词条文本
+class WordCapture {
+ public:
+  explicit WordCapture(StringList& words) : words_(words) {}
+
+  void operator()(std::string_view line) {
+    words_.push_back(extract_word_text(line));
+  }
+
+ private:
+  StringList& words_;
+};
+
+// 类型擦除的通用策略（流式回退路径）
+using AnyLineReader = std::function<bool(std::string_view&)>;
+using AnyLinePredicate = std::function<bool(std::string_view)>;
+using AnyLineCapture = std::function<void(std::string_view)>;
+
+// 单个文件的过滤统计
+struct FilterStats {
+  uint64_t lines_scanned = 0;  // 扫描的非空行数
+  uint64_t lines_kept = 0;     // 保留的行数
+  uint64_t lines_dropped = 0;  // 删除的行数
+  uint64_t bytes_read = 0;     // 读取的字节数（含换行符）
+  uint64_t bytes_written = 0;  // 写出的字节数（含换行符）
+};
+
+/**
+ * 过滤核心：逐行读取，保留满足条件的行，空行直接丢弃
+ */
+template <class Reader, class Predicate, class Sink, class Capture>
+FilterStats filter_lines(Reader& read, const Predicate& keep, Sink& write, Capture& capture) {
+  FilterStats stats;
+  std::string_view line;
+  while (read(line)) {
+    stats.bytes_read += line.size() + 1;
+    if (line.empty()) continue;
+    ++stats.lines_scanned;
+    if (keep(line)) {
+      write(line);
+      ++stats.lines_kept;
+      stats.bytes_written += line.size() + 1;
+    } else {
+      capture(line);
+      ++stats.lines_dropped;
+    }
+  }
+  return stats;
+}
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef USERDB_HEADER_HPP_
+#define USERDB_HEADER_HPP_
+
+#include <charconv>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+
+#include "file_sink.hpp"
+#include "userdb_filter.hpp"
+
+namespace userdb {
+
+/**
+ * .userdb.txt 文件头（开头连续的 '#' 行），如：
+ *   # Rime user dictionary
+ *   #@/db_name	luna_pinyin
+ *   #@/tick	693
+ */
+struct UserdbHeader {
+  std::string_view block;  // 文件头原文，末行可能不含换行符
+  std::string db_name;
+  uint64_t tick = 0;
+  bool has_tick = false;
+};
+
+/**
+ * 解析文件头中的元数据字段（db_name、tick）
+ */
+inline void parse_header_fields(UserdbHeader& header) {
+  MappedLineReader read(header.block.data(), header.block.size());
+  std::string_view line;
+  while (read(line)) {
+    if (line.substr(0, 3) != "#@/") continue;
+    size_t tab = line.find('\t');
+    if (tab == std::string_view::npos) continue;
+    std::string_view name = line.substr(3, tab - 3);
+    std::string_view value = line.substr(tab + 1);
+    if (!value.empty() && value.back() == '\r') {
+      value.remove_suffix(1);
+    }
+    if (name == "db_name") {
+      header.db_name = std::string(value);
+    } else if (name == "tick") {
+      auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), header.tick);
+      header.has_tick = ec == std::errc();
+    }
+  }
+}
+
+/**
+ * 从文件内容开头识别文件头
+ */
+inline UserdbHeader parse_header(std::string_view content) {
+  size_t end = 0;
+  while (end < content.size() && content[end] == '#') {
+    size_t newline = content.find('\n', end);
+    end = newline == std::string_view::npos ? content.size() : newline + 1;
+  }
+  UserdbHeader header;
+  header.block = content.substr(0, end);
+  parse_header_fields(header);
+  return header;
+}
+
+/**
+ * 从流中读取文件头（流式回退路径），block 指向 storage
+ */
+inline UserdbHeader read_header(std::istream& in, std::string& storage) {
+  storage.clear();
+  std::string line;
+  while (in.peek() == '#' && std::getline(in, line)) {
+    storage += line;
+    storage += '\n';
+  }
+  UserdbHeader header;
+  header.block = storage;
+  parse_header_fields(header);
+  return header;
+}
+
+/**
+ * 按原样一次性写出文件头，保证以换行符结尾
+ * @return 写出的字节数
+ */
+inline uint64_t write_header(std::ostream& out, std::string_view block) {
+  if (block.empty()) {
+    return 0;
+  }
+  out.write(block.data(), static_cast<std::streamsize>(block.size()));
+  if (block.back() != '\n') {
+    out.put('\n');
+    return block.size() + 1;
+  }
+  return block.size();
+}
+
+inline uint64_t write_header(FileSink& out, std::string_view block) {
+  if (block.empty()) {
+    return 0;
+  }
+  out.write(block);
+  if (block.back() != '\n') {
+    out.write("\n");
+    return block.size() + 1;
+  }
+  return block.size();
+}
+
+// 剪除长期未使用的词条：在基础判断之上，要求 t >= min_tick
+template <class Base>
+class IdlePrunePredicate {
+ public:
+  IdlePrunePredicate(const Base& base, double min_tick) : base_(base), min_tick_(min_tick) {}
+
+  bool operator()(std::string_view line) const {
+    if (!base_(line)) {
+      return false;
+    }
+    return record_key(line).empty() || parse_t_value(line) >= min_tick_;
+  }
+
+ private:
+  Base base_;
+  double min_tick_;
+};
+
+}  // namespace userdb
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef USERDB_MERGE_HPP_
+#define USERDB_MERGE_HPP_
+
+#include <filesystem>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clean_options.hpp"
+#include "file_sink.hpp"
+#include "mapped_file.hpp"
+#include "tombstone_set.hpp"
+#include "userdb_dedup.hpp"
+#include "userdb_file_filter.hpp"
+#include "userdb_filter.hpp"
+#include "userdb_header.hpp"
+
+namespace userdb {
+
+/**
+ * 多路归并中的单个输入游标，每次停在一条词条上
+ * rime 导出的 .userdb.txt 按词条键（编码<TAB>词条）升序排列
+ */
+class MergeCursor {
+ public:
+  explicit MergeCursor(std::string_view data) : read_(data.data(), data.size()) {}
+
+  /**
+   * 前进到下一条词条，途中遇到的非词条行交给 passthrough
+   * @return 输入已读完时返回 false
+   */
+  template <class Passthrough>
+  bool advance(Passthrough& passthrough) {
+    std::string_view line;
+    while (read_(line)) {
+      bytes_read_ += line.size() + 1;
+      if (line.empty()) continue;
+      std::string_view key = record_key(line);
+      if (key.empty()) {
+        passthrough(line);
+        continue;
+      }
+      if (!key_.empty() && key < key_) {
+        sorted_ = false;
+      }
+      line_ = line;
+      key_ = key;
+      return true;
+    }
+    return false;
+  }
+
+  std::string_view line() const { return line_; }
+  std::string_view key() const { return key_; }
+  bool sorted() const { return sorted_; }
+  uint64_t bytes_read() const { return bytes_read_; }
+
+ private:
+  MappedLineReader read_;
+  std::string_view line_;
+  std::string_view key_;
+  bool sorted_ = true;
+  uint64_t bytes_read_ = 0;
+};
+
+/**
+ * 对已排序的多个输入（不含文件头）做 k 路流式归并，相同词条按合并规则合并为一条
+ * 非词条行原样写出。时间 O(总大小)，额外内存 O(k)。
+ * @return 发现某个输入未排序时返回 false，此时输出不完整，需要改用 merge_unsorted
+ */
+template <class Predicate, class Sink, class Capture>
+bool merge_sorted(const std::vector<std::string_view>& inputs, MergeRule rule,
+                  const Predicate& keep, Sink& write, Capture& capture,
+                  FileFilterStats* stats) {
+  std::vector<MergeCursor> cursors;
+  cursors.reserve(inputs.size());
+  for (std::string_view input : inputs) {
+    cursors.emplace_back(input);
+  }
+
+  FileFilterStats result;
+  auto passthrough = [&](std::string_view line) {
+    write(line);
+    ++result.lines_scanned;
+    ++result.lines_kept;
+    result.bytes_written += line.size() + 1;
+  };
+  auto advance = [&](size_t i) {
+    return cursors[i].advance(passthrough);
+  };
+
+  // 最小堆：键较小者优先，键相同时主输入优先
+  auto greater = [&](size_t a, size_t b) {
+    int cmp = cursors[a].key().compare(cursors[b].key());
+    return cmp != 0 ? cmp > 0 : a > b;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+  for (size_t i = 0; i < cursors.size(); ++i) {
+    if (advance(i)) heap.push(i);
+  }
+
+  std::string rewritten;
+  while (!heap.empty()) {
+    size_t first = heap.top();
+    heap.pop();
+    std::string_view key = cursors[first].key();
+    MergedRecord record;
+
+    // 消费游标中所有键为 key 的连续词条，然后放回堆中
+    auto take = [&](size_t i) {
+      do {
+        std::string_view line = cursors[i].line();
+        ++result.lines_scanned;
+        if (keep(line)) {
+          record.add(line, rule);
+        } else {
+          capture(line);
+          ++result.lines_dropped;
+        }
+        if (!advance(i)) return true;
+      } while (cursors[i].key() == key);
+      if (!cursors[i].sorted()) return false;
+      heap.push(i);
+      return true;
+    };
+
+    if (!take(first)) return false;
+    while (!heap.empty() && cursors[heap.top()].key() == key) {
+      size_t next = heap.top();
+      heap.pop();
+      if (!take(next)) return false;
+    }
+
+    if (record.count > 0) {
+      std::string_view line = record.output(rule, rewritten);
+      write(line);
+      ++result.lines_kept;
+      result.lines_merged += record.count - 1;
+      result.bytes_written += line.size() + 1;
+    }
+  }
+
+  for (const auto& cursor : cursors) {
+    if (!cursor.sorted()) return false;
+    result.bytes_read += cursor.bytes_read();
+  }
+  if (stats) {
+    *stats = result;
+  }
+  return true;
+}
+
+/**
+ * 未排序输入（不含文件头）的回退路径：依次读入全部输入，经哈希去重后写出
+ */
+template <class Predicate, class Sink, class Capture>
+void merge_unsorted(const std::vector<std::string_view>& inputs, MergeRule rule,
+                    const Predicate& keep, Sink& write, Capture& capture,
+                    FileFilterStats* stats) {
+  DedupSink dedup(rule);
+  FileFilterStats result;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    MappedLineReader read(inputs[i].data(), inputs[i].size());
+    FilterStats part = filter_lines(read, keep, dedup, capture);
+    result.lines_scanned += part.lines_scanned;
+    result.lines_kept += part.lines_kept;
+    result.lines_dropped += part.lines_dropped;
+    result.bytes_read += part.bytes_read;
+  }
+  result.lines_merged = dedup.merged_count();
+  result.lines_kept -= result.lines_merged;
+  result.bytes_written = dedup.flush(write);
+  if (stats) {
+    *stats = result;
+  }
+}
+
+/**
+ * 将同一词典在各设备下的多个 .userdb.txt 合并、清理为一个文件
+ * inputs[0] 为主输入（通常是本机设备目录下的副本），其文件头被保留。
+ * 未指定合并规则时按 max_c 合并（与 rime 同步时的合并方式一致）。
+ * @param tombstones 非空时，其中的词条即使 c > 0 也会被删除
+ */
+inline bool merge_userdb_files(const std::vector<std::filesystem::path>& inputs,
+                               const std::filesystem::path& output,
+                               const CleanOptions& options,
+                               StringList& deleted_words,
+                               FileFilterStats* stats = nullptr,
+                               const TombstoneSet* tombstones = nullptr) {
+  // 只保留主输入的文件头，各输入的正文参与归并
+  std::vector<std::unique_ptr<InputBuffer>> buffers;
+  std::vector<std::string_view> views;
+  std::string_view primary_header;
+  for (const auto& input : inputs) {
+    buffers.push_back(std::make_unique<InputBuffer>());
+    if (!buffers.back()->open(input)) {
+      return false;
+    }
+    buffers.back()->advise_sequential(options.drop_page_cache);
+    std::string_view content = buffers.back()->view();
+    UserdbHeader header = parse_header(content);
+    if (views.empty()) {
+      primary_header = header.block;
+    }
+    views.push_back(content.substr(header.block.size()));
+  }
+
+  MergeRule rule = options.merge_rule == MergeRule::kNone ? MergeRule::kMaxC : options.merge_rule;
+  const size_t words_before = deleted_words.size();
+
+  // 保留的行直接引用各输入的缓冲区写出
+  auto open_output = [&](FileSink& out) {
+    out.set_drop_page_cache(options.drop_page_cache);
+    if (!out.open(output)) {
+      return false;
+    }
+    for (const auto& buffer : buffers) {
+      out.add_source(buffer->view());
+    }
+    write_header(out, primary_header);
+    return true;
+  };
+
+  auto run_with = [&](const auto& keep, auto& capture) {
+    {
+      FileSink out;
+      if (!open_output(out)) {
+        return false;
+      }
+      if (merge_sorted(views, rule, keep, out, capture, stats)) {
+        return out.close();
+      }
+    }
+    // 存在未排序的输入，丢弃已写出的部分，改用哈希去重
+    deleted_words.truncate(words_before);
+    FileSink out;
+    if (!open_output(out)) {
+      return false;
+    }
+    merge_unsorted(views, rule, keep, out, capture, stats);
+    return out.close();
+  };
+
+  auto run = [&](auto& capture) {
+    if (tombstones) {
+      return run_with(TombstonePredicate(*tombstones), capture);
+    }
+    return run_with(CValuePredicate(), capture);
+  };
+
+  if (options.record_deleted_words) {
+    WordCapture capture(deleted_words);
+    return run(capture);
+  }
+  NoWordCapture capture;
+  return run(capture);
+}
+
+}  // namespace userdb
+
+#endif
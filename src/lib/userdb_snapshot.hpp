@@ -0,0 +1,297 @@
+#ifndef USERDB_SNAPSHOT_HPP_
+#define USERDB_SNAPSHOT_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "clean_options.hpp"
+#include "mapped_file.hpp"
+#include "tombstone_set.hpp"
+#include "userdb_filter.hpp"
+#include "userdb_header.hpp"
+
+namespace userdb {
+
+// ---------------------------------------------------------------------------
+// 二进制快照（.userdb.snap）
+//
+// 与 .userdb.txt 并存的只读快照，可直接映射使用，无需逐行解析。目前只用于清理前判断文件是否
+// 需要重写（snapshot_needs_clean）；合并设备副本与统计仍读取文本，也不由快照重新生成文本，
+// 文本始终是唯一的数据来源，快照过期或损坏时忽略即可。
+//
+// 布局：
+//   SnapshotHeader
+//   键索引：record_count + 1 个 uint64，第 i 个键为 pool[index[i], index[i+1])
+//   c 列：record_count 个 double
+//   d 列：record_count 个 double
+//   t 列：record_count 个 int64
+//   字符串池：文本文件头 + 按字节序升序排列的词条键（编码<TAB>词条）
+// 所有数组按 8 字节对齐，采用本机字节序（以 byte_order 字段校验）。
+// ---------------------------------------------------------------------------
+
+constexpr char kSnapshotMagic[8] = {'R', 'U', 'D', 'B', 'S', 'N', 'P', '1'};
+constexpr uint32_t kSnapshotVersion = 2;
+constexpr uint32_t kSnapshotByteOrder = 0x01020304;
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t source_size;        // 生成快照时 .userdb.txt 的大小
+  int64_t source_mtime;        // 生成快照时 .userdb.txt 的修改时间
+  uint64_t record_count;
+  uint64_t duplicate_count;    // 相同键的重复词条数
+  uint64_t tick;               // 文件头中的 #@/tick
+  uint64_t dirty_lines;        // 过滤时会删除的非词条行数（空行、c<=0 的非词条行），快照不保存这些行
+  uint64_t text_header_offset;
+  uint64_t text_header_size;
+  uint64_t key_index_offset;
+  uint64_t c_offset;
+  uint64_t d_offset;
+  uint64_t t_offset;
+  uint64_t pool_offset;
+  uint64_t pool_size;
+};
+static_assert(sizeof(SnapshotHeader) % 8 == 0, "snapshot arrays must stay 8-byte aligned");
+
+/**
+ * 文本文件对应的快照路径：xxx.userdb.txt -> xxx.userdb.snap
+ */
+inline std::filesystem::path snapshot_path_for(const std::filesystem::path& text_path) {
+  std::string filename = text_path.filename().string();
+  const std::string suffix = ".userdb.txt";
+  if (filename.size() > suffix.size() &&
+      filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0) {
+    filename.replace(filename.size() - suffix.size(), suffix.size(), ".userdb.snap");
+  } else {
+    filename += ".snap";
+  }
+  return text_path.parent_path() / filename;
+}
+
+inline int64_t file_mtime(const std::filesystem::path& path, std::error_code& ec) {
+  return static_cast<int64_t>(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+}
+
+// 映射后的只读快照
+class SnapshotView {
+ public:
+  bool open(const std::filesystem::path& path) {
+    if (!file_.open(path) || file_.size() < sizeof(SnapshotHeader)) {
+      return false;
+    }
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 ||
+        header_.version != kSnapshotVersion ||
+        header_.byte_order != kSnapshotByteOrder) {
+      return false;
+    }
+    const uint64_t count = header_.record_count;
+    const uint64_t size = file_.size();
+    auto fits = [size](uint64_t offset, uint64_t bytes) {
+      return offset % 8 == 0 && offset <= size && bytes <= size - offset;
+    };
+    if (count >= size / 8 ||
+        !fits(header_.key_index_offset, (count + 1) * 8) ||
+        !fits(header_.c_offset, count * 8) ||
+        !fits(header_.d_offset, count * 8) ||
+        !fits(header_.t_offset, count * 8) ||
+        header_.pool_offset > size || header_.pool_size > size - header_.pool_offset ||
+        header_.text_header_offset > header_.pool_size ||
+        header_.text_header_size > header_.pool_size - header_.text_header_offset) {
+      return false;
+    }
+    key_index_ = reinterpret_cast<const uint64_t*>(file_.data() + header_.key_index_offset);
+    c_ = reinterpret_cast<const double*>(file_.data() + header_.c_offset);
+    d_ = reinterpret_cast<const double*>(file_.data() + header_.d_offset);
+    t_ = reinterpret_cast<const int64_t*>(file_.data() + header_.t_offset);
+    pool_ = std::string_view(file_.data() + header_.pool_offset, header_.pool_size);
+    // 键索引必须单调且不越界
+    for (uint64_t i = 0; i < count; ++i) {
+      if (key_index_[i] > key_index_[i + 1]) return false;
+    }
+    return key_index_[count] <= pool_.size();
+  }
+
+  /**
+   * 快照是否与文本文件的当前内容对应（大小与修改时间一致）
+   */
+  bool is_fresh(const std::filesystem::path& text_path) const {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(text_path, ec);
+    if (ec) return false;
+    int64_t mtime = file_mtime(text_path, ec);
+    return !ec && size == header_.source_size && mtime == header_.source_mtime;
+  }
+
+  size_t size() const { return static_cast<size_t>(header_.record_count); }
+  std::string_view key(size_t i) const {
+    return pool_.substr(key_index_[i], key_index_[i + 1] - key_index_[i]);
+  }
+  double c(size_t i) const { return c_[i]; }
+  double d(size_t i) const { return d_[i]; }
+  int64_t t(size_t i) const { return t_[i]; }
+  uint64_t tick() const { return header_.tick; }
+  uint64_t duplicate_count() const { return header_.duplicate_count; }
+  uint64_t dirty_lines() const { return header_.dirty_lines; }
+  std::string_view text_header() const {
+    return pool_.substr(header_.text_header_offset, header_.text_header_size);
+  }
+
+ private:
+  MappedFile file_;
+  SnapshotHeader header_{};
+  const uint64_t* key_index_ = nullptr;
+  const double* c_ = nullptr;
+  const double* d_ = nullptr;
+  const int64_t* t_ = nullptr;
+  std::string_view pool_;
+};
+
+/**
+ * 由 .userdb.txt 生成二进制快照（先写临时文件再替换）
+ * 快照只保存文件头与词条，正文中的非词条行不会保留，其中过滤时会被删除的只记录行数。
+ * @param temp_suffix 临时文件的后缀（见 CleanOptions::temp_suffix）
+ */
+inline bool build_snapshot(const std::filesystem::path& text_path,
+                           const std::filesystem::path& snapshot_path,
+                           const std::string& temp_suffix = ".cache") {
+  std::error_code ec;
+  uint64_t source_size = std::filesystem::file_size(text_path, ec);
+  if (ec) return false;
+  int64_t source_mtime = file_mtime(text_path, ec);
+  if (ec) return false;
+
+  InputBuffer input;
+  if (!input.open(text_path)) {
+    return false;
+  }
+  UserdbHeader text_header = parse_header(input.view());
+  std::string_view body = input.view().substr(text_header.block.size());
+
+  struct Record {
+    std::string_view key;
+    double c;
+    double d;
+    int64_t t;
+  };
+  std::vector<Record> records;
+  MappedLineReader read(body.data(), body.size());
+  std::string_view line;
+  bool sorted = true;
+  uint64_t dirty_lines = 0;
+  while (read(line)) {
+    std::string_view key = record_key(line);
+    if (key.empty()) {
+      // 与 filter_lines / CValuePredicate 一致：空行与 c<=0 的非词条行会被删除
+      if (line.empty() || parse_c_value(line) <= 0.0) {
+        ++dirty_lines;
+      }
+      continue;
+    }
+    if (!records.empty() && key < records.back().key) {
+      sorted = false;
+    }
+    records.push_back(Record{key, parse_c_value(line), parse_number_field(line, "d=", 0.0),
+                             static_cast<int64_t>(parse_t_value(line))});
+  }
+  if (!sorted) {
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) { return a.key < b.key; });
+  }
+
+  const uint64_t count = records.size();
+  std::vector<uint64_t> key_index;
+  std::vector<double> c_column, d_column;
+  std::vector<int64_t> t_column;
+  key_index.reserve(count + 1);
+  c_column.reserve(count);
+  d_column.reserve(count);
+  t_column.reserve(count);
+  std::string pool(text_header.block);
+  uint64_t duplicate_count = 0;
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (i > 0 && records[i].key == records[i - 1].key) {
+      ++duplicate_count;
+    }
+    key_index.push_back(pool.size());
+    pool.append(records[i].key);
+    c_column.push_back(records[i].c);
+    d_column.push_back(records[i].d);
+    t_column.push_back(records[i].t);
+  }
+  key_index.push_back(pool.size());
+
+  SnapshotHeader header{};
+  std::memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+  header.version = kSnapshotVersion;
+  header.byte_order = kSnapshotByteOrder;
+  header.source_size = source_size;
+  header.source_mtime = source_mtime;
+  header.record_count = count;
+  header.duplicate_count = duplicate_count;
+  header.tick = text_header.tick;
+  header.dirty_lines = dirty_lines;
+  header.key_index_offset = sizeof(SnapshotHeader);
+  header.c_offset = header.key_index_offset + (count + 1) * 8;
+  header.d_offset = header.c_offset + count * 8;
+  header.t_offset = header.d_offset + count * 8;
+  header.pool_offset = header.t_offset + count * 8;
+  header.pool_size = pool.size();
+  header.text_header_offset = 0;
+  header.text_header_size = text_header.block.size();
+
+  std::filesystem::path temp_path = snapshot_path;
+  temp_path += temp_suffix;
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(key_index.data()), static_cast<std::streamsize>(key_index.size() * 8));
+    out.write(reinterpret_cast<const char*>(c_column.data()), static_cast<std::streamsize>(count * 8));
+    out.write(reinterpret_cast<const char*>(d_column.data()), static_cast<std::streamsize>(count * 8));
+    out.write(reinterpret_cast<const char*>(t_column.data()), static_cast<std::streamsize>(count * 8));
+    out.write(pool.data(), static_cast<std::streamsize>(pool.size()));
+    out.flush();
+    if (!out) {
+      out.close();
+      std::filesystem::remove(temp_path, ec);
+      return false;
+    }
+  }
+  std::filesystem::rename(temp_path, snapshot_path, ec);
+  return !ec;
+}
+
+/**
+ * 仅凭快照判断文件是否有需要清理的内容，无需解析文本
+ */
+inline bool snapshot_needs_clean(const SnapshotView& snapshot, const CleanOptions& options,
+                                 const TombstoneSet* tombstones) {
+  if (snapshot.dirty_lines() > 0 ||
+      (options.merge_rule != MergeRule::kNone && snapshot.duplicate_count() > 0)) {
+    return true;
+  }
+  bool prune = options.prune_idle_ticks > 0 && snapshot.tick() > options.prune_idle_ticks;
+  int64_t min_tick = prune ? static_cast<int64_t>(snapshot.tick() - options.prune_idle_ticks) : 0;
+  for (size_t i = 0; i < snapshot.size(); ++i) {
+    if (snapshot.c(i) <= 0.0 || (prune && snapshot.t(i) < min_tick) ||
+        (tombstones && tombstones->deletes(snapshot.key(i), static_cast<double>(snapshot.t(i))))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace userdb
+
+#endif
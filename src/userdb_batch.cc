@@ -0,0 +1,525 @@
+// userdb_batch.cc
+// 多租户批量清理：所有租户的逐文件任务共用一个公平调度的工作窃取线程池
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "lib/batch_checkpoint.hpp"
+#include "lib/fair_work_pool.hpp"
+#include "lib/tenant_lease.hpp"
+#include "lib/trace.hpp"
+#include "userdb_batch.hpp"
+
+namespace fs = std::filesystem;
+
+namespace userdb {
+
+std::string TenantResult::to_json() const {
+  std::string json = "{\"tenant\":\"" + json_escape(name) + "\"";
+  json += ",\"ok\":";
+  json += ok ? "true" : "false";
+  auto field = [&](const char* key, uint64_t value) {
+    json += ",\"";
+    json += key;
+    json += "\":";
+    json += std::to_string(value);
+  };
+  auto millis = [&](const char* key, double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    json += ",\"";
+    json += key;
+    json += "\":";
+    json += buffer;
+  };
+  field("deleted_count", static_cast<uint64_t>(result.deleted_count < 0 ? 0 : result.deleted_count));
+  field("folder_files_deleted", static_cast<uint64_t>(result.folder_files_deleted < 0 ? 0 : result.folder_files_deleted));
+  field("cleaned_folders", result.cleaned_folders.size());
+  field("files", files);
+  field("failed_files", failed_files);
+  field("resumed_files", resumed_files);
+  field("bytes_read", bytes_read);
+  field("bytes_written", bytes_written);
+  millis("wait_ms", wait_ms);
+  millis("duration_ms", duration_ms);
+  json += "}";
+  return json;
+}
+
+// 使用检查点时，租户写完的文件每攒够这么多个或每隔这么久提交一次并记入检查点，
+// 大租户中途崩溃后只需重做尚未提交的文件；不使用检查点时租户结束时一次提交
+constexpr size_t kCommitBatchFiles = 64;
+constexpr std::chrono::seconds kCommitBatchInterval(5);
+
+// 一个租户在批量任务中的状态；items 为合并组或单个文件，各自对应一个任务
+struct TenantState {
+  BatchTenant* tenant = nullptr;
+  BatchCheckpoint* checkpoint = nullptr;
+  LeaseDirectory* leases = nullptr;
+  CleanMetrics metrics;
+  TenantResult result;
+  std::vector<std::vector<fs::path>> items;
+  std::vector<std::vector<StagedDeletions>> item_deletions;  // 各任务删除的词条，按目标文件暂存
+  std::unique_ptr<DictionaryTombstones> tombstones;
+  std::unique_ptr<DeletedWordJournal> journal;  // 固定内存模式下删除的词条随文件提交写入日志
+  std::unique_ptr<DurableCommit> commit;        // 各任务写完的文件成批提交
+  std::atomic<size_t> pending{0};
+  std::atomic<size_t> resumed_files{0};
+  std::atomic<bool> failed{false};      // 任务抛出异常时置位，租户记为失败
+  std::atomic<bool> lease_lost{false};  // 续约失败后置位，其余任务不再清理，尚未提交的文件不再提交
+  std::chrono::steady_clock::time_point started;
+  std::mutex lease_mutex;
+  std::chrono::steady_clock::time_point renewed;
+  std::mutex commit_mutex;
+  std::chrono::steady_clock::time_point committed;
+  std::set<fs::path> replaced;  // 已替换的目标文件，由 commit_mutex 保护
+};
+
+double millis_between(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+/**
+ * 清理一个合并组（多个设备副本）或单个文件；合并失败时逐个清理各副本
+ * 清理结果登记在租户的提交中，提交后才记入检查点；删除的词条按目标文件暂存到 staged
+ */
+void clean_batch_item(TenantState& state, std::vector<fs::path>& copies, std::vector<StagedDeletions>& staged) {
+  const BatchTenant& tenant = *state.tenant;
+  const CleanOptions& options = tenant.options;
+  BatchCheckpoint* checkpoint = state.checkpoint;
+  // 同一组的副本属于同一词典
+  const TombstoneSet* tombstones = state.tombstones ? state.tombstones->find(copies.front()) : nullptr;
+  if (copies.size() > 1) {
+    StagedDeletions deletions;
+    deletions.target = tenant.context.local_sync_dir / copies.front().filename();
+    deletions.count = consolidate_userdb_copies(options, tenant.context.local_sync_dir, copies, deletions.words,
+                                                tombstones, state.metrics, state.commit.get());
+    if (deletions.count >= 0) {
+      staged.push_back(std::move(deletions));
+      return;
+    }
+  } else if (checkpoint && checkpoint->contains(tenant.name, copies.front().string(), file_fingerprint(copies.front()))) {
+    state.resumed_files.fetch_add(1, std::memory_order_relaxed);
+    CLEAN_LOG(kVerbose, kFile) << "Skipping " << copies.front().string() << ": already cleaned";
+    return;
+  }
+  for (const auto& file : copies) {
+    if (state.lease_lost.load(std::memory_order_relaxed)) {
+      break;
+    }
+    StagedDeletions deletions;
+    deletions.target = file;
+    try {
+      deletions.count = clean_userdb_file(file, options, deletions.words, tombstones, state.metrics,
+                                          state.journal.get(), state.commit.get());
+    } catch (const std::exception& e) {
+      CLEAN_LOG(kError, kFile) << "Failed to clean file " << file.string() << ": " << e.what();
+    }
+    staged.push_back(std::move(deletions));
+  }
+}
+
+/**
+ * 删除 sync 目录下其他进程留下的临时文件（<词典>.userdb.txt.<标识>.cache 等）
+ * 认领租户后调用：此时本进程持有租约，其他持有者已放弃或崩溃，它们的临时文件不会再被提交
+ */
+void remove_foreign_temp_files(const fs::path& sync_dir, const std::string& own_suffix) {
+  std::error_code ec;
+  for (fs::directory_iterator device(sync_dir, ec), end; !ec && device != end; device.increment(ec)) {
+    if (!device->is_directory(ec)) {
+      continue;
+    }
+    std::error_code file_ec;
+    for (fs::directory_iterator entry(device->path(), file_ec); !file_ec && entry != end; entry.increment(file_ec)) {
+      std::string name = entry->path().filename().string();
+      bool temp = name.size() > own_suffix.size() && name.compare(name.size() - 6, 6, ".cache") == 0 &&
+                  (name.find(".userdb.txt.") != std::string::npos || name.find(".userdb.snap.") != std::string::npos);
+      if (temp && name.compare(name.size() - own_suffix.size(), own_suffix.size(), own_suffix) != 0) {
+        std::error_code remove_ec;
+        if (fs::remove(entry->path(), remove_ec)) {
+          CLEAN_LOG(kVerbose, kFile) << "Removed stale temp file " << entry->path().string();
+        }
+      }
+    }
+  }
+}
+
+/**
+ * 距上次续约超过租约时长的三分之一时续约，同时完成的任务只有一个续约；force 为 true 时总是续约
+ * 续约失败说明租约已被其他进程抢占，该租户其余的任务与提交都会放弃
+ * @return 仍持有租约（未使用租约时总为 true）
+ */
+bool renew_lease(TenantState& state, bool force = false) {
+  if (!state.leases) {
+    return true;
+  }
+  std::unique_lock<std::mutex> lock(state.lease_mutex, std::defer_lock);
+  if (force) {
+    lock.lock();
+  } else {
+    lock.try_lock();
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (state.lease_lost.load(std::memory_order_relaxed) || !lock ||
+      (!force && now - state.renewed < std::chrono::seconds(state.leases->lease_seconds()) / 3)) {
+    return !state.lease_lost.load(std::memory_order_relaxed);
+  }
+  state.renewed = now;
+  if (!state.leases->renew(state.tenant->name)) {
+    CLEAN_LOG(kError, kGeneral) << "Tenant " << state.tenant->name
+              << ": lease was taken over by another process, abandoning remaining files";
+    state.lease_lost.store(true, std::memory_order_relaxed);
+    state.failed.store(true, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * 提交租户已写完的文件，已替换的文件以清理后的指纹记入检查点；调用方持有 commit_mutex
+ * 使用租约时先续约确认仍持有租约，否则删除临时文件，不替换任何文件
+ */
+void commit_tenant_files(TenantState& state) {
+  ScopedPhase phase(&state.metrics.phases, CleanPhase::kRename);
+  state.committed = std::chrono::steady_clock::now();
+  if (!renew_lease(state, true)) {
+    for (const auto& target : state.commit->discard()) {
+      if (state.journal) {
+        state.journal->discard(target);
+      }
+    }
+    return;
+  }
+  // 目录同步失败时文件已经替换，仍记入检查点，但租户记为失败
+  for (const auto& replaced : commit_replacements(*state.commit, state.journal.get(), &state.replaced)) {
+    if (replaced.error) {
+      state.failed.store(true, std::memory_order_relaxed);
+    }
+    if (replaced.renamed && state.checkpoint) {
+      state.checkpoint->record(state.tenant->name, replaced.target.string(), file_fingerprint(replaced.target));
+    }
+  }
+}
+
+/**
+ * 使用检查点时，待提交的文件够一批或距上次提交已久时提交；正在提交时直接返回
+ */
+void commit_batch_if_due(TenantState& state) {
+  if (!state.checkpoint) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(state.commit_mutex, std::try_to_lock);
+  if (!lock || (state.commit->size() < kCommitBatchFiles &&
+                std::chrono::steady_clock::now() - state.committed < kCommitBatchInterval)) {
+    return;
+  }
+  commit_tenant_files(state);
+}
+
+/**
+ * 租户的最后一个任务结束后调用：提交剩余的清理结果，回收备份分块，
+ * 按文件顺序汇总已替换的文件删除的词条，写日志与指标
+ */
+void finish_tenant(TenantState& state, std::mutex& result_mutex,
+                   const std::function<void(const TenantResult&)>& on_result) {
+  const BatchTenant& tenant = *state.tenant;
+  const CleanOptions& options = tenant.options;
+  TenantResult& result = state.result;
+  CleanMetrics& metrics = state.metrics;
+
+  if (state.commit) {
+    std::lock_guard<std::mutex> lock(state.commit_mutex);
+    commit_tenant_files(state);
+  }
+  if (options.backup_mode == BackupMode::kChunked) {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kBackup);
+    collect_backup_garbage(options);
+  }
+  // 只计入已替换的文件：失去租约前已成批提交的文件计入，之后放弃的不计入
+  for (size_t i = 0; i < state.items.size(); ++i) {
+    result.result.deleted_count +=
+        settle_staged_deletions(state.item_deletions[i], state.replaced, result.result.deleted_words);
+  }
+  {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kJournal);
+    log_deleted_words(result.result.deleted_words, tenant.context.sync_dir);
+    close_deleted_word_journal(state.journal.get());
+  }
+
+  for (const auto& file : metrics.files()) {
+    ++result.files;
+    result.bytes_read += file.bytes_read;
+    result.bytes_written += file.bytes_written;
+    if (!file.ok) {
+      ++result.failed_files;
+    }
+  }
+  result.ok = result.ok && result.failed_files == 0 && !state.failed.load(std::memory_order_relaxed);
+  result.resumed_files = state.resumed_files.load(std::memory_order_relaxed);
+  if (result.ok && state.checkpoint) {
+    state.checkpoint->record(tenant.name, "", BatchCheckpoint::kTenantDone);
+  }
+  // 失败的租户只释放租约，其他进程或下次运行会重试
+  if (state.leases) {
+    state.leases->release(tenant.name, result.ok);
+  }
+  auto now = std::chrono::steady_clock::now();
+  result.duration_ms = millis_between(state.started, now);
+  CLEAN_LOG(kInfo, kGeneral) << "Tenant " << tenant.name << ": deleted " << result.result.deleted_count
+            << " entries from " << result.result.cleaned_files.size() << " dictionaries";
+
+  metrics.set_folder_files_deleted(result.result.folder_files_deleted);
+  metrics.set_total_nanos(static_cast<uint64_t>(result.duration_ms * 1e6));
+  if (options.record_metrics) {
+    fs::path metrics_file = tenant.context.sync_dir / "userdb_cleaner_metrics.jsonl";
+    if (!append_metrics_line(metrics_file, metrics.to_json(options, get_current_time()))) {
+      CLEAN_LOG(kError, kGeneral) << "Failed to write metrics to " << metrics_file.string();
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(result_mutex);
+    if (on_result) {
+      on_result(result);
+    }
+  }
+  // 批量任务可能包含数千个租户，结果交出后即释放
+  state.items = {};
+  std::vector<std::vector<StagedDeletions>>().swap(state.item_deletions);
+  state.replaced = {};
+  state.tombstones.reset();
+  state.journal.reset();
+  state.commit.reset();
+  result.result = CleanResult();
+}
+
+BatchStats run_batch_clean(std::vector<BatchTenant>& tenants, const BatchOptions& batch_options,
+                           const std::function<void(const TenantResult&)>& on_result) {
+  auto start_time = std::chrono::steady_clock::now();
+  TraceRecorder& trace = TraceRecorder::instance();
+  if (!batch_options.trace_file.empty()) {
+    trace.start();
+  }
+  BatchStats stats;
+  // 离开作用域时先写完排队的日志，再结束 batch_span
+  {
+    TraceSpan batch_span(__func__);
+    CleanLogger& logger = clean_logger();
+    logger.set_verbose(batch_options.log_verbose);
+    logger.set_rate_limit(batch_options.log_rate_limit);
+    ScopedAsyncLog async_log(logger);
+
+    std::unique_ptr<BatchCheckpoint> checkpoint;
+    if (!batch_options.checkpoint_file.empty()) {
+      checkpoint = std::make_unique<BatchCheckpoint>();
+      if (!checkpoint->open(batch_options.checkpoint_file)) {
+        CLEAN_LOG(kError, kGeneral) << "Failed to open checkpoint " << batch_options.checkpoint_file.string()
+                  << ", cleaning without it";
+        checkpoint.reset();
+      } else if (checkpoint->loaded() > 0) {
+        CLEAN_LOG(kInfo, kGeneral) << "Resuming from checkpoint " << batch_options.checkpoint_file.string() << " ("
+                  << checkpoint->loaded() << " records)";
+      }
+    }
+
+    // 各租户的配置通常相同，固定内存模式下被关闭的配置项只记录一次
+    bool restricted = false;
+    for (auto& tenant : tenants) {
+      if (!tenant.options.bounded_memory) {
+        continue;
+      }
+      if (restricted) {
+        restrict_to_bounded_memory(tenant.options);
+      } else {
+        apply_bounded_memory(tenant.options);
+        restricted = true;
+      }
+    }
+
+    FairWorkPool pool(tenants.size(), batch_options.threads, batch_options.window);
+    CLEAN_LOG(kInfo, kGeneral) << "Starting batch cleaning of " << tenants.size() << " tenants on " << pool.threads()
+              << " threads";
+
+    std::unique_ptr<LeaseDirectory> leases;
+    if (!batch_options.lease_dir.empty()) {
+      leases = std::make_unique<LeaseDirectory>(batch_options.lease_dir, batch_options.lease_owner,
+                                                batch_options.lease_seconds);
+      if (!leases->prepare()) {
+        CLEAN_LOG(kError, kGeneral) << "Failed to create lease directory " << batch_options.lease_dir.string();
+        leases.reset();
+      } else {
+        // 租约过期后原持有者可能仍在写文件，各进程使用不同的临时文件名
+        for (auto& tenant : tenants) {
+          tenant.options.temp_suffix = "." + leases->file_tag() + ".cache";
+        }
+      }
+    }
+
+    std::vector<std::unique_ptr<TenantState>> states(tenants.size());
+    std::mutex result_mutex;
+    std::atomic<size_t> failed_tenants{0};
+    std::atomic<size_t> resumed_tenants{0};
+    std::atomic<size_t> skipped_tenants{0};
+    auto report = [&](const TenantResult& result) {
+      if (!result.ok) {
+        failed_tenants.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (on_result) {
+        on_result(result);
+      }
+    };
+
+    // 同时处理的租户数有限：租户完成后才开始下一个，多个进程分片时不会一开始就认领全部租户
+    std::mutex admit_mutex;
+    size_t next_tenant = 0;
+    std::function<void()> start_next;
+    start_next = [&]() {
+      size_t t;
+      while (true) {
+        {
+          std::lock_guard<std::mutex> lock(admit_mutex);
+          if (next_tenant == tenants.size()) {
+            return;
+          }
+          t = next_tenant++;
+        }
+        if (checkpoint && checkpoint->tenant_done(tenants[t].name)) {
+          resumed_tenants.fetch_add(1, std::memory_order_relaxed);
+          continue;
+        }
+        break;
+      }
+      states[t] = std::make_unique<TenantState>();
+      TenantState* state = states[t].get();
+      state->tenant = &tenants[t];
+      state->checkpoint = checkpoint.get();
+      state->leases = leases.get();
+      state->result.name = tenants[t].name;
+
+      // 准备任务：认领租户，清空 .userdb 文件夹、扫描 sync 目录，再为每个合并组或文件派发任务
+      pool.post(t, [&pool, &result_mutex, &report, &start_next, &skipped_tenants, state, t, start_time]() {
+        USERDB_TRACE_SCOPE_DETAIL("batch_prepare_tenant", state->tenant->name);
+        const BatchTenant& tenant = *state->tenant;
+        if (state->leases) {
+          LeaseDirectory::Claim claim = state->leases->claim(tenant.name);
+          if (claim != LeaseDirectory::Claim::kClaimed) {
+            CLEAN_LOG(kVerbose, kGeneral) << "Tenant " << tenant.name
+                      << (claim == LeaseDirectory::Claim::kDone ? ": already cleaned" : ": claimed by another process");
+            skipped_tenants.fetch_add(1, std::memory_order_relaxed);
+            start_next();
+            return;
+          }
+          state->renewed = std::chrono::steady_clock::now();
+          remove_foreign_temp_files(tenant.context.sync_dir, tenant.options.temp_suffix);
+        }
+        state->started = std::chrono::steady_clock::now();
+        state->committed = state->started;
+        state->result.wait_ms = millis_between(start_time, state->started);
+        const CleanOptions& options = tenant.options;
+        CleanResult& result = state->result.result;
+        state->metrics.use_threads(1);
+
+        // 准备失败的租户不派发任务，直接结束并释放租约
+        try {
+          state->journal = open_deleted_word_journal(options, tenant.context.sync_dir);
+          state->commit = std::make_unique<DurableCommit>(options.durable_commit);
+          result.folder_files_deleted = clean_userdb_folders(tenant.context.user_data_dir, options.cleanup_list,
+                                                             result.cleaned_folders, state->metrics);
+          std::vector<fs::path> files;
+          {
+            ScopedPhase phase(&state->metrics.phases, CleanPhase::kDiscovery);
+            files = get_userdb_files(tenant.context.sync_dir, options.cleanup_list, result.cleaned_files);
+          }
+
+          // 租户内部不再并行读取，线程由池在租户之间分配
+          if (options.propagate_deletions && !files.empty()) {
+            ScopedPhase phase(&state->metrics.phases, CleanPhase::kFilter);
+            state->tombstones = std::make_unique<DictionaryTombstones>(collect_tombstones(files, 1));
+          }
+          if (options.consolidate_devices) {
+            state->items = group_device_copies(files);
+          } else {
+            for (auto& file : files) {
+              state->items.push_back({std::move(file)});
+            }
+          }
+        } catch (const std::exception& e) {
+          CLEAN_LOG(kError, kGeneral) << "Tenant " << tenant.name << ": " << e.what();
+          state->result.ok = false;
+          state->items.clear();
+        }
+
+        size_t count = state->items.size();
+        state->item_deletions.resize(count);
+        if (count == 0) {
+          finish_tenant(*state, result_mutex, report);
+          start_next();
+          return;
+        }
+        state->pending.store(count, std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i) {
+          pool.post(t, [&result_mutex, &report, &start_next, state, i]() {
+            USERDB_TRACE_SCOPE_NAMED("batch_clean_item");
+            // 异常不能越过计数，否则租户永远不会结束
+            try {
+              if (renew_lease(*state)) {
+                clean_batch_item(*state, state->items[i], state->item_deletions[i]);
+                commit_batch_if_due(*state);
+              }
+            } catch (const std::exception& e) {
+              CLEAN_LOG(kError, kGeneral) << "Tenant " << state->tenant->name << ": " << e.what();
+              state->failed.store(true, std::memory_order_relaxed);
+            }
+            if (state->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+              finish_tenant(*state, result_mutex, report);
+              start_next();
+            }
+          });
+        }
+      });
+    };
+
+    size_t max_active = batch_options.max_active_tenants ? batch_options.max_active_tenants : pool.threads() * 4;
+    for (size_t i = 0; i < max_active; ++i) {
+      start_next();
+    }
+
+    pool.run();
+
+    stats.tenants = tenants.size();
+    stats.failed_tenants = failed_tenants.load(std::memory_order_relaxed);
+    stats.resumed_tenants = resumed_tenants.load(std::memory_order_relaxed);
+    stats.skipped_tenants = skipped_tenants.load(std::memory_order_relaxed);
+    stats.threads = pool.threads();
+    stats.steals = pool.steals();
+    stats.duration_ms = millis_between(start_time, std::chrono::steady_clock::now());
+    CLEAN_LOG(kInfo, kGeneral) << "Batch cleaning completed: " << stats.tenants << " tenants, " << stats.failed_tenants
+              << " failed, " << stats.resumed_tenants << " resumed, " << stats.skipped_tenants << " skipped, "
+              << stats.steals << " tasks stolen";
+
+    // 全部成功时检查点已无用处，删除后下次从头清理
+    if (checkpoint && stats.failed_tenants == 0) {
+      checkpoint->close();
+      std::error_code ec;
+      fs::remove(batch_options.checkpoint_file, ec);
+    }
+  }
+
+  if (!batch_options.trace_file.empty()) {
+    trace.stop();
+    if (!trace.write_json(batch_options.trace_file)) {
+      CLEAN_LOG(kError, kGeneral) << "Failed to write trace to " << batch_options.trace_file.string();
+    }
+  }
+  return stats;
+}
+
+}  // namespace userdb
@@ -0,0 +1,84 @@
+#ifndef USERDB_BATCH_HPP_
+#define USERDB_BATCH_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "userdb_clean_core.hpp"
+
+namespace userdb {
+
+// 批量清理中的一个租户：一份用户目录及其 sync 目录
+struct BatchTenant {
+  std::string name;       // 结果记录中的标识，通常为用户目录
+  CleanOptions options;   // 各租户的 backup_repo 等路径不同，因此分别保存
+  CleanContext context;
+};
+
+// 单个租户的清理结果
+struct TenantResult {
+  std::string name;
+  CleanResult result;
+  size_t files = 0;          // 处理的 .userdb.txt 文件数（含合并的副本）
+  size_t failed_files = 0;
+  size_t resumed_files = 0;  // 检查点显示已清理而跳过的文件数
+  uint64_t bytes_read = 0;
+  uint64_t bytes_written = 0;
+  double wait_ms = 0;        // 批量开始到该租户第一个任务开始
+  double duration_ms = 0;    // 第一个任务开始到最后一个任务结束
+  bool ok = true;
+
+  /**
+   * 输出为一行 JSON（不含换行符与删除的词条）
+   */
+  std::string to_json() const;
+};
+
+struct BatchOptions {
+  size_t threads = 0;          // 0 表示按硬件并发数
+  size_t window = 0;           // 同时在途的任务数，0 表示线程数的两倍
+  bool log_verbose = false;
+  int log_rate_limit = 100;
+  std::filesystem::path trace_file;  // 非空时把整个批量任务的 trace 写到此处
+  // 非空时把完成的文件（成批提交后）与租户记入检查点，重启后跳过；全部租户成功后删除
+  std::filesystem::path checkpoint_file;
+  size_t max_active_tenants = 0;  // 同时处理的租户数，0 表示线程数的四倍
+  // 非空时多个进程通过该目录中的租约文件瓜分租户，见 lib/tenant_lease.hpp
+  std::filesystem::path lease_dir;
+  std::string lease_owner;        // 租约持有者标识，如 host:pid，各进程必须不同
+  int lease_seconds = 600;        // 租约时长，应远长于清理单个文件的耗时
+};
+
+// 整个批量任务的统计
+struct BatchStats {
+  size_t tenants = 0;
+  size_t failed_tenants = 0;
+  size_t resumed_tenants = 0;  // 检查点显示已完成而跳过的租户数
+  size_t skipped_tenants = 0;  // 由其他进程清理（持有租约或已完成）而跳过的租户数
+  size_t threads = 0;
+  uint64_t steals = 0;
+  double duration_ms = 0;
+};
+
+/**
+ * 在同一个线程池中清理多个租户
+ *
+ * 每个租户先清空 .userdb 文件夹并扫描 sync 目录，再把合并与逐文件清理派发为独立任务；
+ * 同时处理的租户不超过 max_active_tenants 个，它们的任务按租户轮转调度，
+ * 文件很多的租户不会阻塞其他租户。
+ * 租户的最后一个任务结束后回收备份分块、记录删除的词条与指标，然后调用 on_result。
+ * 租户的 context.sync 在批量模式中不调用。
+ * 启用检查点时，已完成的租户不再处理，清理后未被改动的文件不再清理；
+ * 中断前已清理文件的删除词条不会补记到 userdb_cleaner.txt。
+ * @param on_result 在工作线程中调用，各次调用互斥
+ */
+BatchStats run_batch_clean(std::vector<BatchTenant>& tenants, const BatchOptions& batch_options,
+                           const std::function<void(const TenantResult&)>& on_result);
+
+}  // namespace userdb
+
+#endif
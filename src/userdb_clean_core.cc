@@ -0,0 +1,938 @@
+// userdb_clean_core.cc
+// 不依赖 rime 的清理流程：插件与命令行工具共用
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lib/backup_store.hpp"
+#include "lib/chunk_store.hpp"
+#include "lib/file_op_batch.hpp"
+#include "lib/page_cache.hpp"
+#include "lib/parallel_for.hpp"
+#include "lib/tombstone_set.hpp"
+#include "lib/trace.hpp"
+#include "lib/userdb_file_filter.hpp"
+#include "lib/userdb_merge.hpp"
+#include "lib/userdb_snapshot.hpp"
+#include "userdb_clean_core.hpp"
+
+namespace fs = std::filesystem;
+
+namespace userdb {
+
+CleanLogger& clean_logger() {
+  static CleanLogger logger([](LogLevel level, const std::string& message) {
+    static const char* const kPrefixes[] = {"V ", "I ", "W ", "E "};
+    std::fprintf(stderr, "%s%s\n", kPrefixes[static_cast<int>(level)], message.c_str());
+  });
+  return logger;
+}
+
+/**
+ * 获取当前时间的中文格式字符串
+ */
+std::string get_current_time() {
+  USERDB_TRACE_SCOPE();
+  auto now = std::chrono::system_clock::now();
+  auto time_t = std::chrono::system_clock::to_time_t(now);
+  std::tm tm;
+#if defined(_WIN32) || defined(_WIN64)
+  localtime_s(&tm, &time_t);
+#else
+  localtime_r(&time_t, &tm);
+#endif
+  
+  std::ostringstream oss;
+  oss << std::setfill('0') 
+      << (tm.tm_year + 1900) << "-"
+      << std::setw(2) << (tm.tm_mon + 1) << "-"
+      << std::setw(2) << tm.tm_mday << " "
+      << std::setw(2) << tm.tm_hour << ":"
+      << std::setw(2) << tm.tm_min << ":"
+      << std::setw(2) << tm.tm_sec;
+  
+  return oss.str();
+}
+
+/**
+ * 为 .userdb.txt 打开一代新的带时间戳备份（compressed / chunked 模式）
+ */
+std::unique_ptr<BackupWriter> open_timestamped_backup(const fs::path& userdb_file, const CleanOptions& options) {
+  USERDB_TRACE_SCOPE();
+  if (options.backup_mode == BackupMode::kChunked) {
+    auto writer = std::make_unique<ChunkedBackupWriter>();
+    if (!writer->open(options.backup_repo, userdb_file)) {
+      return nullptr;
+    }
+    writer->set_drop_page_cache(options.drop_page_cache);
+    return writer;
+  }
+  auto writer = open_backup_writer(userdb_file);
+  if (writer) {
+    writer->set_drop_page_cache(options.drop_page_cache);
+  }
+  return writer;
+}
+
+/**
+ * 删除超出保留代数的旧备份，返回删除的数量
+ * 分块模式只删除清单，分块在本次清理结束后统一回收
+ */
+int rotate_timestamped_backups(const fs::path& userdb_file, const CleanOptions& options) {
+  USERDB_TRACE_SCOPE();
+  if (options.backup_mode == BackupMode::kChunked) {
+    return rotate_chunked_backups(options.backup_repo, userdb_file, options.backup_generations);
+  }
+  return rotate_backups(userdb_file, options.backup_generations);
+}
+
+/**
+ * 备份.userdb.txt文件为.userdb_backup.txt
+ * 压缩与分块模式下写入一代新的带时间戳备份，并删除超出保留代数的旧备份
+ */
+bool backup_userdb_file(const fs::path& userdb_file, const CleanOptions& options) {
+  USERDB_TRACE_SCOPE();
+  if (options.backup_mode != BackupMode::kCopy) {
+    auto backup = open_timestamped_backup(userdb_file, options);
+    InputBuffer input;
+    bool opened = input.open(userdb_file);
+    if (opened) {
+      input.advise_sequential(options.drop_page_cache);
+    }
+    if (!backup || !opened || !backup->write(input.view()) || !backup->commit()) {
+      CLEAN_LOG(kError, kBackup) << "Failed to write backup of " << userdb_file.string();
+      return false;
+    }
+    int removed = rotate_timestamped_backups(userdb_file, options);
+    CLEAN_LOG(kInfo, kBackup) << "Backed up " << userdb_file.filename().string() << " (removed " << removed << " old backups)";
+    return true;
+  }
+
+  try {
+    // 构造备份文件名
+    std::string filename = userdb_file.filename().string();
+    std::string backup_filename = filename;
+    size_t pos = backup_filename.find(".userdb.txt");
+    if (pos != std::string::npos) {
+      backup_filename.replace(pos, 11, ".userdb_backup.txt");
+    } else {
+      backup_filename += ".backup";
+    }
+    
+    fs::path backup_path = userdb_file.parent_path() / backup_filename;
+    
+    // 复制文件（覆盖模式）
+    fs::copy_file(userdb_file, backup_path, fs::copy_options::overwrite_existing);
+    if (options.drop_page_cache) {
+      drop_page_cache(backup_path);
+    }
+    
+    CLEAN_LOG(kInfo, kBackup) << "Backed up " << filename << " to " << backup_filename;
+    return true;
+  } catch (const fs::filesystem_error& e) {
+    CLEAN_LOG(kError, kBackup) << "Failed to backup file " << userdb_file.string() << ": " << e.what();
+    return false;
+  }
+}
+
+/**
+ * 记录删除的词条到日志文件
+ */
+void log_deleted_words(const StringList& deleted_words, const fs::path& sync_dir) {
+  USERDB_TRACE_SCOPE();
+  if (deleted_words.empty()) {
+    return;
+  }
+  
+  fs::path log_file = sync_dir / "userdb_cleaner.txt";
+  
+  try {
+    // 以追加模式打开文件，使用UTF-8编码（不带BOM）
+    std::ofstream out(log_file, std::ios::app);
+    if (!out.is_open()) {
+      CLEAN_LOG(kError, kGeneral) << "Failed to open log file: " << log_file.string();
+      return;
+    }
+    
+    // 写入当前时间
+    std::string current_time = get_current_time();
+    out << current_time << " Deleted words:\n";
+    
+    // 写入被删除的词条
+    for (const auto& word : deleted_words) {
+      out << "  - " << word << "\n";
+    }
+    
+    out << "\n"; // 添加空行分隔不同时间的记录
+    
+    out.close();
+    CLEAN_LOG(kInfo, kGeneral) << "Logged " << deleted_words.size() << " deleted words to " << log_file.string();
+  } catch (const std::exception& e) {
+    CLEAN_LOG(kError, kGeneral) << "Failed to write to log file: " << e.what();
+  }
+}
+
+std::unique_ptr<DeletedWordJournal> open_deleted_word_journal(const CleanOptions& options, const fs::path& sync_dir) {
+  if (!options.bounded_memory || !options.record_deleted_words) {
+    return nullptr;
+  }
+  return std::make_unique<DeletedWordJournal>(sync_dir / "userdb_cleaner.txt", get_current_time() + " Deleted words:",
+                                              options.temp_suffix);
+}
+
+void close_deleted_word_journal(DeletedWordJournal* journal) {
+  if (!journal) {
+    return;
+  }
+  if (!journal->close()) {
+    CLEAN_LOG(kError, kGeneral) << "Failed to write to log file: " << journal->path().string();
+  } else if (journal->count() > 0) {
+    CLEAN_LOG(kInfo, kGeneral) << "Logged " << journal->count() << " deleted words to " << journal->path().string();
+  }
+}
+
+void apply_bounded_memory(CleanOptions& options) {
+  if (!options.bounded_memory) {
+    return;
+  }
+  for (std::string_view name : restrict_to_bounded_memory(options)) {
+    CLEAN_LOG(kWarning, kGeneral) << "Bounded memory mode: " << name << " is disabled";
+  }
+}
+
+/**
+ * 检查是否需要清理指定的userdb
+ */
+bool should_clean_userdb(const std::string& db_name, const std::vector<std::string>& cleanup_list) {
+  // 如果清理列表为空，则清理所有
+  if (cleanup_list.empty()) {
+    return true;
+  }
+  
+  // 检查是否在清理列表中
+  for (const auto& allowed_db : cleanup_list) {
+    if (db_name == allowed_db) {
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+/**
+ * 从路径中提取userdb名称
+ */
+std::string extract_userdb_name(const fs::path& path) {
+  std::string filename = path.filename().string();
+  
+  // 处理 .userdb 文件夹
+  if (fs::is_directory(path)) {
+    const std::string suffix = ".userdb";
+    if (filename.length() > suffix.length() && 
+        filename.substr(filename.length() - suffix.length()) == suffix) {
+      return filename.substr(0, filename.length() - suffix.length());
+    }
+  }
+  
+  // 处理 .userdb.txt 文件
+  const std::string suffix = ".userdb.txt";
+  if (filename.length() > suffix.length() && 
+      filename.substr(filename.length() - suffix.length()) == suffix) {
+    return filename.substr(0, filename.length() - suffix.length());
+  }
+  
+  return filename; // 返回原始文件名
+}
+
+/**
+ * 获取目录下所有的 .userdb 文件夹（根据清理列表过滤）
+ */
+std::vector<fs::path> get_userdb_folders(const fs::path& dir, const std::vector<std::string>& cleanup_list, StringList& cleaned_folders) {
+  USERDB_TRACE_SCOPE();
+  std::vector<fs::path> result;
+  if (!fs::exists(dir)) {
+    CLEAN_LOG(kInfo, kDiscovery) << "No .userdb folders found in directory: " << dir.string();
+    return result;
+  }
+  if (!fs::is_directory(dir)) {
+    return result;
+  }
+  
+  int folder_count = 0;
+  int filtered_count = 0;
+  for (const auto& entry : fs::directory_iterator(dir)) {
+    try {
+      if (entry.is_directory()) {
+        const auto& path = entry.path();
+        const std::string folder_name = path.filename().string();
+        // 匹配以 .userdb 结尾的文件夹
+        const std::string suffix = ".userdb";
+        const size_t suffix_len = suffix.length();
+        const size_t name_len = folder_name.length();
+        if (name_len > suffix_len &&
+            folder_name.substr(name_len - suffix_len) == suffix) {
+          std::string db_name = extract_userdb_name(path);
+          if (should_clean_userdb(db_name, cleanup_list)) {
+            result.push_back(path);
+            // 去重添加，并添加后缀
+            std::string full_name = db_name + ".userdb";
+            cleaned_folders.push_unique(full_name);
+            folder_count++;
+            CLEAN_LOG(kVerbose, kDiscovery) << "Including folder in cleanup: " << folder_name << " (db_name: " << db_name << ")";
+          } else {
+            filtered_count++;
+            CLEAN_LOG(kVerbose, kDiscovery) << "Skipping folder (not in cleanup list): " << folder_name << " (db_name: " << db_name << ")";
+          }
+        }
+      }
+    } catch (const fs::filesystem_error& e) {
+      CLEAN_LOG(kError, kDiscovery) << "Failed to get .userdb folders. Error: " << e.what();
+    }
+  }
+  CLEAN_LOG(kInfo, kDiscovery) << "Found " << folder_count << " .userdb folders (" << filtered_count << " filtered out)";
+  return result;
+}
+
+/**
+ * 清理用户目录下的 .userdb 文件夹
+ */
+int clean_userdb_folders(const fs::path& user_data_dir, const std::vector<std::string>& cleanup_list,
+                         StringList& cleaned_folders, CleanMetrics& metrics) {
+  USERDB_TRACE_SCOPE();
+  CLEAN_LOG(kInfo, kPurge) << "Cleaning userdb folders in: " << user_data_dir.string();
+  CLEAN_LOG(kInfo, kPurge) << "Cleanup list size: " << cleanup_list.size();
+  if (!cleanup_list.empty()) {
+    CLEAN_LOG(kInfo, kPurge) << "Cleanup list contents:";
+    for (const auto& db : cleanup_list) {
+      CLEAN_LOG(kInfo, kPurge) << "  - " << db;
+    }
+  }
+  
+  std::vector<fs::path> folders;
+  {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kDiscovery);
+    folders = get_userdb_folders(user_data_dir, cleanup_list, cleaned_folders);
+  }
+  int deleted_files_count = 0;
+  
+  ScopedPhase phase(&metrics.phases, CleanPhase::kPurge);
+  // 先列出所有文件夹中的条目，再一起提交删除
+  std::vector<fs::path> entries;
+  FileOpBatch batch;
+  for (const auto& folder : folders) {
+    CLEAN_LOG(kInfo, kPurge) << "Processing folder: " << folder.string();
+    for (const auto& entry : fs::directory_iterator(folder)) {
+      std::error_code ec;
+      // 与 fs::remove 相同：目录（须为空）用 rmdir 删除，符号链接只删除链接本身
+      if (fs::is_directory(entry.symlink_status(ec))) {
+        batch.remove_directory(entry.path());
+      } else {
+        batch.unlink(entry.path());
+      }
+      entries.push_back(entry.path());
+    }
+  }
+  std::vector<std::error_code> results = batch.run();
+  for (size_t i = 0; i < entries.size(); ++i) {
+    // 已被其他进程删除的条目与 fs::remove 一样不视为失败
+    if (!results[i] || results[i] == std::errc::no_such_file_or_directory) {
+      deleted_files_count++;
+      CLEAN_LOG(kVerbose, kPurge) << "Deleted file: " << entries[i].string();
+    } else {
+      CLEAN_LOG(kError, kPurge) << "Failed to delete '" << entries[i].string() << "'. Error: " << results[i].message();
+    }
+  }
+  if (batch.used_io_uring()) {
+    CLEAN_LOG(kVerbose, kPurge) << "Deleted entries through io_uring";
+  }
+  
+  CLEAN_LOG(kInfo, kPurge) << "Cleaned " << deleted_files_count << " files from " << cleaned_folders.size() << " userdb folders";
+  return deleted_files_count;
+}
+
+/**
+ * 递归获取 sync 目录下所有子目录中的 .userdb.txt 文件（根据清理列表过滤）
+ */
+std::vector<fs::path> get_userdb_files(const fs::path& sync_path, const std::vector<std::string>& cleanup_list,
+                                       StringList& cleaned_files) {
+  USERDB_TRACE_SCOPE();
+  std::vector<fs::path> result;
+  CLEAN_LOG(kInfo, kDiscovery) << "Scanning for userdb files in: " << sync_path.string();
+
+  if (!fs::exists(sync_path) || !fs::is_directory(sync_path)) {
+    CLEAN_LOG(kError, kDiscovery) << "Sync directory does not exist: " << sync_path.string();
+    return result;
+  }
+
+  int file_count = 0;
+  int filtered_count = 0;
+  
+  // 递归遍历 sync 目录下的所有子目录
+  for (const auto& entry : fs::recursive_directory_iterator(sync_path)) {
+    try {
+      if (entry.is_regular_file()) {
+        const auto& path = entry.path();
+        const std::string file_name = path.filename().string();
+        // 匹配以 .userdb.txt 结尾的文件
+        const std::string suffix = ".userdb.txt";
+        const size_t suffix_len = suffix.length();
+        const size_t name_len = file_name.length();
+        if (name_len > suffix_len &&
+            file_name.substr(name_len - suffix_len) == suffix) {
+          std::string db_name = extract_userdb_name(path);
+          if (should_clean_userdb(db_name, cleanup_list)) {
+            result.push_back(path);
+            // 去重添加，并添加后缀
+            std::string full_name = db_name + ".userdb.txt";
+            cleaned_files.push_unique(full_name);
+            file_count++;
+            CLEAN_LOG(kVerbose, kDiscovery) << "Including file in cleanup: " << file_name << " (db_name: " << db_name << ")";
+          } else {
+            filtered_count++;
+            CLEAN_LOG(kVerbose, kDiscovery) << "Skipping file (not in cleanup list): " << file_name << " (db_name: " << db_name << ")";
+          }
+        }
+      }
+    } catch (const fs::filesystem_error& e) {
+      CLEAN_LOG(kError, kDiscovery) << "Failed to get .userdb.txt files. Error: " << e.what();
+    }
+  }
+  
+  CLEAN_LOG(kInfo, kDiscovery) << "Found " << file_count << " .userdb.txt files in sync directory and subdirectories (" << filtered_count << " filtered out)";
+  return result;
+}
+
+/**
+ * 按文件名把 sync 目录下各设备的 .userdb.txt 分组，保持发现顺序
+ */
+std::vector<std::vector<fs::path>> group_device_copies(const std::vector<fs::path>& files) {
+  std::vector<std::vector<fs::path>> groups;
+  std::map<std::string, size_t> index;
+  for (const auto& file : files) {
+    auto it = index.emplace(file.filename().string(), groups.size()).first;
+    if (it->second == groups.size()) {
+      groups.emplace_back();
+    }
+    groups[it->second].push_back(file);
+  }
+  return groups;
+}
+
+/**
+ * 把同一词典在各设备下的副本合并为本机设备目录下的一个文件
+ * 各副本备份后删除
+ * @return 合并过程中删除的无效词条数量，失败时返回 -1
+ */
+int consolidate_userdb_copies(const CleanOptions& options, const fs::path& local_dir, std::vector<fs::path>& copies,
+                              StringList& deleted_words, const TombstoneSet* tombstones,
+                              CleanMetrics& metrics, DurableCommit* commit) {
+  const std::string name = copies.front().filename().string();
+  USERDB_TRACE_SCOPE_DETAIL("consolidate_userdb_file", name);
+
+  // 副本取自 sync/<设备>/；本机设备目录不在同一 sync 目录下（installation_id 或 sync_dir 有误）时
+  // 合并会把词典移出 sync 目录并删除各副本，跳过
+  std::error_code ec;
+  fs::path sync_dir = copies.front().parent_path().parent_path();
+  fs::path local_parent = local_dir.has_filename() ? local_dir.parent_path() : local_dir.parent_path().parent_path();
+  if (!fs::equivalent(local_parent, sync_dir, ec)) {
+    CLEAN_LOG(kWarning, kFile) << "Skipping consolidation of " << name << ": local device directory "
+              << local_dir.string() << " is not under " << sync_dir.string();
+    return -1;
+  }
+
+  // 本机副本作为主输入，保留其文件头
+  for (size_t i = 1; i < copies.size(); ++i) {
+    if (fs::equivalent(copies[i].parent_path(), local_dir, ec)) {
+      std::swap(copies[0], copies[i]);
+      break;
+    }
+  }
+
+  {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kBackup);
+    for (const auto& copy : copies) {
+      if (!backup_userdb_file(copy, options)) {
+        CLEAN_LOG(kError, kFile) << "Failed to backup file: " << copy.string();
+        return -1;
+      }
+    }
+  }
+
+  try {
+    fs::create_directories(local_dir);
+    fs::path output = local_dir / name;
+    ScopedFileMetrics file_metrics(metrics, output);
+    std::string temp_file = output.string() + options.temp_suffix;
+
+    FileFilterStats stats;
+    {
+      ScopedPhase phase(&metrics.phases, CleanPhase::kFilter);
+      if (!merge_userdb_files(copies, temp_file, options, deleted_words, &stats, tombstones)) {
+        CLEAN_LOG(kError, kFile) << "Failed to merge device copies of " << name;
+        fs::remove(temp_file, ec);
+        return -1;
+      }
+    }
+
+    {
+      ScopedPhase rename_phase(&metrics.phases, CleanPhase::kRename);
+      // 其他设备的副本及其快照在合并结果替换本机副本之后删除；本机副本由改名直接替换
+      std::vector<fs::path> remove_after;
+      for (const auto& copy : copies) {
+        std::error_code ec;
+        if (!fs::equivalent(copy.parent_path(), local_dir, ec)) {
+          remove_after.push_back(copy);
+          remove_after.push_back(snapshot_path_for(copy));
+        }
+      }
+      // 改名保留修改时间与大小，快照直接由临时文件生成
+      fs::path output_snapshot = snapshot_path_for(output);
+      if (!options.binary_snapshot) {
+        remove_after.push_back(output_snapshot);
+      } else if (!build_snapshot(temp_file, output_snapshot, options.temp_suffix)) {
+        CLEAN_LOG(kWarning, kFile) << "Failed to write binary snapshot for " << output.string();
+      }
+      if (commit) {
+        commit->replace(temp_file, output, std::move(remove_after));
+      } else {
+        DurableCommit local_commit(options.durable_commit);
+        local_commit.replace(temp_file, output, std::move(remove_after));
+        if (!commit_replacements(local_commit).front().renamed) {
+          return -1;
+        }
+      }
+    }
+
+    file_metrics.succeed(stats);
+    int file_deleted_count = static_cast<int>(stats.lines_dropped);
+    CLEAN_LOG(kInfo, kFile) << "Consolidated " << copies.size() << " copies of " << name << " into " << output.string()
+              << ": deleted " << file_deleted_count << " invalid entries, merged " << stats.lines_merged << " duplicate entries";
+    return file_deleted_count;
+  } catch (const fs::filesystem_error& e) {
+    CLEAN_LOG(kError, kFile) << "Failed to consolidate " << name << ": " << e.what();
+    return -1;
+  }
+}
+
+/**
+ * 合并 sync 目录下各设备的同名 .userdb.txt 为一个文件
+ * 合并结果写入本机设备目录，其他设备下的副本在备份后删除，
+ * 合并完成的文件会从 files 中移除，其余文件仍按单个文件清理
+ * @param commit 合并结果登记在其中，由调用方统一提交
+ * @param staged 各合并结果删除的词条与数量，按合并顺序追加
+ */
+void consolidate_userdb_files(const CleanOptions& options, const fs::path& local_dir, std::vector<fs::path>& files,
+                              std::vector<StagedDeletions>& staged, const DictionaryTombstones* tombstones,
+                              CleanMetrics& metrics, DurableCommit* commit) {
+  USERDB_TRACE_SCOPE();
+  std::vector<fs::path> consolidated;
+  for (auto& copies : group_device_copies(files)) {
+    if (copies.size() < 2) {
+      continue;
+    }
+    const TombstoneSet* dictionary_tombstones = tombstones ? tombstones->find(copies.front()) : nullptr;
+    StagedDeletions deletions;
+    deletions.target = local_dir / copies.front().filename();
+    deletions.count = consolidate_userdb_copies(options, local_dir, copies, deletions.words, dictionary_tombstones,
+                                                metrics, commit);
+    if (deletions.count >= 0) {
+      consolidated.insert(consolidated.end(), copies.begin(), copies.end());
+      staged.push_back(std::move(deletions));
+    }
+  }
+
+  files.erase(std::remove_if(files.begin(), files.end(), [&](const fs::path& file) {
+    return std::find(consolidated.begin(), consolidated.end(), file) != consolidated.end();
+  }), files.end());
+}
+
+/**
+ * 按词典收集所有文件中被删除（c <= 0）的词条键及删除时的 t
+ * @param max_threads 并行读取的线程数，0 表示按硬件并发数
+ */
+DictionaryTombstones collect_tombstones(const std::vector<fs::path>& files, size_t max_threads) {
+  USERDB_TRACE_SCOPE();
+  std::vector<TombstoneSet> partial(files.size());
+  parallel_for(files.size(), [&](size_t i) {
+    USERDB_TRACE_SCOPE_DETAIL("collect_tombstones_task",
+                              files[i].parent_path().filename().string() + "/" + files[i].filename().string());
+    InputBuffer buffer;
+    if (buffer.open(files[i])) {
+      // 随后清理时还会读取，不丢弃
+      buffer.advise_sequential();
+      partial[i].collect(buffer.view());
+    } else {
+      CLEAN_LOG(kError, kFile) << "Failed to open file: " << files[i].string();
+    }
+  }, max_threads);
+
+  DictionaryTombstones tombstones;
+  for (size_t i = 0; i < files.size(); ++i) {
+    tombstones[files[i]].merge(partial[i]);
+  }
+  CLEAN_LOG(kInfo, kFile) << "Collected " << tombstones.size() << " deleted entries from " << files.size() << " userdb files";
+  return tombstones;
+}
+
+/**
+ * 清理单个 .userdb.txt 文件：备份后过滤无效词条，再替换原文件
+ * @return 删除的无效词条数量，失败时返回 -1
+ */
+int clean_userdb_file(const fs::path& file, const CleanOptions& options, StringList& deleted_words,
+                      const TombstoneSet* tombstones, CleanMetrics& metrics, DeletedWordJournal* journal,
+                      DurableCommit* commit) {
+  USERDB_TRACE_SCOPE_DETAIL(__func__, file.parent_path().filename().string() + "/" + file.filename().string());
+  CLEAN_LOG(kInfo, kFile) << "Processing file: " << file.string();
+  ScopedFileMetrics file_metrics(metrics, file);
+
+  // 快照与文本一致时直接读取快照判断，没有需要清理的词条就跳过重写
+  fs::path snapshot_path = snapshot_path_for(file);
+  if (options.binary_snapshot) {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kFilter);
+    SnapshotView snapshot;
+    if (snapshot.open(snapshot_path) && snapshot.is_fresh(file) &&
+        !snapshot_needs_clean(snapshot, options, tombstones)) {
+      CLEAN_LOG(kInfo, kFile) << "File " << file.filename().string() << ": binary snapshot is up to date, nothing to clean";
+      file_metrics.skip();
+      return 0;
+    }
+  }
+
+  // 备份文件：复制模式先整体复制；压缩与分块模式在过滤的同时流式写入
+  std::unique_ptr<BackupWriter> backup;
+  {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kBackup);
+    if (options.backup_mode != BackupMode::kCopy) {
+      backup = open_timestamped_backup(file, options);
+      if (!backup) {
+        CLEAN_LOG(kError, kFile) << "Failed to create backup for file: " << file.string();
+        return -1;
+      }
+    } else if (!backup_userdb_file(file, options)) {
+      CLEAN_LOG(kError, kFile) << "Failed to backup file: " << file.string();
+      // 继续处理，但不记录删除的词条
+      return -1;
+    }
+  }
+
+  // 不存在时 is_regular_file 同样为 false，只需一次 stat
+  if (!fs::is_regular_file(file)) {
+    return -1;
+  }
+
+  std::string temp_file = file.string() + options.temp_suffix;
+  // 登记替换之前失败（含异常）时删除写了一半的临时文件，磁盘写满时尤其不能留下；暂存的删除词条一并丢弃
+  auto abandon = [&]() {
+    std::error_code ec;
+    fs::remove(temp_file, ec);
+    if (journal) {
+      journal->discard(file);
+    }
+    return -1;
+  };
+
+  // 把 c > 0 的行写入新文件，按配置记录删除的词条并合并重复词条
+  FileFilterStats stats;
+  try {
+    {
+      ScopedPhase phase(&metrics.phases, CleanPhase::kFilter);
+      bool filtered = options.bounded_memory
+                          ? filter_userdb_file_bounded(file, temp_file, options, journal, &stats, backup.get())
+                          : filter_userdb_file(file, temp_file, options, deleted_words, &stats, tombstones, backup.get());
+      if (!filtered) {
+        CLEAN_LOG(kError, kFile) << "Failed to filter file: " << file.string();
+        return abandon();
+      }
+    }
+    // 备份落盘成功后才替换原文件
+    if (backup) {
+      ScopedPhase phase(&metrics.phases, CleanPhase::kBackup);
+      if (!backup->commit()) {
+        CLEAN_LOG(kError, kFile) << "Failed to backup file: " << file.string();
+        return abandon();
+      }
+      rotate_timestamped_backups(file, options);
+    }
+  } catch (...) {
+    abandon();
+    throw;
+  }
+  int file_deleted_count = static_cast<int>(stats.lines_dropped);
+
+  {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kRename);
+    // 改名保留修改时间与大小，快照直接由临时文件生成；替换失败时快照与原文件不符，下次不会被采用
+    if (options.binary_snapshot && !build_snapshot(temp_file, snapshot_path, options.temp_suffix)) {
+      CLEAN_LOG(kWarning, kFile) << "Failed to write binary snapshot for " << file.string();
+    }
+    if (commit) {
+      commit->replace(temp_file, file);
+    } else {
+      DurableCommit local_commit(options.durable_commit);
+      local_commit.replace(temp_file, file);
+      if (!commit_replacements(local_commit, journal).front().renamed) {
+        return -1;
+      }
+    }
+  }
+
+  file_metrics.succeed(stats);
+  CLEAN_LOG(kInfo, kFile) << "File " << file.filename().string() << ": deleted " << file_deleted_count << " invalid entries";
+  if (stats.lines_merged > 0) {
+    CLEAN_LOG(kInfo, kFile) << "File " << file.filename().string() << ": merged " << stats.lines_merged << " duplicate entries";
+  }
+  if (stats.lines_oversized > 0) {
+    CLEAN_LOG(kWarning, kFile) << "File " << file.filename().string() << ": kept " << stats.lines_oversized
+              << " oversized lines unchecked";
+  }
+  return file_deleted_count;
+}
+
+std::vector<DurableCommit::Result> commit_replacements(DurableCommit& commit, DeletedWordJournal* journal,
+                                                       std::set<fs::path>* replaced) {
+  USERDB_TRACE_SCOPE();
+  std::vector<DurableCommit::Result> results = commit.commit();
+  for (const auto& result : results) {
+    if (!result.renamed) {
+      CLEAN_LOG(kError, kFile) << "Failed to replace " << result.target.string() << ": " << result.error.message();
+    } else if (result.error) {
+      CLEAN_LOG(kError, kFile) << "Replaced " << result.target.string() << " but failed to sync its directory: "
+                << result.error.message();
+    }
+    if (journal) {
+      if (result.renamed) {
+        journal->publish(result.target);
+      } else {
+        journal->discard(result.target);
+      }
+    }
+    if (replaced && result.renamed) {
+      replaced->insert(result.target);
+    }
+  }
+  return results;
+}
+
+int settle_staged_deletions(const std::vector<StagedDeletions>& staged, const std::set<fs::path>& replaced,
+                            StringList& deleted_words) {
+  int delete_item_count = 0;
+  for (const auto& deletions : staged) {
+    if (deletions.count < 0 || replaced.count(deletions.target) == 0) {
+      continue;
+    }
+    delete_item_count += deletions.count;
+    deleted_words.append(deletions.words);
+  }
+  return delete_item_count;
+}
+
+void collect_backup_garbage(const CleanOptions& options) {
+  if (options.backup_mode != BackupMode::kChunked) {
+    return;
+  }
+  auto gc = collect_chunk_garbage(options.backup_repo);
+  CLEAN_LOG(kInfo, kBackup) << "Backup repository " << options.backup_repo << ": " << gc.chunks_kept << " chunks kept, "
+            << gc.chunks_removed << " removed (" << gc.bytes_removed << " bytes)";
+}
+
+/**
+ * 清理用户目录 sync 下的 .userdb 文件
+ * @return 总共清理的无效词条数量
+ */
+int clean_userdb_files(const CleanOptions& options, const CleanContext& context, StringList& cleaned_files,
+                       StringList& deleted_words, CleanMetrics& metrics) {
+  USERDB_TRACE_SCOPE();
+  std::vector<fs::path> files;
+  {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kDiscovery);
+    files = get_userdb_files(context.sync_dir, options.cleanup_list, cleaned_files);
+  }
+  int delete_item_count = 0;
+
+  // 第一阶段：按词典收集所有设备上已删除的词条，第二阶段从同一词典的每个副本中删除它们
+  std::unique_ptr<DictionaryTombstones> tombstones;
+  if (options.propagate_deletions && !files.empty()) {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kFilter);
+    metrics.use_threads(parallel_for_threads(files.size()));
+    tombstones = std::make_unique<DictionaryTombstones>(collect_tombstones(files));
+  }
+
+  // 各文件写完后只登记替换，全部写完再一起同步、改名；删除的词条按目标文件暂存，提交后才计入
+  DurableCommit commit(options.durable_commit);
+  std::unique_ptr<DeletedWordJournal> journal;
+  std::vector<StagedDeletions> staged;
+
+  // 先合并各设备的同名副本，剩余文件逐个清理
+  if (options.consolidate_devices && !cancel_requested(context)) {
+    consolidate_userdb_files(options, context.local_sync_dir, files, staged, tombstones.get(), metrics, &commit);
+  }
+  
+  size_t first_file = staged.size();
+  staged.resize(first_file + files.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    staged[first_file + i].target = files[i];
+  }
+  if (tombstones) {
+    // 各文件互不依赖，并行清理；删除的词条按文件顺序汇总
+    metrics.use_threads(parallel_for_threads(files.size()));
+    parallel_for(files.size(), [&](size_t i) {
+      USERDB_TRACE_SCOPE_NAMED("clean_userdb_files_task");
+      if (cancel_requested(context)) {
+        return;
+      }
+      StagedDeletions& deletions = staged[first_file + i];
+      // 异常不能越出 parallel_for：插件在分离的线程中清理，越出后整个输入法退出
+      try {
+        deletions.count = clean_userdb_file(files[i], options, deletions.words, tombstones->find(files[i]), metrics,
+                                            nullptr, &commit);
+      } catch (const std::exception& e) {
+        CLEAN_LOG(kError, kFile) << "Failed to clean file " << files[i].string() << ": " << e.what();
+      }
+    });
+  } else {
+    journal = open_deleted_word_journal(options, context.sync_dir);
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (cancel_requested(context)) {
+        break;
+      }
+      StagedDeletions& deletions = staged[first_file + i];
+      try {
+        deletions.count = clean_userdb_file(files[i], options, deletions.words, nullptr, metrics, journal.get(), &commit);
+      } catch (const std::exception& e) {
+        CLEAN_LOG(kError, kFile) << "Failed to clean file " << files[i].string() << ": " << e.what();
+      }
+    }
+  }
+
+  // 取消时已写完的文件同样提交，不留下临时文件；只有确实被替换的文件删除的词条与数量才计入结果与日志
+  std::set<fs::path> replaced;
+  {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kRename);
+    commit_replacements(commit, journal.get(), &replaced);
+  }
+  close_deleted_word_journal(journal.get());
+  delete_item_count += settle_staged_deletions(staged, replaced, deleted_words);
+  
+  // 所有备份写完后回收不再被任何清单引用的分块
+  if (options.backup_mode == BackupMode::kChunked) {
+    ScopedPhase phase(&metrics.phases, CleanPhase::kBackup);
+    collect_backup_garbage(options);
+  }
+
+  // 在日志中打印删除的词条详情
+  ScopedPhase phase(&metrics.phases, CleanPhase::kSummary);
+  if (!deleted_words.empty()) {
+    CLEAN_LOG(kVerbose, kDeletedWord) << "Deleted words (" << deleted_words.size() << " items):";
+    for (const auto& word : deleted_words) {
+      CLEAN_LOG(kVerbose, kDeletedWord) << "  - " << word;
+    }
+  }
+  
+  CLEAN_LOG(kInfo, kGeneral) << "Total deleted invalid entries from userdb files: " << delete_item_count;
+  return delete_item_count;
+}
+
+CleanResult run_clean_task(const CleanOptions& requested_options, const CleanContext& context,
+                           CleanMetrics* external_metrics) {
+  CleanOptions options = requested_options;
+  auto start_time = std::chrono::steady_clock::now();
+  TraceRecorder& trace = TraceRecorder::instance();
+  if (options.trace) {
+    trace.start();
+  }
+  CleanMetrics local_metrics;
+  CleanMetrics& metrics = external_metrics ? *external_metrics : local_metrics;
+  CleanResult result;
+  // 离开作用域时先写完排队的日志，再结束 task_span
+  {
+    TraceSpan task_span(__func__);
+    CleanLogger& logger = clean_logger();
+    logger.set_verbose(options.log_verbose);
+    logger.set_rate_limit(options.log_rate_limit);
+    ScopedAsyncLog async_log(logger);
+    const auto& cleanup_list = options.cleanup_list;
+    CLEAN_LOG(kInfo, kGeneral) << "Starting userdb cleaning task...";
+    CLEAN_LOG(kInfo, kGeneral) << "Cleanup list contains " << cleanup_list.size() << " items";
+    if (!cleanup_list.empty()) {
+      CLEAN_LOG(kInfo, kGeneral) << "Cleanup list:";
+      for (const auto& db : cleanup_list) {
+        CLEAN_LOG(kInfo, kGeneral) << "  - " << db;
+      }
+    }
+    CLEAN_LOG(kInfo, kGeneral) << "Full information display: " << options.full_information_display;
+    apply_bounded_memory(options);
+
+    // 清理前先执行 sync
+    if (context.sync) {
+      CLEAN_LOG(kInfo, kGeneral) << "Executing pre-clean deployment...";
+      ScopedPhase phase(&metrics.phases, CleanPhase::kDeployer);
+      context.sync();
+    }
+
+    result.folder_files_deleted = clean_userdb_folders(context.user_data_dir, cleanup_list, result.cleaned_folders,
+                                                       metrics);
+    result.deleted_count = clean_userdb_files(options, context, result.cleaned_files, result.deleted_words, metrics);
+    result.cancelled = cancel_requested(context);
+    if (result.cancelled) {
+      CLEAN_LOG(kWarning, kGeneral) << "Cleaning task cancelled, remaining files were left untouched";
+    }
+
+    // 记录删除的词条到日志文件
+    {
+      ScopedPhase phase(&metrics.phases, CleanPhase::kJournal);
+      log_deleted_words(result.deleted_words, context.sync_dir);
+    }
+
+    // 清理后执行 sync
+    if (context.sync) {
+      CLEAN_LOG(kInfo, kGeneral) << "Executing post-clean deployment...";
+      ScopedPhase phase(&metrics.phases, CleanPhase::kDeployer);
+      context.sync();
+    }
+
+    {
+      ScopedPhase phase(&metrics.phases, CleanPhase::kSummary);
+      CLEAN_LOG(kInfo, kGeneral) << "Userdb cleaning completed. Total deleted entries: " << result.deleted_count;
+      CLEAN_LOG(kInfo, kGeneral) << "Cleaned folders: " << result.cleaned_folders.size();
+      CLEAN_LOG(kInfo, kGeneral) << "Cleaned files: " << result.cleaned_files.size();
+      CLEAN_LOG(kInfo, kGeneral) << "Deleted words: " << result.deleted_words.size();
+    }
+
+    // 本次清理的指标以一行 JSON 追加到 userdb_cleaner_metrics.jsonl
+    metrics.set_folder_files_deleted(result.folder_files_deleted);
+    metrics.set_total_nanos(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_time).count()));
+    if (options.record_metrics) {
+      fs::path metrics_file = context.sync_dir / "userdb_cleaner_metrics.jsonl";
+      if (!append_metrics_line(metrics_file, metrics.to_json(options, get_current_time()))) {
+        CLEAN_LOG(kError, kGeneral) << "Failed to write metrics to " << metrics_file.string();
+      }
+    }
+  }
+
+  // 日志写完后再写出 Chrome trace-event JSON，可在 Perfetto 中打开
+  if (options.trace) {
+    trace.stop();
+    fs::path trace_file = context.sync_dir / "userdb_cleaner_trace.json";
+    if (trace.write_json(trace_file)) {
+      CLEAN_LOG(kInfo, kGeneral) << "Wrote " << trace.size() << " trace events to " << trace_file.string();
+    } else {
+      CLEAN_LOG(kError, kGeneral) << "Failed to write trace to " << trace_file.string();
+    }
+  }
+  return result;
+}
+
+}  // namespace userdb
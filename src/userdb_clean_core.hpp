@@ -0,0 +1,168 @@
+#ifndef USERDB_CLEAN_CORE_HPP_
+#define USERDB_CLEAN_CORE_HPP_
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "lib/bounded_filter.hpp"
+#include "lib/clean_logger.hpp"
+#include "lib/clean_metrics.hpp"
+#include "lib/clean_options.hpp"
+#include "lib/durable_commit.hpp"
+#include "lib/string_arena.hpp"
+#include "lib/tombstone_set.hpp"
+
+namespace userdb {
+
+// 清理任务所需的目录与宿主提供的回调，插件从 rime API 获取，命令行工具由参数指定
+struct CleanContext {
+  std::filesystem::path user_data_dir;   // 含 <dict>.userdb 文件夹的用户目录
+  std::filesystem::path sync_dir;        // 含各设备子目录的 sync 目录
+  std::filesystem::path local_sync_dir;  // 本机设备在 sync 目录下的子目录，合并副本时写入此处
+  std::function<void()> sync;            // 清理前后各调用一次（Windows 下为 WeaselDeployer /sync），可为空
+  const std::atomic<bool>* cancelled = nullptr;  // 非空且置位后不再开始清理新的文件，可为空
+};
+
+inline bool cancel_requested(const CleanContext& context) {
+  return context.cancelled && context.cancelled->load(std::memory_order_relaxed);
+}
+
+// 一次清理任务的结果，供宿主通知用户
+struct CleanResult {
+  int deleted_count = 0;                     // 删除的无效词条总数
+  int folder_files_deleted = 0;              // 从 .userdb 文件夹中删除的文件数
+  StringList cleaned_folders;                // 清理的 <dict>.userdb 文件夹
+  StringList cleaned_files;                  // 清理的 <dict>.userdb.txt 文件
+  StringList deleted_words;                  // 删除的词条
+  bool cancelled = false;                    // 清理中途被取消，部分文件未清理
+};
+
+/**
+ * 清理路径共用的日志，默认写到 stderr，插件启动时改为写入 glog
+ */
+CleanLogger& clean_logger();
+
+/**
+ * 执行一次完整的清理任务：清空 .userdb 文件夹、清理 sync 目录下的 .userdb.txt、
+ * 记录删除的词条，并按配置写出指标与 trace
+ * @param metrics 非空时把本次的指标写入其中
+ */
+CleanResult run_clean_task(const CleanOptions& options, const CleanContext& context,
+                           CleanMetrics* metrics = nullptr);
+
+// 以下为清理流程的单个步骤：run_clean_task 依次调用，批量模式按租户分别调度
+
+/**
+ * 当前时间，如 2024-01-31 23:59:59
+ */
+std::string get_current_time();
+
+/**
+ * 清空用户目录下（按清理列表过滤的）.userdb 文件夹
+ * @return 删除的文件数
+ */
+int clean_userdb_folders(const std::filesystem::path& user_data_dir, const std::vector<std::string>& cleanup_list,
+                         StringList& cleaned_folders, CleanMetrics& metrics);
+
+/**
+ * 递归查找 sync 目录下（按清理列表过滤的）.userdb.txt 文件
+ */
+std::vector<std::filesystem::path> get_userdb_files(const std::filesystem::path& sync_path,
+                                                    const std::vector<std::string>& cleanup_list,
+                                                    StringList& cleaned_files);
+
+/**
+ * 按词典收集所有文件中被删除（c <= 0）的词条键及删除时的 t
+ * @param max_threads 并行读取的线程数，0 表示按硬件并发数
+ */
+DictionaryTombstones collect_tombstones(const std::vector<std::filesystem::path>& files, size_t max_threads = 0);
+
+/**
+ * 按文件名把各设备的 .userdb.txt 分组，保持发现顺序
+ */
+std::vector<std::vector<std::filesystem::path>> group_device_copies(const std::vector<std::filesystem::path>& files);
+
+/**
+ * 把同一词典在各设备下的副本合并为 local_dir 下的一个文件，各副本备份后删除
+ * local_dir 须是副本所在 sync 目录的直接子目录，否则不合并并返回 -1
+ * @param commit 非空时合并结果只登记在其中，由调用方统一提交；为空时立即提交
+ * @return 删除的无效词条数量，失败时返回 -1
+ */
+int consolidate_userdb_copies(const CleanOptions& options, const std::filesystem::path& local_dir,
+                              std::vector<std::filesystem::path>& copies, StringList& deleted_words,
+                              const TombstoneSet* tombstones, CleanMetrics& metrics,
+                              DurableCommit* commit = nullptr);
+
+/**
+ * 清理单个 .userdb.txt：备份后过滤无效词条，再替换原文件
+ * @param journal 固定内存模式下删除的词条写入其暂存文件，不追加到 deleted_words；
+ *                替换成功后才进入日志（commit 非空时由调用方以 commit_replacements 提交）
+ * @param commit 非空时新文件只登记在其中，由调用方统一提交；为空时立即提交
+ * @return 删除的无效词条数量，失败时返回 -1
+ */
+int clean_userdb_file(const std::filesystem::path& file, const CleanOptions& options,
+                      StringList& deleted_words, const TombstoneSet* tombstones, CleanMetrics& metrics,
+                      DeletedWordJournal* journal = nullptr, DurableCommit* commit = nullptr);
+
+/**
+ * 提交登记的全部替换（同步、改名、同步目录），失败的逐个记录日志；调用方负责计入 rename 阶段
+ * @param journal 非空时已改名的文件暂存的删除词条写入日志（目录同步失败也已替换），未改名的丢弃
+ * @param replaced 非空时加入已改名的目标文件
+ * @return 与登记顺序对应的提交结果
+ */
+std::vector<DurableCommit::Result> commit_replacements(DurableCommit& commit, DeletedWordJournal* journal = nullptr,
+                                                       std::set<std::filesystem::path>* replaced = nullptr);
+
+// 一个文件清理后登记替换时删除的词条与数量；替换提交之前不计入结果
+struct StagedDeletions {
+  std::filesystem::path target;  // 登记替换的目标文件
+  int count = -1;                // 删除的词条数量，清理失败时为 -1
+  StringList words;
+};
+
+/**
+ * 把目标文件已被替换的暂存结果按顺序计入 deleted_words；清理失败或未替换的文件内容未变，不计入
+ * @param replaced commit_replacements 收集的已改名的目标文件
+ * @return 计入的删除词条数量
+ */
+int settle_staged_deletions(const std::vector<StagedDeletions>& staged,
+                            const std::set<std::filesystem::path>& replaced, StringList& deleted_words);
+
+/**
+ * 回收分块备份仓库中不再被引用的分块（chunked 模式）
+ */
+void collect_backup_garbage(const CleanOptions& options);
+
+/**
+ * 把删除的词条追加到 sync 目录下的 userdb_cleaner.txt
+ */
+void log_deleted_words(const StringList& deleted_words, const std::filesystem::path& sync_dir);
+
+/**
+ * 固定内存模式下流式写入 userdb_cleaner.txt 的日志；未启用该模式或不记录词条时返回空
+ */
+std::unique_ptr<DeletedWordJournal> open_deleted_word_journal(const CleanOptions& options,
+                                                              const std::filesystem::path& sync_dir);
+
+/**
+ * 关闭流式日志并记录写入结果；journal 可以为空
+ */
+void close_deleted_word_journal(DeletedWordJournal* journal);
+
+/**
+ * 按固定内存模式调整配置，并记录被关闭的配置项
+ */
+void apply_bounded_memory(CleanOptions& options);
+
+}  // namespace userdb
+
+// 被限速或未启用的消息不做格式化
+#define CLEAN_LOG(level, category) \
+  USERDB_LOG(::userdb::clean_logger(), ::userdb::LogLevel::level, ::userdb::LogCategory::category)
+
+#endif
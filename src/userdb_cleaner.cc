@@ -7,23 +7,29 @@
 #include <rime/schema.h>
 #include <rime_api.h>
 
-#if defined(_WIN32) || defined(_WIN64)
+#include <algorithm>
 #include <charconv>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
-#include <windows.h>
 #include <vector>
+#include <map>
+#include <memory>
 #include <cstdlib>  // 用于 system 函数
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
 #endif
 
 #include "lib/detached_thread_manager.hpp"
+#include "lib/trace.hpp"
+#include "userdb_clean_core.hpp"
 #include "userdb_cleaner.hpp"
+#include "userdb_daemon.hpp"
 
 namespace fs = std::filesystem;
 
@@ -39,6 +45,7 @@ UserdbCleaner::~UserdbCleaner() {
 }
 
 void UserdbCleaner::InitializeConfig() {
+  USERDB_TRACE_SCOPE();
   if (!engine_) {
     LOG(ERROR) << "Engine is null in UserdbCleaner";
     return;
@@ -65,26 +72,131 @@ void UserdbCleaner::InitializeConfig() {
 
   // 读取需要清理的userdb列表
   if (auto list = config->GetList("userdb_cleaner/cleanup_userdb_list")) {
-    cleanup_userdb_list_.clear();
+    clean_options_.cleanup_list.clear();
     for (size_t i = 0; i < list->size(); ++i) {
       if (auto item = list->GetValueAt(i)) {
         std::string db_name;
         if (item->GetString(&db_name)) {
-          cleanup_userdb_list_.push_back(db_name);
+          clean_options_.cleanup_list.push_back(db_name);
           LOG(INFO) << "Added to cleanup list: " << db_name;
         }
       }
     }
-    LOG(INFO) << "Cleanup userdb list has " << cleanup_userdb_list_.size() << " items";
+    LOG(INFO) << "Cleanup userdb list has " << clean_options_.cleanup_list.size() << " items";
   } else {
     LOG(INFO) << "No cleanup_userdb_list specified, will clean all userdb files";
   }
 
   // 读取是否显示完整信息的配置
-  if (!config->GetBool("userdb_cleaner/full_information_display", &full_information_display_)) {
-    LOG(INFO) << "userdb_cleaner/full_information_display not set, using default: " << full_information_display_;
+  if (!config->GetBool("userdb_cleaner/full_information_display", &clean_options_.full_information_display)) {
+    LOG(INFO) << "userdb_cleaner/full_information_display not set, using default: " << clean_options_.full_information_display;
+  } else {
+    LOG(INFO) << "UserdbCleaner full_information_display: " << clean_options_.full_information_display;
+  }
+
+  // 读取是否记录被删除词条的配置（关闭后不写入 userdb_cleaner.txt，清理走更快的路径）
+  if (!config->GetBool("userdb_cleaner/record_deleted_words", &clean_options_.record_deleted_words)) {
+    LOG(INFO) << "userdb_cleaner/record_deleted_words not set, using default: " << clean_options_.record_deleted_words;
   } else {
-    LOG(INFO) << "UserdbCleaner full_information_display: " << full_information_display_;
+    LOG(INFO) << "UserdbCleaner record_deleted_words: " << clean_options_.record_deleted_words;
+  }
+
+  // 读取重复词条的合并规则（none / max_c / max_t / sum_c）
+  std::string merge_rule;
+  if (config->GetString("userdb_cleaner/merge_duplicates", &merge_rule)) {
+    if (userdb::parse_merge_rule(merge_rule, &clean_options_.merge_rule)) {
+      LOG(INFO) << "UserdbCleaner merge_duplicates: " << merge_rule;
+    } else {
+      LOG(WARNING) << "Unknown userdb_cleaner/merge_duplicates: " << merge_rule << ", duplicates will be kept";
+    }
+  }
+
+  // 读取是否合并各设备副本的配置
+  if (config->GetBool("userdb_cleaner/consolidate_devices", &clean_options_.consolidate_devices)) {
+    LOG(INFO) << "UserdbCleaner consolidate_devices: " << clean_options_.consolidate_devices;
+  }
+
+  // 读取是否在各设备间传播删除的配置
+  if (config->GetBool("userdb_cleaner/propagate_deletions", &clean_options_.propagate_deletions)) {
+    LOG(INFO) << "UserdbCleaner propagate_deletions: " << clean_options_.propagate_deletions;
+  }
+
+  // 读取长期未使用词条的剪除阈值（以文件头中的 tick 为基准）
+  int prune_idle_ticks = 0;
+  if (config->GetInt("userdb_cleaner/prune_idle_ticks", &prune_idle_ticks) && prune_idle_ticks > 0) {
+    clean_options_.prune_idle_ticks = static_cast<uint64_t>(prune_idle_ticks);
+    LOG(INFO) << "UserdbCleaner prune_idle_ticks: " << prune_idle_ticks;
+  }
+
+  // 读取是否维护二进制快照的配置
+  if (config->GetBool("userdb_cleaner/binary_snapshot", &clean_options_.binary_snapshot)) {
+    LOG(INFO) << "UserdbCleaner binary_snapshot: " << clean_options_.binary_snapshot;
+  }
+
+  // 读取是否以固定内存清理
+  if (config->GetBool("userdb_cleaner/bounded_memory", &clean_options_.bounded_memory)) {
+    LOG(INFO) << "UserdbCleaner bounded_memory: " << clean_options_.bounded_memory;
+  }
+
+  // 读取替换原文件前是否同步到磁盘
+  if (config->GetBool("userdb_cleaner/durable_commit", &clean_options_.durable_commit)) {
+    LOG(INFO) << "UserdbCleaner durable_commit: " << clean_options_.durable_commit;
+  }
+
+  // 读取是否把清理读写过的文件从页缓存中丢弃
+  if (config->GetBool("userdb_cleaner/drop_page_cache", &clean_options_.drop_page_cache)) {
+    LOG(INFO) << "UserdbCleaner drop_page_cache: " << clean_options_.drop_page_cache;
+  }
+
+  // 读取备份方式与保留代数
+  std::string backup_mode;
+  if (config->GetString("userdb_cleaner/backup_mode", &backup_mode)) {
+    if (userdb::parse_backup_mode(backup_mode, &clean_options_.backup_mode)) {
+      LOG(INFO) << "UserdbCleaner backup_mode: " << backup_mode;
+    } else {
+      LOG(WARNING) << "Unknown userdb_cleaner/backup_mode: " << backup_mode << ", using copy";
+    }
+  }
+  if (config->GetInt("userdb_cleaner/backup_generations", &clean_options_.backup_generations)) {
+    LOG(INFO) << "UserdbCleaner backup_generations: " << clean_options_.backup_generations;
+  }
+  // 分块备份仓库默认位于用户目录下，不随 sync 目录同步
+  if (!config->GetString("userdb_cleaner/backup_repo", &clean_options_.backup_repo) ||
+      clean_options_.backup_repo.empty()) {
+    char user_data_dir[1024] = {0};
+    rime_get_api()->get_user_data_dir_s(user_data_dir, sizeof(user_data_dir));
+    clean_options_.backup_repo = (fs::path(user_data_dir) / "userdb_backups").string();
+  }
+  if (clean_options_.backup_mode == userdb::BackupMode::kChunked) {
+    LOG(INFO) << "UserdbCleaner backup_repo: " << clean_options_.backup_repo;
+  }
+
+  // 读取是否记录每次清理的指标
+  if (config->GetBool("userdb_cleaner/record_metrics", &clean_options_.record_metrics)) {
+    LOG(INFO) << "UserdbCleaner record_metrics: " << clean_options_.record_metrics;
+  }
+
+  // 读取是否导出 trace
+  if (config->GetBool("userdb_cleaner/trace", &clean_options_.trace)) {
+    LOG(INFO) << "UserdbCleaner trace: " << clean_options_.trace;
+  }
+
+  // 读取清理日志的明细开关与限速
+  if (config->GetBool("userdb_cleaner/log_verbose", &clean_options_.log_verbose)) {
+    LOG(INFO) << "UserdbCleaner log_verbose: " << clean_options_.log_verbose;
+  }
+  if (config->GetInt("userdb_cleaner/log_rate_limit", &clean_options_.log_rate_limit)) {
+    LOG(INFO) << "UserdbCleaner log_rate_limit: " << clean_options_.log_rate_limit;
+  }
+
+  // 读取清理守护进程的套接字（设置后插件只提交任务，由守护进程统一执行）
+  if (config->GetString("userdb_cleaner/daemon_socket", &daemon_socket_) && !daemon_socket_.empty()) {
+#if defined(_WIN32) || defined(_WIN64)
+    LOG(WARNING) << "userdb_cleaner/daemon_socket is not supported on Windows, cleaning in process";
+    daemon_socket_.clear();
+#else
+    LOG(INFO) << "UserdbCleaner daemon_socket: " << daemon_socket_;
+#endif
   }
 }
 
@@ -93,6 +205,7 @@ void UserdbCleaner::InitializeConfig() {
  * 执行 WeaselDeployer 命令（无窗口模式）
  */
 bool execute_weasel_deployer(const std::string& argument) {
+  USERDB_TRACE_SCOPE();
   // 获取共享数据目录（程序目录）
   char shared_data_dir[1024] = {0};
   rime_get_api()->get_shared_data_dir_s(shared_data_dir, sizeof(shared_data_dir));
@@ -101,7 +214,7 @@ bool execute_weasel_deployer(const std::string& argument) {
   fs::path deployer_path = fs::path(shared_data_dir).parent_path() / "WeaselDeployer.exe";
   
   if (!fs::exists(deployer_path)) {
-    LOG(ERROR) << "WeaselDeployer.exe not found at: " << deployer_path.string();
+    CLEAN_LOG(kError, kGeneral) << "WeaselDeployer.exe not found at: " << deployer_path.string();
     return false;
   }
   
@@ -115,7 +228,7 @@ bool execute_weasel_deployer(const std::string& argument) {
   ZeroMemory(&pi, sizeof(pi));
   
   std::string command = "\"" + deployer_path.string() + "\" " + argument;
-  LOG(INFO) << "Executing: " << command;
+  CLEAN_LOG(kInfo, kGeneral) << "Executing: " << command;
   
   // 创建进程
   BOOL success = CreateProcess(
@@ -132,7 +245,7 @@ bool execute_weasel_deployer(const std::string& argument) {
   );
   
   if (!success) {
-    LOG(ERROR) << "CreateProcess failed: " << GetLastError();
+    CLEAN_LOG(kError, kGeneral) << "CreateProcess failed: " << GetLastError();
     return false;
   }
   
@@ -143,7 +256,7 @@ bool execute_weasel_deployer(const std::string& argument) {
   CloseHandle(pi.hProcess);
   CloseHandle(pi.hThread);
   
-  LOG(INFO) << "WeaselDeployer executed successfully: " << argument;
+  CLEAN_LOG(kInfo, kGeneral) << "WeaselDeployer executed successfully: " << argument;
   return true;
 }
 #endif
@@ -152,6 +265,7 @@ bool execute_weasel_deployer(const std::string& argument) {
  * 获取同步目录
  */
 fs::path get_sync_directory() {
+  USERDB_TRACE_SCOPE();
   fs::path sync_path;
   
   // 方法1: 使用 get_sync_dir_s API 函数
@@ -160,11 +274,11 @@ fs::path get_sync_directory() {
   sync_path = fs::path(sync_dir);
   
   if (fs::exists(sync_path) && fs::is_directory(sync_path)) {
-    LOG(INFO) << "Using sync directory from API: " << sync_path.string();
+    CLEAN_LOG(kInfo, kDiscovery) << "Using sync directory from API: " << sync_path.string();
     return sync_path;
   }
   
-  LOG(WARNING) << "Sync directory from API does not exist: " << sync_path.string();
+  CLEAN_LOG(kWarning, kDiscovery) << "Sync directory from API does not exist: " << sync_path.string();
   
   // 方法2: 解析 installation.yaml 中的 sync_dir 配置
   char user_data_dir[1024] = {0};
@@ -193,444 +307,41 @@ fs::path get_sync_directory() {
         #endif
         
         if (fs::exists(sync_path) && fs::is_directory(sync_path)) {
-          LOG(INFO) << "Using sync directory from installation.yaml: " << sync_path.string();
+          CLEAN_LOG(kInfo, kDiscovery) << "Using sync directory from installation.yaml: " << sync_path.string();
           return sync_path;
         } else {
-          LOG(WARNING) << "Sync directory from installation.yaml does not exist: " << sync_path.string();
+          CLEAN_LOG(kWarning, kDiscovery) << "Sync directory from installation.yaml does not exist: " << sync_path.string();
         }
       } else {
-        LOG(INFO) << "No sync_dir configuration found in installation.yaml";
+        CLEAN_LOG(kInfo, kDiscovery) << "No sync_dir configuration found in installation.yaml";
       }
     } else {
-      LOG(ERROR) << "Failed to load installation.yaml";
+      CLEAN_LOG(kError, kDiscovery) << "Failed to load installation.yaml";
     }
   } else {
-    LOG(WARNING) << "installation.yaml does not exist: " << inst_file.string();
+    CLEAN_LOG(kWarning, kDiscovery) << "installation.yaml does not exist: " << inst_file.string();
   }
   
   // 方法3: 使用用户目录下的 sync 目录作为默认值
   sync_path = user_path / "sync";
   if (fs::exists(sync_path) && fs::is_directory(sync_path)) {
-    LOG(INFO) << "Using default sync directory: " << sync_path.string();
+    CLEAN_LOG(kInfo, kDiscovery) << "Using default sync directory: " << sync_path.string();
     return sync_path;
   }
   
-  LOG(ERROR) << "No valid sync directory found";
+  CLEAN_LOG(kError, kDiscovery) << "No valid sync directory found";
   return sync_path; // 返回默认路径，即使它不存在
 }
 
-/**
- * 获取当前时间的中文格式字符串
- */
-std::string get_current_time() {
-  auto now = std::chrono::system_clock::now();
-  auto time_t = std::chrono::system_clock::to_time_t(now);
-  std::tm tm;
-  localtime_s(&tm, &time_t);
-  
-  std::ostringstream oss;
-  oss << std::setfill('0') 
-      << (tm.tm_year + 1900) << "-"
-      << std::setw(2) << (tm.tm_mon + 1) << "-"
-      << std::setw(2) << tm.tm_mday << " "
-      << std::setw(2) << tm.tm_hour << ":"
-      << std::setw(2) << tm.tm_min << ":"
-      << std::setw(2) << tm.tm_sec;
-  
-  return oss.str();
-}
-
-/**
- * 备份.userdb.txt文件为.userdb_backup.txt
- */
-bool backup_userdb_file(const fs::path& userdb_file) {
-  try {
-    // 构造备份文件名
-    std::string filename = userdb_file.filename().string();
-    std::string backup_filename = filename;
-    size_t pos = backup_filename.find(".userdb.txt");
-    if (pos != std::string::npos) {
-      backup_filename.replace(pos, 11, ".userdb_backup.txt");
-    } else {
-      backup_filename += ".backup";
-    }
-    
-    fs::path backup_path = userdb_file.parent_path() / backup_filename;
-    
-    // 复制文件（覆盖模式）
-    fs::copy_file(userdb_file, backup_path, fs::copy_options::overwrite_existing);
-    
-    LOG(INFO) << "Backed up " << filename << " to " << backup_filename;
-    return true;
-  } catch (const fs::filesystem_error& e) {
-    LOG(ERROR) << "Failed to backup file " << userdb_file.string() << ": " << e.what();
-    return false;
-  }
-}
-
-/**
- * 记录删除的词条到日志文件
- */
-void log_deleted_words(const std::vector<std::string>& deleted_words, const fs::path& sync_dir) {
-  if (deleted_words.empty()) {
-    return;
-  }
-  
-  fs::path log_file = sync_dir / "userdb_cleaner.txt";
-  
-  try {
-    // 以追加模式打开文件，使用UTF-8编码（不带BOM）
-    std::ofstream out(log_file, std::ios::app);
-    if (!out.is_open()) {
-      LOG(ERROR) << "Failed to open log file: " << log_file.string();
-      return;
-    }
-    
-    // 写入当前时间
-    std::string current_time = get_current_time();
-    out << current_time << " Deleted words:\n";
-    
-    // 写入被删除的词条
-    for (const auto& word : deleted_words) {
-      out << "  - " << word << "\n";
-    }
-    
-    out << "\n"; // 添加空行分隔不同时间的记录
-    
-    out.close();
-    LOG(INFO) << "Logged " << deleted_words.size() << " deleted words to " << log_file.string();
-  } catch (const std::exception& e) {
-    LOG(ERROR) << "Failed to write to log file: " << e.what();
-  }
-}
-
-/**
- * 检查是否需要清理指定的userdb
- */
-bool should_clean_userdb(const std::string& db_name, const std::vector<std::string>& cleanup_list) {
-  // 如果清理列表为空，则清理所有
-  if (cleanup_list.empty()) {
-    return true;
-  }
-  
-  // 检查是否在清理列表中
-  for (const auto& allowed_db : cleanup_list) {
-    if (db_name == allowed_db) {
-      return true;
-    }
-  }
-  
-  return false;
-}
-
-/**
- * 从路径中提取userdb名称
- */
-std::string extract_userdb_name(const fs::path& path) {
-  std::string filename = path.filename().string();
-  
-  // 处理 .userdb 文件夹
-  if (fs::is_directory(path)) {
-    const std::string suffix = ".userdb";
-    if (filename.length() > suffix.length() && 
-        filename.substr(filename.length() - suffix.length()) == suffix) {
-      return filename.substr(0, filename.length() - suffix.length());
-    }
-  }
-  
-  // 处理 .userdb.txt 文件
-  const std::string suffix = ".userdb.txt";
-  if (filename.length() > suffix.length() && 
-      filename.substr(filename.length() - suffix.length()) == suffix) {
-    return filename.substr(0, filename.length() - suffix.length());
-  }
-  
-  return filename; // 返回原始文件名
-}
-
-/**
- * 获取目录下所有的 .userdb 文件夹（根据清理列表过滤）
- */
-std::vector<fs::path> get_userdb_folders(const fs::path& dir, const std::vector<std::string>& cleanup_list, std::vector<std::string>& cleaned_folders) {
-  std::vector<fs::path> result;
-  if (!fs::exists(dir)) {
-    LOG(INFO) << "No .userdb folders found in directory: " << dir.string();
-    return result;
-  }
-  if (!fs::is_directory(dir)) {
-    return result;
-  }
-  
-  int folder_count = 0;
-  int filtered_count = 0;
-  for (const auto& entry : fs::directory_iterator(dir)) {
-    try {
-      if (entry.is_directory()) {
-        const auto& path = entry.path();
-        const std::string folder_name = path.filename().string();
-        // 匹配以 .userdb 结尾的文件夹
-        const std::string suffix = ".userdb";
-        const size_t suffix_len = suffix.length();
-        const size_t name_len = folder_name.length();
-        if (name_len > suffix_len &&
-            folder_name.substr(name_len - suffix_len) == suffix) {
-          std::string db_name = extract_userdb_name(path);
-          if (should_clean_userdb(db_name, cleanup_list)) {
-            result.push_back(path);
-            // 去重添加，并添加后缀
-            std::string full_name = db_name + ".userdb";
-            if (std::find(cleaned_folders.begin(), cleaned_folders.end(), full_name) == cleaned_folders.end()) {
-              cleaned_folders.push_back(full_name);
-            }
-            folder_count++;
-            LOG(INFO) << "Including folder in cleanup: " << folder_name << " (db_name: " << db_name << ")";
-          } else {
-            filtered_count++;
-            LOG(INFO) << "Skipping folder (not in cleanup list): " << folder_name << " (db_name: " << db_name << ")";
-          }
-        }
-      }
-    } catch (const fs::filesystem_error& e) {
-      LOG(ERROR) << "Failed to get .userdb folders. Error: " << e.what();
-    }
-  }
-  LOG(INFO) << "Found " << folder_count << " .userdb folders (" << filtered_count << " filtered out)";
-  return result;
-}
-
-/**
- * 清理用户目录下的 .userdb 文件夹
- */
-int clean_userdb_folders(const std::vector<std::string>& cleanup_list, std::vector<std::string>& cleaned_folders) {
-  // 使用 get_user_data_dir_s 获取用户数据目录
-  char user_data_dir[1024] = {0};
-  rime_get_api()->get_user_data_dir_s(user_data_dir, sizeof(user_data_dir));
-  
-  LOG(INFO) << "Cleaning userdb folders in: " << user_data_dir;
-  LOG(INFO) << "Cleanup list size: " << cleanup_list.size();
-  if (!cleanup_list.empty()) {
-    LOG(INFO) << "Cleanup list contents:";
-    for (const auto& db : cleanup_list) {
-      LOG(INFO) << "  - " << db;
-    }
-  }
-  
-  auto folders = get_userdb_folders(user_data_dir, cleanup_list, cleaned_folders);
-  int deleted_files_count = 0;
-  
-  if (!folders.empty()) {
-    for (const auto& folder : folders) {
-      LOG(INFO) << "Processing folder: " << folder.string();
-      for (const auto& entry : fs::directory_iterator(folder)) {
-        try {
-          fs::remove(entry.path());
-          deleted_files_count++;
-          LOG(INFO) << "Deleted file: " << entry.path().string();
-        } catch (const fs::filesystem_error& e) {
-          LOG(ERROR) << "Failed to delete '" << entry.path().string() << "'. Error: " << e.what();
-        }
-      }
-    }
-  }
-  
-  LOG(INFO) << "Cleaned " << deleted_files_count << " files from " << cleaned_folders.size() << " userdb folders";
-  return deleted_files_count;
-}
-
-/**
- * 递归获取 sync 目录下所有子目录中的 .userdb.txt 文件（根据清理列表过滤）
- */
-std::vector<fs::path> get_userdb_files(const std::vector<std::string>& cleanup_list, std::vector<std::string>& cleaned_files) {
-  std::vector<fs::path> result;
-
-  // 使用新的同步目录获取方法
-  fs::path sync_path = get_sync_directory();
-  
-  LOG(INFO) << "Scanning for userdb files in: " << sync_path.string();
-
-  if (!fs::exists(sync_path) || !fs::is_directory(sync_path)) {
-    LOG(ERROR) << "Sync directory does not exist: " << sync_path.string();
-    return result;
-  }
-
-  int file_count = 0;
-  int filtered_count = 0;
-  
-  // 递归遍历 sync 目录下的所有子目录
-  for (const auto& entry : fs::recursive_directory_iterator(sync_path)) {
-    try {
-      if (entry.is_regular_file()) {
-        const auto& path = entry.path();
-        const std::string file_name = path.filename().string();
-        // 匹配以 .userdb.txt 结尾的文件
-        const std::string suffix = ".userdb.txt";
-        const size_t suffix_len = suffix.length();
-        const size_t name_len = file_name.length();
-        if (name_len > suffix_len &&
-            file_name.substr(name_len - suffix_len) == suffix) {
-          std::string db_name = extract_userdb_name(path);
-          if (should_clean_userdb(db_name, cleanup_list)) {
-            result.push_back(path);
-            // 去重添加，并添加后缀
-            std::string full_name = db_name + ".userdb.txt";
-            if (std::find(cleaned_files.begin(), cleaned_files.end(), full_name) == cleaned_files.end()) {
-              cleaned_files.push_back(full_name);
-            }
-            file_count++;
-            LOG(INFO) << "Including file in cleanup: " << file_name << " (db_name: " << db_name << ")";
-          } else {
-            filtered_count++;
-            LOG(INFO) << "Skipping file (not in cleanup list): " << file_name << " (db_name: " << db_name << ")";
-          }
-        }
-      }
-    } catch (const fs::filesystem_error& e) {
-      LOG(ERROR) << "Failed to get .userdb.txt files. Error: " << e.what();
-    }
-  }
-  
-  LOG(INFO) << "Found " << file_count << " .userdb.txt files in sync directory and subdirectories (" << filtered_count << " filtered out)";
-  return result;
-}
-
-/**
- * 从行中提取 c 值并解析
- */
-double parse_c_value(const std::string& line) {
-  // 从后往前查找"c="
-  size_t pos = line.rfind("c=");
-  if (pos == std::string::npos)
-    return 1.0;  // 未找到 c 字段, 保留该行
-
-  // 移动到c值起始位置 (跳过"c=")
-  pos += 2;
-
-  // 查找c值结束位置 (空格/制表符/行尾)
-  size_t end = pos;
-  while (end < line.size() &&
-         !std::isspace(static_cast<unsigned char>(line[end]))) {
-    end++;
-  }
-
-  double value = -1.0;
-  auto [ptr, ec] = std::from_chars(line.data() + pos, line.data() + end, value);
-
-  // 检查解析是否成功
-  if (ec != std::errc() || ptr != line.data() + end) {
-    try {
-      return std::stod(line.substr(pos, end - pos));
-    } catch (...) {
-      return 1.0;  // 解析失败, 保留该行
-    }
-  }
-  return value;
-}
-
-/**
- * 从词条行中提取词条文本
- * 格式示例: biàn biàn 	便便	c=1 d=0.00687406 t=31469
- * 返回: 便便
- */
-std::string extract_word_text(const std::string& line) {
-  // 查找第一个制表符
-  size_t first_tab = line.find('\t');
-  if (first_tab == std::string::npos) {
-    return line;  // 没有制表符，返回整行
-  }
-  
-  // 查找第二个制表符
-  size_t second_tab = line.find('\t', first_tab + 1);
-  if (second_tab == std::string::npos) {
-    // 没有第二个制表符，返回第一个制表符后的内容
-    return line.substr(first_tab + 1);
-  }
-  
-  // 返回两个制表符之间的内容（词条文本）
-  return line.substr(first_tab + 1, second_tab - first_tab - 1);
-}
-
-/**
- * 清理用户目录 sync 下的 .userdb 文件
- * @return 总共清理的无效词条数量
- */
-int clean_userdb_files(const std::vector<std::string>& cleanup_list, std::vector<std::string>& cleaned_files, std::vector<std::string>& deleted_words) {
-  auto files = get_userdb_files(cleanup_list, cleaned_files);
-  int delete_item_count = 0;
-  
-  if (!files.empty()) {
-    std::string line;
-    line.reserve(256);
-
-    for (const auto& file : files) {
-      LOG(INFO) << "Processing file: " << file.string();
-      
-      // 备份文件
-      if (!backup_userdb_file(file)) {
-        LOG(ERROR) << "Failed to backup file: " << file.string();
-        // 继续处理，但不记录删除的词条
-        continue;
-      }
-      
-      if (fs::exists(file) && fs::is_regular_file(file)) {
-        std::ifstream in(file, std::ios::binary);
-        std::string temp_file = file.string() + ".cache";
-        std::ofstream out(temp_file, std::ios::binary);
-        if (!in.is_open() || !out.is_open()) {
-          LOG(ERROR) << "Failed to open file: " << file.string();
-          continue;
-        }
-
-        int file_deleted_count = 0;
-        while (std::getline(in, line)) {
-          if (line.empty()) continue;
-          // 提取并检查 c 值
-          double c_value = parse_c_value(line);
-          // 把 c > 0 的行写入新文件
-          if (c_value > 0.0) {
-            out << line << "\n";
-          } else {
-            // 记录删除的词条
-            std::string word_text = extract_word_text(line);
-            deleted_words.push_back(word_text);
-            delete_item_count++;
-            file_deleted_count++;
-          }
-          line.clear();
-        }
-
-        out.flush();
-        out.close();
-        in.close();
-
-        fs::remove(file);
-        std::string new_file = file.string();
-        fs::rename(temp_file, new_file);
-        
-        LOG(INFO) << "File " << file.filename().string() << ": deleted " << file_deleted_count << " invalid entries";
-      }
-    }
-  }
-  
-  // 在日志中打印删除的词条详情
-  if (!deleted_words.empty()) {
-    LOG(INFO) << "Deleted words (" << deleted_words.size() << " items):";
-    for (const auto& word : deleted_words) {
-      LOG(INFO) << "  - " << word;
-    }
-  }
-  
-  LOG(INFO) << "Total deleted invalid entries from userdb files: " << delete_item_count;
-  return delete_item_count;
-}
-
 /**
  * 发送清理结果通知
  */
 void send_clean_msg(const int& delete_item_count, 
-                   const std::vector<std::string>& cleaned_folders,
-                   const std::vector<std::string>& cleaned_files,
-                   const std::vector<std::string>& deleted_words,
+                   const userdb::StringList& cleaned_folders,
+                   const userdb::StringList& cleaned_files,
+                   const userdb::StringList& deleted_words,
                    bool full_information_display) {
+  USERDB_TRACE_SCOPE();
 #if defined(_WIN32) || defined(_WIN64)
   std::wstring title = L"用户词典清理工具";
   std::wstring message;
@@ -650,7 +361,7 @@ void send_clean_msg(const int& delete_item_count,
         for (size_t i = 0; i < cleaned_folders.size(); ++i) {
           if (i > 0) message += L", ";
           // 将字符串转换为宽字符串
-          std::string db_name = cleaned_folders[i];
+          std::string db_name(cleaned_folders[i]);
           int wide_length = MultiByteToWideChar(CP_UTF8, 0, db_name.c_str(), -1, nullptr, 0);
           if (wide_length > 0) {
             std::wstring wide_db_name(wide_length, 0);
@@ -670,7 +381,7 @@ void send_clean_msg(const int& delete_item_count,
         for (size_t i = 0; i < cleaned_files.size(); ++i) {
           if (i > 0) message += L", ";
           // 将字符串转换为宽字符串
-          std::string db_name = cleaned_files[i];
+          std::string db_name(cleaned_files[i]);
           int wide_length = MultiByteToWideChar(CP_UTF8, 0, db_name.c_str(), -1, nullptr, 0);
           if (wide_length > 0) {
             std::wstring wide_db_name(wide_length, 0);
@@ -696,7 +407,7 @@ void send_clean_msg(const int& delete_item_count,
             }
           }
           // 将词条转换为宽字符串并用方括号括起来
-          std::string word = deleted_words[i];
+          std::string word(deleted_words[i]);
           int wide_length = MultiByteToWideChar(CP_UTF8, 0, word.c_str(), -1, nullptr, 0);
           if (wide_length > 0) {
             std::wstring wide_word(wide_length, 0);
@@ -722,7 +433,7 @@ void send_clean_msg(const int& delete_item_count,
         message += L"清理的 userdb 文件夹:\n";
         for (size_t i = 0; i < cleaned_folders.size(); ++i) {
           if (i > 0) message += L", ";
-          std::string db_name = cleaned_folders[i];
+          std::string db_name(cleaned_folders[i]);
           int wide_length = MultiByteToWideChar(CP_UTF8, 0, db_name.c_str(), -1, nullptr, 0);
           if (wide_length > 0) {
             std::wstring wide_db_name(wide_length, 0);
@@ -740,7 +451,7 @@ void send_clean_msg(const int& delete_item_count,
         message += L"清理的 userdb.txt 文件:\n";
         for (size_t i = 0; i < cleaned_files.size(); ++i) {
           if (i > 0) message += L", ";
-          std::string db_name = cleaned_files[i];
+          std::string db_name(cleaned_files[i]);
           int wide_length = MultiByteToWideChar(CP_UTF8, 0, db_name.c_str(), -1, nullptr, 0);
           if (wide_length > 0) {
             std::wstring wide_db_name(wide_length, 0);
@@ -759,91 +470,102 @@ void send_clean_msg(const int& delete_item_count,
 #elif __APPLE__
   // macOS 实现
   if (delete_item_count > 0) {
-    LOG(INFO) << "用户词典清理完成。删除了 " << delete_item_count << " 个无效词条。";
+    CLEAN_LOG(kInfo, kGeneral) << "用户词典清理完成。删除了 " << delete_item_count << " 个无效词条。";
     if (full_information_display) {
       if (!cleaned_folders.empty()) {
-        LOG(INFO) << "清理的 userdb 文件夹: " << cleaned_folders.size();
+        CLEAN_LOG(kInfo, kGeneral) << "清理的 userdb 文件夹: " << cleaned_folders.size();
       }
       if (!cleaned_files.empty()) {
-        LOG(INFO) << "清理的 userdb.txt 文件: " << cleaned_files.size();
+        CLEAN_LOG(kInfo, kGeneral) << "清理的 userdb.txt 文件: " << cleaned_files.size();
       }
       if (!deleted_words.empty()) {
-        LOG(INFO) << "删除的词条数量: " << deleted_words.size();
+        CLEAN_LOG(kInfo, kGeneral) << "删除的词条数量: " << deleted_words.size();
       }
     }
   } else {
-    LOG(INFO) << "用户词典清理完成。未找到需要清理的无效词条。";
+    CLEAN_LOG(kInfo, kGeneral) << "用户词典清理完成。未找到需要清理的无效词条。";
   }
 #elif __linux__
   // Linux 实现
   if (delete_item_count > 0) {
-    LOG(INFO) << "用户词典清理完成。删除了 " << delete_item_count << " 个无效词条。";
+    CLEAN_LOG(kInfo, kGeneral) << "用户词典清理完成。删除了 " << delete_item_count << " 个无效词条。";
     if (full_information_display) {
       if (!cleaned_folders.empty()) {
-        LOG(INFO) << "清理的 userdb 文件夹: " << cleaned_folders.size();
+        CLEAN_LOG(kInfo, kGeneral) << "清理的 userdb 文件夹: " << cleaned_folders.size();
       }
       if (!cleaned_files.empty()) {
-        LOG(INFO) << "清理的 userdb.txt 文件: " << cleaned_files.size();
+        CLEAN_LOG(kInfo, kGeneral) << "清理的 userdb.txt 文件: " << cleaned_files.size();
       }
       if (!deleted_words.empty()) {
-        LOG(INFO) << "删除的词条数量: " << deleted_words.size();
+        CLEAN_LOG(kInfo, kGeneral) << "删除的词条数量: " << deleted_words.size();
       }
     }
   } else {
-    LOG(INFO) << "用户词典清理完成。未找到需要清理的无效词条。";
+    CLEAN_LOG(kInfo, kGeneral) << "用户词典清理完成。未找到需要清理的无效词条。";
   }
 #endif
 }
 
 /**
- * 执行清理任务
+ * 清理任务的目录取自 rime API
  */
-void process_clean_task(const std::vector<std::string>& cleanup_list, bool full_information_display) {
-  LOG(INFO) << "Starting userdb cleaning task...";
-  LOG(INFO) << "Cleanup list contains " << cleanup_list.size() << " items";
-  if (!cleanup_list.empty()) {
-    LOG(INFO) << "Cleanup list:";
-    for (const auto& db : cleanup_list) {
-      LOG(INFO) << "  - " << db;
-    }
-  }
-  LOG(INFO) << "Full information display: " << full_information_display;
-  
-#if defined(_WIN32) || defined(_WIN64)
-  // 清理前先执行 sync
-  LOG(INFO) << "Executing pre-clean deployment...";
-  execute_weasel_deployer("/sync");
-#endif
-  
-  std::vector<std::string> cleaned_folders;
-  std::vector<std::string> cleaned_files;
-  std::vector<std::string> deleted_words;
-  
-  int folder_deleted_count = clean_userdb_folders(cleanup_list, cleaned_folders);
-  int file_deleted_count = clean_userdb_files(cleanup_list, cleaned_files, deleted_words);
-  
-  // 记录删除的词条到日志文件
-  fs::path sync_dir = get_sync_directory();
-  log_deleted_words(deleted_words, sync_dir);
-  
-  // 通知中只显示删除的词条总数（file_deleted_count）
-  int total_notification_count = file_deleted_count;
-  
+userdb::CleanContext get_clean_context() {
+  userdb::CleanContext context;
+  char user_data_dir[1024] = {0};
+  rime_get_api()->get_user_data_dir_s(user_data_dir, sizeof(user_data_dir));
+  context.user_data_dir = user_data_dir;
+  context.sync_dir = get_sync_directory();
+  char local_sync_dir[1024] = {0};
+  rime_get_api()->get_user_data_sync_dir(local_sync_dir, sizeof(local_sync_dir));
+  context.local_sync_dir = local_sync_dir;
 #if defined(_WIN32) || defined(_WIN64)
-  // 清理后执行 sync
-  LOG(INFO) << "Executing post-clean deployment...";
-  execute_weasel_deployer("/sync");
+  context.sync = []() { execute_weasel_deployer("/sync"); };
 #endif
-  
-  LOG(INFO) << "Userdb cleaning completed. Total deleted entries: " << file_deleted_count;
-  LOG(INFO) << "Cleaned folders: " << cleaned_folders.size();
-  LOG(INFO) << "Cleaned files: " << cleaned_files.size();
-  LOG(INFO) << "Deleted words: " << deleted_words.size();
-  
-  send_clean_msg(total_notification_count, cleaned_folders, cleaned_files, deleted_words, full_information_display);
+  return context;
+}
+
+/**
+ * 执行清理任务：目录取自 rime API，日志写入 glog，清理流程见 userdb_clean_core
+ * @param metrics 非空时把本次的指标写入其中（供基准测试使用）
+ */
+void process_clean_task(const userdb::CleanOptions& options, userdb::CleanMetrics* metrics) {
+  userdb::clean_logger().set_sink([](userdb::LogLevel level, const std::string& message) {
+    switch (level) {
+      case userdb::LogLevel::kError: LOG(ERROR) << message; break;
+      case userdb::LogLevel::kWarning: LOG(WARNING) << message; break;
+      default: LOG(INFO) << message; break;
+    }
+  });
+
+  userdb::CleanContext context = get_clean_context();
+  userdb::CleanResult result = userdb::run_clean_task(options, context, metrics);
+
+  // 通知中只显示删除的词条总数
+  send_clean_msg(result.deleted_count, result.cleaned_folders, result.cleaned_files, result.deleted_words,
+                 options.full_information_display);
 }
 
 ProcessResult UserdbCleaner::ProcessKeyEvent(const KeyEvent& key_event) {
+#if !defined(_WIN32) && !defined(_WIN64)
+  // 配置了守护进程时只提交任务后立即返回，同一主机上的多个前端不会各自启动清理线程
+  if (!daemon_socket_.empty()) {
+    auto ctx = engine_->context();
+    if (ctx->input() != trigger_input_) {
+      return kNoop;
+    }
+    ctx->Clear();
+    userdb::CleanContext context = get_clean_context();
+    std::string response;
+    std::string error;
+    if (userdb::daemon_request(daemon_socket_, userdb::encode_clean_job(clean_options_, context), &response, &error,
+                               userdb::kSubmitTimeoutMillis)) {
+      LOG(INFO) << "UserdbCleaner submitted to daemon: " << response;
+    } else {
+      LOG(ERROR) << "Failed to submit cleaning job to " << daemon_socket_ << ": " << error;
+    }
+    return kAccepted;
+  }
+#endif
 #if defined(_WIN32) || defined(_WIN64)
   auto ctx = engine_->context();
   auto input = ctx->input();
@@ -856,8 +578,8 @@ ProcessResult UserdbCleaner::ProcessKeyEvent(const KeyEvent& key_event) {
     
     // 启动一个线程来执行清理任务，传递清理列表和显示配置
     DetachedThreadManager manager;
-    if (manager.try_start([cleanup_list = cleanup_userdb_list_, full_display = full_information_display_]() { 
-      process_clean_task(cleanup_list, full_display); 
+    if (manager.try_start([options = clean_options_]() { 
+      process_clean_task(options); 
     })) {
       LOG(INFO) << "UserdbCleaner task started successfully";
       return kAccepted;
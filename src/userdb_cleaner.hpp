@@ -7,6 +7,9 @@
 #include <vector>
 #include <string>
 
+#include "lib/clean_options.hpp"
+#include "lib/clean_metrics.hpp"
+
 namespace rime {
 
 class UserdbCleaner : public Processor {
@@ -19,9 +22,15 @@ class UserdbCleaner : public Processor {
  private:
   void InitializeConfig();
   std::string trigger_input_ = "/del";  // 默认触发输入
-  std::vector<std::string> cleanup_userdb_list_;  // 需要清理的userdb列表
-  bool full_information_display_ = false;  // 是否显示完整清理信息，默认为false
+  userdb::CleanOptions clean_options_;  // 清理任务配置（清理列表、显示方式等）
+  std::string daemon_socket_;           // 非空时把清理任务提交给该套接字上的守护进程
 };
 
+/**
+ * 执行一次完整的清理任务（插件在后台线程中调用）
+ * @param metrics 非空时把本次的指标（各阶段耗时、逐文件统计等）写入其中
+ */
+void process_clean_task(const userdb::CleanOptions& options, userdb::CleanMetrics* metrics = nullptr);
+
 }  // namespace rime
 #endif
\ No newline at end of file
@@ -0,0 +1,516 @@
+// userdb_daemon.cc
+// 清理守护进程：Unix 域套接字上的 submit / cancel / status 请求，单线程调度所有磁盘操作
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "userdb_daemon.hpp"
+
+namespace fs = std::filesystem;
+
+namespace userdb {
+
+const char* job_state_name(JobState state) {
+  switch (state) {
+    case JobState::kQueued: return "queued";
+    case JobState::kRunning: return "running";
+    case JobState::kDone: return "done";
+    case JobState::kCancelled: return "cancelled";
+    case JobState::kFailed: return "failed";
+    default: return "unknown";
+  }
+}
+
+std::string escape_field(std::string_view value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (char c : value) {
+    switch (c) {
+      case '\\': escaped += "\\\\"; break;
+      case '\t': escaped += "\\t"; break;
+      case '\n': escaped += "\\n"; break;
+      default: escaped += c; break;
+    }
+  }
+  return escaped;
+}
+
+std::string unescape_field(std::string_view value) {
+  std::string plain;
+  plain.reserve(value.size());
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '\\' && i + 1 < value.size()) {
+      char next = value[++i];
+      plain += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+    } else {
+      plain += value[i];
+    }
+  }
+  return plain;
+}
+
+std::string encode_clean_job(const CleanOptions& options, const CleanContext& context) {
+  std::string line = "submit";
+  auto field = [&](const char* key, std::string_view value) {
+    line += '\t';
+    line += key;
+    line += '=';
+    line += escape_field(value);
+  };
+  std::string dicts;
+  for (const auto& name : options.cleanup_list) {
+    dicts += (dicts.empty() ? "" : ",") + name;
+  }
+  field("user_data_dir", context.user_data_dir.string());
+  field("sync_dir", context.sync_dir.string());
+  field("local_sync_dir", context.local_sync_dir.string());
+  field("dicts", dicts);
+  field("record", options.record_deleted_words ? "1" : "0");
+  field("merge", merge_rule_name(options.merge_rule));
+  field("consolidate", options.consolidate_devices ? "1" : "0");
+  field("propagate", options.propagate_deletions ? "1" : "0");
+  field("prune_idle_ticks", std::to_string(options.prune_idle_ticks));
+  field("binary_snapshot", options.binary_snapshot ? "1" : "0");
+  field("bounded_memory", options.bounded_memory ? "1" : "0");
+  field("drop_page_cache", options.drop_page_cache ? "1" : "0");
+  field("durable_commit", options.durable_commit ? "1" : "0");
+  field("backup_mode", backup_mode_name(options.backup_mode));
+  field("backup_generations", std::to_string(options.backup_generations));
+  field("backup_repo", options.backup_repo);
+  field("metrics", options.record_metrics ? "1" : "0");
+  field("trace", options.trace ? "1" : "0");
+  field("verbose", options.log_verbose ? "1" : "0");
+  field("log_rate", std::to_string(options.log_rate_limit));
+  return line;
+}
+
+bool decode_clean_job(std::string_view line, CleanOptions* options, CleanContext* context, std::string* error) {
+  std::vector<std::string_view> fields;
+  size_t begin = 0;
+  while (begin <= line.size()) {
+    size_t end = line.find('\t', begin);
+    if (end == std::string_view::npos) end = line.size();
+    fields.push_back(line.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  if (fields.empty() || fields[0] != "submit") {
+    *error = "not a submit request";
+    return false;
+  }
+  for (size_t i = 1; i < fields.size(); ++i) {
+    size_t eq = fields[i].find('=');
+    if (eq == std::string_view::npos) {
+      *error = "malformed field: " + std::string(fields[i]);
+      return false;
+    }
+    std::string_view key = fields[i].substr(0, eq);
+    std::string value = unescape_field(fields[i].substr(eq + 1));
+    bool flag = value == "1";
+    bool ok = true;
+    if (key == "user_data_dir") {
+      context->user_data_dir = value;
+    } else if (key == "sync_dir") {
+      context->sync_dir = value;
+    } else if (key == "local_sync_dir") {
+      context->local_sync_dir = value;
+    } else if (key == "dicts") {
+      std::stringstream list(value);
+      std::string name;
+      while (std::getline(list, name, ',')) {
+        if (!name.empty()) options->cleanup_list.push_back(name);
+      }
+    } else if (key == "record") {
+      options->record_deleted_words = flag;
+    } else if (key == "merge") {
+      ok = parse_merge_rule(value, &options->merge_rule);
+    } else if (key == "consolidate") {
+      options->consolidate_devices = flag;
+    } else if (key == "propagate") {
+      options->propagate_deletions = flag;
+    } else if (key == "prune_idle_ticks") {
+      options->prune_idle_ticks = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (key == "binary_snapshot") {
+      options->binary_snapshot = flag;
+    } else if (key == "bounded_memory") {
+      options->bounded_memory = flag;
+    } else if (key == "drop_page_cache") {
+      options->drop_page_cache = flag;
+    } else if (key == "durable_commit") {
+      options->durable_commit = flag;
+    } else if (key == "backup_mode") {
+      ok = parse_backup_mode(value, &options->backup_mode);
+    } else if (key == "backup_generations") {
+      options->backup_generations = std::atoi(value.c_str());
+      ok = options->backup_generations > 0;
+    } else if (key == "backup_repo") {
+      options->backup_repo = value;
+    } else if (key == "metrics") {
+      options->record_metrics = flag;
+    } else if (key == "trace") {
+      options->trace = flag;
+    } else if (key == "verbose") {
+      options->log_verbose = flag;
+    } else if (key == "log_rate") {
+      options->log_rate_limit = std::atoi(value.c_str());
+    }
+    // 未知的键忽略，便于新旧版本的客户端与守护进程混用
+    if (!ok) {
+      *error = "invalid value for " + std::string(key) + ": " + value;
+      return false;
+    }
+  }
+  if (context->user_data_dir.empty() || context->sync_dir.empty()) {
+    *error = "user_data_dir and sync_dir are required";
+    return false;
+  }
+  if (context->user_data_dir.is_relative() || context->sync_dir.is_relative()) {
+    *error = "user_data_dir and sync_dir must be absolute";
+    return false;
+  }
+  return true;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+bool daemon_request(const fs::path&, const std::string&, std::string*, std::string* error, int) {
+  *error = "the cleaning daemon is not supported on Windows";
+  return false;
+}
+
+bool CleanDaemon::serve(const std::atomic<bool>&, std::string* error) {
+  *error = "the cleaning daemon is not supported on Windows";
+  return false;
+}
+
+#else
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+bool make_socket_address(const fs::path& path, sockaddr_un* address, std::string* error) {
+  std::string native = path.string();
+  if (native.size() >= sizeof(address->sun_path)) {
+    *error = "socket path too long: " + native;
+    return false;
+  }
+  std::memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  std::memcpy(address->sun_path, native.c_str(), native.size() + 1);
+  return true;
+}
+
+int open_socket(int timeout_millis) {
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  // 对方不读写时不会无限期阻塞（插件在输入法线程中提交任务）；Linux 上发送超时同样限制 connect
+  timeval timeout{timeout_millis / 1000, (timeout_millis % 1000) * 1000};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  return fd;
+}
+
+bool send_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t sent = ::send(fd, data.data(), data.size(), kSendFlags);
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent <= 0) return false;
+    data.remove_prefix(static_cast<size_t>(sent));
+  }
+  return true;
+}
+
+bool daemon_request(const fs::path& socket_path, const std::string& request, std::string* response,
+                    std::string* error, int timeout_millis) {
+  sockaddr_un address;
+  if (!make_socket_address(socket_path, &address, error)) {
+    return false;
+  }
+  int fd = open_socket(timeout_millis);
+  if (fd < 0) {
+    *error = std::string("socket: ") + std::strerror(errno);
+    return false;
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    *error = "connect " + socket_path.string() + ": " + std::strerror(errno);
+    ::close(fd);
+    return false;
+  }
+  if (!send_all(fd, request + "\n")) {
+    *error = std::string("send: ") + std::strerror(errno);
+    ::close(fd);
+    return false;
+  }
+  ::shutdown(fd, SHUT_WR);
+  response->clear();
+  char buffer[4096];
+  while (true) {
+    ssize_t got = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (got < 0 && errno == EINTR) continue;
+    if (got < 0) {
+      *error = std::string("recv: ") + std::strerror(errno);
+      ::close(fd);
+      return false;
+    }
+    if (got == 0) break;
+    response->append(buffer, static_cast<size_t>(got));
+  }
+  ::close(fd);
+  while (!response->empty() && response->back() == '\n') {
+    response->pop_back();
+  }
+  return true;
+}
+
+// 读取一行请求，超过 1 MiB 或超时时返回 false
+bool read_request_line(int fd, std::string* line) {
+  line->clear();
+  char buffer[4096];
+  while (line->size() < (1u << 20)) {
+    ssize_t got = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (got < 0 && errno == EINTR) continue;
+    if (got < 0) return false;
+    if (got == 0) return !line->empty();
+    line->append(buffer, static_cast<size_t>(got));
+    size_t newline = line->find('\n');
+    if (newline != std::string::npos) {
+      line->resize(newline);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CleanDaemon::serve(const std::atomic<bool>& stop, std::string* error) {
+  sockaddr_un address;
+  if (!make_socket_address(socket_path_, &address, error)) {
+    return false;
+  }
+  // 套接字文件存在但无人监听时是上次异常退出留下的，可以删除
+  std::string probe_error;
+  std::string probe_response;
+  if (daemon_request(socket_path_, "status 0", &probe_response, &probe_error)) {
+    *error = "another daemon is listening on " + socket_path_.string();
+    return false;
+  }
+  std::error_code ec;
+  fs::remove(socket_path_, ec);
+
+  int listener = open_socket(2000);
+  if (listener < 0) {
+    *error = std::string("socket: ") + std::strerror(errno);
+    return false;
+  }
+  // 只有本用户可以提交任务
+  mode_t old_mask = ::umask(0077);
+  int bound = ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+  ::umask(old_mask);
+  if (bound != 0 || ::listen(listener, 16) != 0) {
+    *error = "bind " + socket_path_.string() + ": " + std::strerror(errno);
+    ::close(listener);
+    return false;
+  }
+  CLEAN_LOG(kInfo, kGeneral) << "Cleaning daemon listening on " << socket_path_.string();
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    pollfd entry{listener, POLLIN, 0};
+    int ready = ::poll(&entry, 1, 500);
+    if (ready <= 0) {
+      continue;
+    }
+    int client = ::accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+    timeval timeout{2, 0};
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    ::setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    std::string line;
+    if (read_request_line(client, &line)) {
+      std::string response = handle_request(line);
+      if (!response.empty()) {
+        send_all(client, response + "\n");
+      }
+    }
+    ::close(client);
+  }
+
+  ::close(listener);
+  fs::remove(socket_path_, ec);
+  CLEAN_LOG(kInfo, kGeneral) << "Cleaning daemon stopped";
+  return true;
+}
+
+#endif
+
+CleanDaemon::CleanDaemon(fs::path socket_path, size_t keep_finished)
+    : socket_path_(std::move(socket_path)), keep_finished_(keep_finished) {
+  scheduler_ = std::thread([this]() { run_scheduler(); });
+}
+
+CleanDaemon::~CleanDaemon() { shutdown_scheduler(); }
+
+void CleanDaemon::shutdown_scheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    if (running_) {
+      running_->cancelled.store(true, std::memory_order_relaxed);
+    }
+    queue_.clear();
+  }
+  cv_.notify_all();
+  if (scheduler_.joinable()) {
+    scheduler_.join();
+  }
+}
+
+uint64_t CleanDaemon::submit(const CleanOptions& options, const CleanContext& context) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // 多个前端先后触发同一用户目录的清理时合并为一个任务
+  for (const auto& job : queue_) {
+    if (job->context.user_data_dir == context.user_data_dir && job->context.sync_dir == context.sync_dir) {
+      return job->status.id;
+    }
+  }
+  auto job = std::make_shared<Job>();
+  job->status.id = next_id_++;
+  job->status.user_data_dir = context.user_data_dir.string();
+  job->options = options;
+  job->context = context;
+  job->context.sync = nullptr;
+  job->context.cancelled = &job->cancelled;
+  queue_.push_back(job);
+  cv_.notify_one();
+  CLEAN_LOG(kInfo, kGeneral) << "Queued job " << job->status.id << " for " << job->status.user_data_dir;
+  return job->status.id;
+}
+
+bool CleanDaemon::cancel(uint64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_ && running_->status.id == id) {
+    running_->cancelled.store(true, std::memory_order_relaxed);
+    return true;
+  }
+  auto it = std::find_if(queue_.begin(), queue_.end(), [&](const auto& job) { return job->status.id == id; });
+  if (it == queue_.end()) {
+    return false;
+  }
+  (*it)->status.state = JobState::kCancelled;
+  finished_.push_back(*it);
+  queue_.erase(it);
+  while (finished_.size() > keep_finished_) {
+    finished_.pop_front();
+  }
+  return true;
+}
+
+std::vector<JobStatus> CleanDaemon::status(uint64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<JobStatus> jobs;
+  auto add = [&](const std::shared_ptr<Job>& job) {
+    if (id == 0 || job->status.id == id) jobs.push_back(job->status);
+  };
+  for (const auto& job : finished_) add(job);
+  if (running_) add(running_);
+  for (const auto& job : queue_) add(job);
+  std::sort(jobs.begin(), jobs.end(), [](const JobStatus& a, const JobStatus& b) { return a.id < b.id; });
+  return jobs;
+}
+
+std::string CleanDaemon::handle_request(std::string_view line) {
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  if (line.substr(0, 7) == "submit\t") {
+    CleanOptions options;
+    CleanContext context;
+    std::string error;
+    if (!decode_clean_job(line, &options, &context, &error)) {
+      return "error " + error;
+    }
+    return "ok " + std::to_string(submit(options, context));
+  }
+  if (line.substr(0, 7) == "cancel ") {
+    uint64_t id = std::strtoull(std::string(line.substr(7)).c_str(), nullptr, 10);
+    return cancel(id) ? "ok" : "error no queued or running job " + std::to_string(id);
+  }
+  if (line == "status" || line.substr(0, 7) == "status ") {
+    uint64_t id = line.size() > 7 ? std::strtoull(std::string(line.substr(7)).c_str(), nullptr, 10) : 0;
+    std::string response;
+    for (const auto& job : status(id)) {
+      response += std::to_string(job.id) + "\t" + job_state_name(job.state) + "\t" + escape_field(job.user_data_dir) +
+                  "\t" + std::to_string(job.deleted_count) + "\n";
+    }
+    if (!response.empty()) response.pop_back();
+    return response;
+  }
+  return "error unknown request";
+}
+
+void CleanDaemon::run_scheduler() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [&]() { return stopping_ || !queue_.empty(); });
+    if (stopping_) {
+      break;
+    }
+    std::shared_ptr<Job> job = queue_.front();
+    queue_.pop_front();
+    job->status.state = JobState::kRunning;
+    running_ = job;
+    lock.unlock();
+
+    CLEAN_LOG(kInfo, kGeneral) << "Running job " << job->status.id << " for " << job->status.user_data_dir;
+    JobState state = JobState::kDone;
+    int deleted_count = 0;
+    try {
+      CleanResult result = run_clean_task(job->options, job->context);
+      deleted_count = result.deleted_count;
+      if (result.cancelled) state = JobState::kCancelled;
+    } catch (const std::exception& e) {
+      CLEAN_LOG(kError, kGeneral) << "Job " << job->status.id << " failed: " << e.what();
+      state = JobState::kFailed;
+    }
+
+    lock.lock();
+    job->status.state = state;
+    job->status.deleted_count = deleted_count;
+    running_.reset();
+    finished_.push_back(job);
+    while (finished_.size() > keep_finished_) {
+      finished_.pop_front();
+    }
+  }
+}
+
+}  // namespace userdb
@@ -0,0 +1,124 @@
+#ifndef USERDB_DAEMON_HPP_
+#define USERDB_DAEMON_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "userdb_clean_core.hpp"
+
+namespace userdb {
+
+/**
+ * 清理守护进程的协议：客户端连接 Unix 域套接字，发送一行请求，读取应答直到连接关闭
+ *
+ *   submit<TAB>key=value<TAB>...  ->  "ok <id>"（同一用户目录已在排队时返回已有任务的 id）
+ *   cancel <id>                   ->  "ok"，排队中的任务直接取消，运行中的任务在文件之间停止
+ *   status [<id>]                 ->  每个任务一行：id<TAB>state<TAB>user_data_dir<TAB>deleted_count
+ *   失败时应答 "error <message>"
+ *
+ * 字段中的 \ 、制表符与换行符转义为 \\、\t、\n。
+ */
+
+enum class JobState {
+  kQueued,
+  kRunning,
+  kDone,
+  kCancelled,
+  kFailed,
+};
+
+const char* job_state_name(JobState state);
+
+/**
+ * 编码 submit 请求（不含换行符）
+ */
+std::string encode_clean_job(const CleanOptions& options, const CleanContext& context);
+
+/**
+ * 解析 submit 请求；context 中只填充目录
+ */
+bool decode_clean_job(std::string_view line, CleanOptions* options, CleanContext* context, std::string* error);
+
+// 插件在输入法线程中提交任务，连接、发送与等待应答各自最多等待这么久
+constexpr int kSubmitTimeoutMillis = 200;
+
+/**
+ * 发送一个请求并读取全部应答（客户端；Windows 下不支持）
+ * @param timeout_millis 连接、发送与接收各自的超时
+ */
+bool daemon_request(const std::filesystem::path& socket_path, const std::string& request, std::string* response,
+                    std::string* error, int timeout_millis = 10000);
+
+// 守护进程中一个清理任务的状态
+struct JobStatus {
+  uint64_t id = 0;
+  JobState state = JobState::kQueued;
+  std::string user_data_dir;
+  int deleted_count = 0;
+};
+
+/**
+ * 清理守护进程：在套接字上接收请求，由唯一的调度线程依次执行清理任务，
+ * 同一主机上的多个前端提交的任务因此不会同时读写磁盘
+ */
+class CleanDaemon {
+ public:
+  /**
+   * @param keep_finished 保留供 status 查询的已结束任务数
+   */
+  explicit CleanDaemon(std::filesystem::path socket_path, size_t keep_finished = 100);
+  // 取消运行中的任务并丢弃排队的任务
+  ~CleanDaemon();
+
+  CleanDaemon(const CleanDaemon&) = delete;
+  CleanDaemon& operator=(const CleanDaemon&) = delete;
+
+  /**
+   * 监听套接字并接收请求，直到 stop 置位；已有守护进程在监听时返回 false
+   */
+  bool serve(const std::atomic<bool>& stop, std::string* error);
+
+  uint64_t submit(const CleanOptions& options, const CleanContext& context);
+  bool cancel(uint64_t id);
+  std::vector<JobStatus> status(uint64_t id = 0);
+
+  // 处理一行请求，返回应答（不含末尾换行符）
+  std::string handle_request(std::string_view line);
+
+ private:
+  struct Job {
+    JobStatus status;
+    CleanOptions options;
+    CleanContext context;
+    std::atomic<bool> cancelled{false};
+  };
+
+  void run_scheduler();
+  void shutdown_scheduler();
+
+  const std::filesystem::path socket_path_;
+  const size_t keep_finished_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<Job>> queue_;
+  std::shared_ptr<Job> running_;
+  std::deque<std::shared_ptr<Job>> finished_;
+  uint64_t next_id_ = 1;
+  bool stopping_ = false;
+  std::thread scheduler_;
+};
+
+}  // namespace userdb
+
+#endif
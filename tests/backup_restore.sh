@@ -0,0 +1,62 @@
+#!/bin/sh
+# chunked 备份与 --restore 的往返：每一代清单都能还原出备份时的 .userdb.txt，
+# 分块损坏时还原失败且不改动输出文件
+# 用法：backup_restore.sh <userdb_cleaner_cli>
+set -eu
+
+cli=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+fail() {
+  echo "FAIL: $*" >&2
+  exit 1
+}
+
+dir="$work/user"
+dict="$dir/sync/device-1/luna_pinyin.userdb.txt"
+mkdir -p "$dir/sync/device-1"
+printf 'installation_id: "device-1"\n' > "$dir/installation.yaml"
+# 约 300 KB，跨越多个分块；每 7 条中有 2 条 c<=0
+awk 'BEGIN {
+  printf "# Rime user dictionary\n#@/db_name\tluna_pinyin\n#@/db_type\tuserdb\n#@/tick\t40000\n"
+  for (i = 0; i < 6000; ++i) printf "ci %d \t词条%d\tc=%d d=0.5 t=%d\n", i, i, i % 7 - 1, i
+}' > "$dict"
+cp "$dict" "$work/generation1.txt"
+
+"$cli" --user-data-dir "$dir" --dict luna_pinyin --backup-mode chunked --quiet > /dev/null
+cp "$dict" "$work/generation2.txt"
+cmp -s "$work/generation1.txt" "$work/generation2.txt" && fail "cleaning did not change the dictionary"
+"$cli" --user-data-dir "$dir" --dict luna_pinyin --backup-mode chunked --quiet > /dev/null
+
+manifests=$(ls "$dir/userdb_backups/manifests/device-1/"luna_pinyin.*.manifest | sort)
+[ "$(echo "$manifests" | wc -l)" -eq 2 ] || fail "expected 2 manifests, got: $manifests"
+
+g=1
+for manifest in $manifests; do
+  "$cli" --restore "$manifest" --output "$work/restored$g.txt" 2> /dev/null || fail "restoring $manifest failed"
+  cmp -s "$work/generation$g.txt" "$work/restored$g.txt" || fail "generation $g does not round-trip"
+  g=$((g + 1))
+done
+
+# 相对路径的清单与显式指定的仓库
+first=$(echo "$manifests" | head -n 1)
+(cd "$(dirname "$first")" && "$cli" --restore "$(basename "$first")" --backup-repo "$dir/userdb_backups" \
+  --output "$work/relative.txt" 2> /dev/null) || fail "restoring with --backup-repo failed"
+cmp -s "$work/generation1.txt" "$work/relative.txt" || fail "restore with --backup-repo does not round-trip"
+
+# 损坏一个分块：还原失败，已有的输出文件不变，不留临时文件
+chunk=$(find "$dir/userdb_backups/chunks" -type f | head -n 1)
+printf 'x' >> "$chunk"
+printf 'keep me\n' > "$work/existing.txt"
+for manifest in $manifests; do
+  if "$cli" --restore "$manifest" --output "$work/existing.txt" 2> /dev/null; then
+    # 该分块可能只属于另一代
+    continue
+  fi
+  [ "$(cat "$work/existing.txt")" = "keep me" ] || fail "failed restore modified the output"
+  [ ! -e "$work/existing.txt.partial" ] || fail "failed restore left a temp file"
+  echo "OK: 2 generations restored, corrupted chunk rejected"
+  exit 0
+done
+fail "no manifest noticed the corrupted chunk"
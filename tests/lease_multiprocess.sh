@@ -0,0 +1,80 @@
+#!/bin/sh
+# 多个命令行进程通过同一个租约目录分担批量清理：
+# 每个用户目录恰好被清理一次，过期的租约被接手，他人持有的未过期租约保持不动
+# 用法：lease_multiprocess.sh <userdb_cleaner_cli>
+set -eu
+
+cli=$1
+processes=4
+tenants=12
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+fail() {
+  echo "FAIL: $*" >&2
+  exit 1
+}
+
+lock_of() {
+  printf '%s' "$1" | sha256sum | cut -c1-32
+}
+
+: > "$work/manifest.tsv"
+i=1
+while [ "$i" -le "$tenants" ]; do
+  dir="$work/users/u$i"
+  mkdir -p "$dir/sync/device-1"
+  printf 'installation_id: "device-1"\n' > "$dir/installation.yaml"
+  printf '# Rime user dictionary\n#@/db_name\ta\n#@/db_type\tuserdb\n#@/tick\t10\n' > "$dir/sync/device-1/a.userdb.txt"
+  printf 'ni hao \t你好\tc=3 d=1 t=9\nbu yao \t不要\tc=-1 d=1 t=5\n' >> "$dir/sync/device-1/a.userdb.txt"
+  echo "$dir" >> "$work/manifest.tsv"
+  i=$((i + 1))
+done
+
+# u1：其他进程崩溃后留下的过期租约；u2：其他进程正在清理（未过期）
+now=$(date +%s)
+mkdir -p "$work/leases"
+expired="$work/users/u1"
+held="$work/users/u2"
+printf 'crashed:1\t%s\t%s\n' "$((now - 60))" "$expired" > "$work/leases/$(lock_of "$expired").lock"
+printf 'crashed:1\t%s\t%s\n' "$((now - 60))" "$expired" > "$expired/sync/device-1/a.userdb.txt.crashed_1.cache"
+printf 'busy:2\t%s\t%s\n' "$((now + 3600))" "$held" > "$work/leases/$(lock_of "$held").lock"
+cp "$held/sync/device-1/a.userdb.txt" "$work/held_before.txt"
+
+pids=
+p=1
+while [ "$p" -le "$processes" ]; do
+  "$cli" --batch "$work/manifest.tsv" --lease-dir "$work/leases" --threads 2 \
+    --results "$work/results$p.jsonl" --quiet 2> "$work/stderr$p.txt" &
+  pids="$pids $!"
+  p=$((p + 1))
+done
+status=0
+for pid in $pids; do
+  wait "$pid" || status=1
+done
+[ "$status" -eq 0 ] || fail "a cleaner process exited with an error: $(cat "$work"/stderr*.txt)"
+
+cat "$work"/results*.jsonl > "$work/all_results.txt"
+i=1
+while [ "$i" -le "$tenants" ]; do
+  dir="$work/users/u$i"
+  results=$(grep -c "\"tenant\":\"$dir\"" "$work/all_results.txt" || true)
+  runs=$(cat "$dir/sync/userdb_cleaner_metrics.jsonl" 2>/dev/null | wc -l)
+  if [ "$dir" = "$held" ]; then
+    [ "$results" -eq 0 ] && [ "$runs" -eq 0 ] || fail "$dir is leased by another process but was cleaned"
+    cmp -s "$work/held_before.txt" "$dir/sync/device-1/a.userdb.txt" || fail "$dir was modified"
+    grep -q '^busy:2	' "$work/leases/$(lock_of "$dir").lock" || fail "lease of $dir was taken over"
+  else
+    [ "$results" -eq 1 ] || fail "$dir has $results results, expected 1"
+    [ "$runs" -eq 1 ] || fail "$dir was cleaned $runs times, expected 1"
+    grep "\"tenant\":\"$dir\"" "$work/all_results.txt" | grep -q '"ok":true' || fail "$dir failed"
+    [ -e "$work/leases/$(lock_of "$dir").done" ] || fail "$dir is not marked done"
+    ! grep -q '不要' "$dir/sync/device-1/a.userdb.txt" || fail "$dir still has the deleted entry"
+  fi
+  i=$((i + 1))
+done
+
+leftover=$(find "$work/users" -name '*.cache' | wc -l)
+[ "$leftover" -eq 0 ] || fail "temp files left behind: $(find "$work/users" -name '*.cache')"
+echo "OK: $tenants tenants, $processes processes"
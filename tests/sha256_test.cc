@@ -0,0 +1,75 @@
+// sha256_test.cc
+// Sha256 的已知答案测试：FIPS 180-4 / NIST CAVP 的标准向量，以及跨 64 字节块边界的分段输入
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "lib/sha256.hpp"
+
+namespace {
+
+int failures = 0;
+
+void expect_hex(const std::string& actual, std::string_view expected, const char* what) {
+  if (actual != expected) {
+    std::fprintf(stderr, "FAIL %s:\n  expected %.*s\n  actual   %s\n", what, static_cast<int>(expected.size()),
+                 expected.data(), actual.c_str());
+    ++failures;
+  }
+}
+
+std::string to_hex(const userdb::Sha256::Digest& digest) {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  std::string hex;
+  for (uint8_t byte : digest) {
+    hex += kDigits[byte >> 4];
+    hex += kDigits[byte & 0xf];
+  }
+  return hex;
+}
+
+}  // namespace
+
+int main() {
+  using userdb::Sha256;
+
+  expect_hex(Sha256::hex(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", "empty");
+  expect_hex(Sha256::hex("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", "abc");
+  expect_hex(Sha256::hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+             "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", "448 bits");
+  expect_hex(Sha256::hex("abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+                         "ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"),
+             "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1", "896 bits");
+  expect_hex(Sha256::hex(std::string(1000000, 'a')),
+             "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", "one million a");
+
+  // 填充恰好跨块的长度：55 字节只需一个块，56 与 64 字节需要两个块
+  expect_hex(Sha256::hex(std::string(55, 'a')),
+             "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318", "55 bytes");
+  expect_hex(Sha256::hex(std::string(56, 'a')),
+             "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a", "56 bytes");
+  expect_hex(Sha256::hex(std::string(64, 'a')),
+             "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb", "64 bytes");
+
+  // 分段输入与一次输入结果相同，finish 之后可以复用
+  std::string message(1000, '\0');
+  for (size_t i = 0; i < message.size(); ++i) {
+    message[i] = static_cast<char>(i * 31 + 7);
+  }
+  std::string whole = Sha256::hex(message);
+  Sha256 sha;
+  for (size_t step : {1, 3, 63, 64, 65, 200}) {
+    for (size_t offset = 0; offset < message.size(); offset += step) {
+      sha.update(std::string_view(message).substr(offset, step));
+    }
+    expect_hex(to_hex(sha.finish()), whole, "incremental update");
+  }
+
+  if (failures) {
+    std::fprintf(stderr, "%d failures\n", failures);
+    return 1;
+  }
+  std::printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,566 @@
+// userdb_merge_test.cc
+// 词条改写逻辑的测试：c 值替换、去重输出端、各合并规则与并列时的取舍、多设备 k 路归并、
+// c<=0 与空闲剪除、已删除词条集合，以及末行无换行符与超过缓冲区长度的行；
+// 删除的词条只在文件确实被替换后计入，二进制快照据以跳过重写的判断与文本过滤一致
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lib/bounded_filter.hpp"
+#include "lib/clean_options.hpp"
+#include "lib/durable_commit.hpp"
+#include "lib/string_arena.hpp"
+#include "lib/tombstone_set.hpp"
+#include "lib/userdb_dedup.hpp"
+#include "lib/userdb_file_filter.hpp"
+#include "lib/userdb_merge.hpp"
+#include "lib/userdb_snapshot.hpp"
+#include "userdb_clean_core.hpp"
+
+namespace fs = std::filesystem;
+using namespace userdb;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+  do {                                                                            \
+    if (!(condition)) {                                                           \
+      std::fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #condition); \
+      ++failures;                                                                 \
+    }                                                                             \
+  } while (0)
+
+#define CHECK_EQ(actual, expected) check_eq((actual), (expected), __FILE__, __LINE__, #actual)
+
+void check_eq(const std::string& actual, const std::string& expected, const char* file, int line, const char* what) {
+  if (actual != expected) {
+    std::fprintf(stderr, "%s:%d: %s\n--- expected\n%s\n--- actual\n%s\n", file, line, what, expected.c_str(),
+                 actual.c_str());
+    ++failures;
+  }
+}
+
+void check_eq(uint64_t actual, uint64_t expected, const char* file, int line, const char* what) {
+  if (actual != expected) {
+    std::fprintf(stderr, "%s:%d: %s: expected %llu, actual %llu\n", file, line, what,
+                 static_cast<unsigned long long>(expected), static_cast<unsigned long long>(actual));
+    ++failures;
+  }
+}
+
+// 每个测试在其中读写文件，结束时删除
+class TempDir {
+ public:
+  TempDir() {
+    static int created = 0;
+    path_ = fs::temp_directory_path() /
+            ("userdb_merge_test." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "." +
+             std::to_string(created++));
+    fs::remove_all(path_);
+    fs::create_directories(path_);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    fs::remove_all(path_, ec);
+  }
+  fs::path operator/(const std::string& name) const { return path_ / name; }
+
+ private:
+  fs::path path_;
+};
+
+void write_file(const fs::path& path, std::string_view content) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+std::string read_file(const fs::path& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream buffer;
+  buffer << in.rdbuf();
+  return buffer.str();
+}
+
+std::string join(const StringList& words) {
+  std::string joined;
+  for (std::string_view word : words) {
+    joined += std::string(word) + ";";
+  }
+  return joined;
+}
+
+const std::string kHeader =
+    "# Rime user dictionary\n"
+    "#@/db_name\ttest\n"
+    "#@/tick\t100\n";
+
+// 同一文件中的重复词条：a 三条（c 并列最大、t 各不相同），b 的 c=0，c 两条 t 并列、另有一条 c=-1
+const std::string kBody =
+    "a \t甲\tc=2 d=1 t=10\n"
+    "b \t乙\tc=0 d=1 t=20\n"
+    "a \t甲\tc=5 d=2 t=5\n"
+    "c \t丙\tc=1 d=1 t=30\n"
+    "a \t甲\tc=5 d=3 t=40\n"
+    "c \t丙\tc=-1 d=1 t=50\n"
+    "c \t丙\tc=3 d=1 t=30\n";
+
+std::string filter(const std::string& content, CleanOptions options, FileFilterStats* stats = nullptr,
+                   StringList* words = nullptr) {
+  TempDir dir;
+  write_file(dir / "in.userdb.txt", content);
+  StringList deleted;
+  FileFilterStats result;
+  CHECK(filter_userdb_file(dir / "in.userdb.txt", dir / "out.userdb.txt", options, words ? *words : deleted, &result));
+  if (stats) {
+    *stats = result;
+  }
+  return read_file(dir / "out.userdb.txt");
+}
+
+std::string filter_bounded(const std::string& content, CleanOptions options, size_t buffer_size,
+                           FileFilterStats* stats = nullptr) {
+  TempDir dir;
+  write_file(dir / "in.userdb.txt", content);
+  FileFilterStats result;
+  CHECK(filter_userdb_file_bounded(dir / "in.userdb.txt", dir / "out.userdb.txt", options, nullptr, &result, nullptr,
+                                   buffer_size));
+  if (stats) {
+    *stats = result;
+  }
+  return read_file(dir / "out.userdb.txt");
+}
+
+CleanOptions with_rule(MergeRule rule) {
+  CleanOptions options;
+  options.merge_rule = rule;
+  return options;
+}
+
+void test_replace_c_value() {
+  CHECK_EQ(replace_c_value("ni \t你\tc=3 d=0.5 t=7", 10), "ni \t你\tc=10 d=0.5 t=7");
+  CHECK_EQ(replace_c_value("ni \t你\tc=3 d=0.5 t=7", 2.5), "ni \t你\tc=2.5 d=0.5 t=7");
+  CHECK_EQ(replace_c_value("ni \t你\td=0.5 t=7 c=3", 12), "ni \t你\td=0.5 t=7 c=12");
+  CHECK_EQ(replace_c_value("ni \t你\td=0.5 t=7", 4), "ni \t你\td=0.5 t=7");
+}
+
+void test_dedup_sink() {
+  // 非词条行按原位置保留；超过初始容量的词条触发扩容后仍能找到
+  DedupSink dedup(MergeRule::kMaxC);
+  std::vector<std::string> lines;
+  lines.push_back("# comment");
+  for (int i = 0; i < 3000; ++i) {
+    lines.push_back("k" + std::to_string(i) + " \tw\tc=1 d=1 t=1");
+  }
+  for (int i = 0; i < 3000; i += 3) {
+    lines.push_back("k" + std::to_string(i) + " \tw\tc=2 d=1 t=1");
+  }
+  lines.push_back("no tabs here");
+  for (const auto& line : lines) {
+    dedup(line);
+  }
+  CHECK_EQ(dedup.merged_count(), 1000u);
+  std::vector<std::string> out;
+  auto write = [&](std::string_view line) { out.emplace_back(line); };
+  dedup.flush(write);
+  CHECK_EQ(out.size(), 3002u);
+  CHECK_EQ(out.front(), "# comment");
+  CHECK_EQ(out[1], "k0 \tw\tc=2 d=1 t=1");
+  CHECK_EQ(out[2], "k1 \tw\tc=1 d=1 t=1");
+  CHECK_EQ(out.back(), "no tabs here");
+}
+
+void test_merge_rules() {
+  FileFilterStats stats;
+  StringList words;
+  CHECK_EQ(filter(kHeader + kBody, with_rule(MergeRule::kNone), &stats, &words),
+           kHeader +
+               "a \t甲\tc=2 d=1 t=10\n"
+               "a \t甲\tc=5 d=2 t=5\n"
+               "c \t丙\tc=1 d=1 t=30\n"
+               "a \t甲\tc=5 d=3 t=40\n"
+               "c \t丙\tc=3 d=1 t=30\n");
+  CHECK_EQ(stats.lines_dropped, 2u);
+  CHECK_EQ(stats.lines_merged, 0u);
+  CHECK_EQ(join(words), "乙;丙;");
+
+  // c 并列时保留先出现的行
+  CHECK_EQ(filter(kHeader + kBody, with_rule(MergeRule::kMaxC), &stats),
+           kHeader +
+               "a \t甲\tc=5 d=2 t=5\n"
+               "c \t丙\tc=3 d=1 t=30\n");
+  CHECK_EQ(stats.lines_merged, 3u);
+  CHECK_EQ(stats.lines_kept, 2u);
+
+  // t 并列时保留先出现的行
+  CHECK_EQ(filter(kHeader + kBody, with_rule(MergeRule::kMaxT)),
+           kHeader +
+               "a \t甲\tc=5 d=3 t=40\n"
+               "c \t丙\tc=1 d=1 t=30\n");
+
+  // 只累加保留的（c>0）记录，其余字段取 t 最大的行
+  CHECK_EQ(filter(kHeader + kBody, with_rule(MergeRule::kSumC)),
+           kHeader +
+               "a \t甲\tc=12 d=3 t=40\n"
+               "c \t丙\tc=4 d=1 t=30\n");
+
+  // 只出现一次的词条不改写 c
+  CHECK_EQ(filter(kHeader + "x \t戊\tc=0.25 d=1 t=1\n", with_rule(MergeRule::kSumC)),
+           kHeader + "x \t戊\tc=0.25 d=1 t=1\n");
+}
+
+void test_c_values() {
+  // c<=0 删除；没有 c 字段的行与非词条行保留
+  std::string body =
+      "a \t甲\tc=0 d=1 t=1\n"
+      "b \t乙\tc=-0.5 d=1 t=1\n"
+      "c \t丙\tc=0.001 d=1 t=1\n"
+      "d \t丁\td=1 t=1\n"
+      "not a record\n"
+      "\n"
+      "e \t戊\tc=-3 d=1 t=1\n";
+  FileFilterStats stats;
+  std::string expected = kHeader +
+                         "c \t丙\tc=0.001 d=1 t=1\n"
+                         "d \t丁\td=1 t=1\n"
+                         "not a record\n";
+  CHECK_EQ(filter(kHeader + body, CleanOptions(), &stats), expected);
+  CHECK_EQ(stats.lines_dropped, 3u);
+  CHECK_EQ(filter_bounded(kHeader + body, CleanOptions(), kBoundedBufferSize), expected);
+}
+
+void test_idle_prune() {
+  // tick 100，剪除 70 个 tick 以上未使用的词条：保留 t >= 30
+  CleanOptions options;
+  options.prune_idle_ticks = 70;
+  std::string expected = kHeader +
+                         "c \t丙\tc=1 d=1 t=30\n"
+                         "a \t甲\tc=5 d=3 t=40\n"
+                         "c \t丙\tc=3 d=1 t=30\n";
+  FileFilterStats stats;
+  CHECK_EQ(filter(kHeader + kBody, options, &stats), expected);
+  CHECK_EQ(stats.lines_dropped, 4u);
+  CHECK_EQ(filter_bounded(kHeader + kBody, options, kBoundedBufferSize), expected);
+
+  // 剪除与合并同时生效：被剪除的行不参与合并
+  options.merge_rule = MergeRule::kSumC;
+  CHECK_EQ(filter(kHeader + kBody, options),
+           kHeader +
+               "c \t丙\tc=4 d=1 t=30\n"
+               "a \t甲\tc=5 d=3 t=40\n");
+
+  // tick 不超过剪除阈值、或文件头没有 tick 时不剪除
+  options = CleanOptions();
+  options.prune_idle_ticks = 100;
+  CHECK_EQ(filter(kHeader + "a \t甲\tc=1 d=1 t=0\n", options), kHeader + "a \t甲\tc=1 d=1 t=0\n");
+  options.prune_idle_ticks = 1;
+  CHECK_EQ(filter("#@/db_name\ttest\na \t甲\tc=1 d=1 t=0\n", options), "#@/db_name\ttest\na \t甲\tc=1 d=1 t=0\n");
+}
+
+void test_no_trailing_newline() {
+  // 末行没有换行符：保留时补上换行符，删除时不留下残余
+  std::string kept = kHeader + "a \t甲\tc=1 d=1 t=1\nb \t乙\tc=2 d=1 t=1";
+  std::string dropped = kHeader + "a \t甲\tc=1 d=1 t=1\nb \t乙\tc=0 d=1 t=1";
+  std::string expected_kept = kHeader + "a \t甲\tc=1 d=1 t=1\nb \t乙\tc=2 d=1 t=1\n";
+  std::string expected_dropped = kHeader + "a \t甲\tc=1 d=1 t=1\n";
+  for (MergeRule rule : {MergeRule::kNone, MergeRule::kMaxC, MergeRule::kSumC}) {
+    CHECK_EQ(filter(kept, with_rule(rule)), expected_kept);
+    CHECK_EQ(filter(dropped, with_rule(rule)), expected_dropped);
+  }
+  CHECK_EQ(filter_bounded(kept, CleanOptions(), kBoundedBufferSize), expected_kept);
+  CHECK_EQ(filter_bounded(dropped, CleanOptions(), kBoundedBufferSize), expected_dropped);
+  CHECK_EQ(filter_bounded(kept, CleanOptions(), 16), expected_kept);
+
+  // 只有文件头、且最后一行没有换行符
+  CHECK_EQ(filter("#@/db_name\ttest", CleanOptions()), "#@/db_name\ttest\n");
+}
+
+void test_oversized_lines() {
+  // 固定内存模式：超过缓冲区的行不做判断，分段原样写出（即使 c<=0）
+  const size_t buffer_size = 64;
+  std::string long_word(150, 'x');
+  std::string long_line = "long \t" + long_word + "\tc=-1 d=1 t=1";
+  std::string body = "a \t甲\tc=1 d=1 t=1\n" + long_line + "\nb \t乙\tc=0 d=1 t=1\nc \t丙\tc=2 d=1 t=1\n";
+  FileFilterStats stats;
+  CHECK_EQ(filter_bounded(kHeader + body, CleanOptions(), buffer_size, &stats),
+           kHeader + "a \t甲\tc=1 d=1 t=1\n" + long_line + "\nc \t丙\tc=2 d=1 t=1\n");
+  CHECK_EQ(stats.lines_oversized, 1u);
+  CHECK_EQ(stats.lines_dropped, 1u);
+  CHECK_EQ(stats.lines_kept, 3u);
+
+  // 超长行是最后一行且没有换行符
+  CHECK_EQ(filter_bounded(kHeader + "a \t甲\tc=1 d=1 t=1\n" + long_line, CleanOptions(), buffer_size),
+           kHeader + "a \t甲\tc=1 d=1 t=1\n" + long_line + "\n");
+
+  // 紧接文件头的超长行
+  CHECK_EQ(filter_bounded(kHeader + long_line + "\nb \t乙\tc=0 d=1 t=1\n", CleanOptions(), buffer_size),
+           kHeader + long_line + "\n");
+
+  // 行长恰好等于缓冲区（含换行符）时仍正常判断
+  std::string exact = "e \t" + std::string(buffer_size - 16, 'y') + "\tc=0 d=1 t=1";
+  CHECK_EQ(exact.size() + 1, buffer_size);
+  CHECK_EQ(filter_bounded(kHeader + exact + "\nc \t丙\tc=2 d=1 t=1\n", CleanOptions(), buffer_size, &stats),
+           kHeader + "c \t丙\tc=2 d=1 t=1\n");
+  CHECK_EQ(stats.lines_oversized, 0u);
+
+  // 普通输入在小缓冲区与完整读入下结果一致
+  CHECK_EQ(filter_bounded(kHeader + kBody, CleanOptions(), buffer_size), filter(kHeader + kBody, CleanOptions()));
+}
+
+void test_deleted_word_journal() {
+  // 删除的词条先写入暂存文件，publish 后才进入日志，discard 的不进入
+  TempDir dir;
+  write_file(dir / "a.userdb.txt", kHeader + kBody);
+  write_file(dir / "b.userdb.txt", kHeader + "x \t戊\tc=0 d=1 t=1\n");
+  {
+    DeletedWordJournal journal(dir / "log.txt", "title");
+    CleanOptions options;
+    CHECK(filter_userdb_file_bounded(dir / "a.userdb.txt", dir / "a.out", options, &journal));
+    CHECK(filter_userdb_file_bounded(dir / "b.userdb.txt", dir / "b.out", options, &journal));
+    CHECK(fs::exists(journal.staging_path(dir / "a.userdb.txt")));
+    journal.publish(dir / "a.userdb.txt");
+    journal.discard(dir / "b.userdb.txt");
+    CHECK(!fs::exists(journal.staging_path(dir / "a.userdb.txt")));
+    CHECK(!fs::exists(journal.staging_path(dir / "b.userdb.txt")));
+    CHECK(journal.close());
+    CHECK_EQ(journal.count(), 2u);
+  }
+  CHECK_EQ(read_file(dir / "log.txt"), "title\n  - 乙\n  - 丙\n\n");
+}
+
+void test_staged_deletions() {
+  // 改名失败的文件内容未变，它删除的词条与数量不计入；清理失败（-1）的同样不计入
+  TempDir dir;
+  write_file(dir / "a.userdb.txt", "old a");
+  write_file(dir / "a.cache", "new a");
+  write_file(dir / "b.cache", "new b");
+  fs::create_directories(dir / "b.userdb.txt" / "occupied");  // 非空目录，改名失败
+  DurableCommit commit;
+  commit.replace(dir / "a.cache", dir / "a.userdb.txt");
+  commit.replace(dir / "b.cache", dir / "b.userdb.txt");
+  std::set<fs::path> replaced;
+  std::vector<DurableCommit::Result> results = commit_replacements(commit, nullptr, &replaced);
+  CHECK(results.size() == 2);
+  CHECK(results[0].renamed && !results[0].error);
+  CHECK(!results[1].renamed && results[1].error);
+  CHECK_EQ(read_file(dir / "a.userdb.txt"), "new a");
+  CHECK(!fs::exists(dir / "b.cache"));
+  CHECK_EQ(replaced.size(), 1u);
+
+  std::vector<StagedDeletions> staged(3);
+  staged[0].target = dir / "a.userdb.txt";
+  staged[0].count = 1;
+  staged[0].words.push_back("甲");
+  staged[1].target = dir / "b.userdb.txt";
+  staged[1].count = 1;
+  staged[1].words.push_back("乙");
+  staged[2].target = dir / "a.userdb.txt";
+  staged[2].words.push_back("丙");
+  StringList words;
+  CHECK_EQ(static_cast<uint64_t>(settle_staged_deletions(staged, replaced, words)), 1u);
+  CHECK_EQ(join(words), "甲;");
+}
+
+void test_snapshot_needs_clean() {
+  // 过滤会删除的非词条行（空行、c<=0）不在快照的词条中，但同样使文件需要重写
+  TempDir dir;
+  CleanOptions options;
+  const std::string clean = kHeader + "a \t甲\tc=1 d=1 t=1\nnot a record\n";
+  const std::pair<std::string, uint64_t> cases[] = {
+      {clean, 0},
+      {clean + "\n", 1},
+      {clean + "junk c=0\n", 1},
+      {clean + "x\tc=-1\n\n", 2},
+  };
+  for (const auto& [content, dirty] : cases) {
+    write_file(dir / "a.userdb.txt", content);
+    CHECK(build_snapshot(dir / "a.userdb.txt", dir / "a.userdb.snap"));
+    SnapshotView snapshot;
+    CHECK(snapshot.open(dir / "a.userdb.snap"));
+    CHECK(snapshot.is_fresh(dir / "a.userdb.txt"));
+    CHECK_EQ(snapshot.size(), 1u);
+    CHECK_EQ(snapshot.dirty_lines(), dirty);
+    CHECK(snapshot_needs_clean(snapshot, options, nullptr) == (dirty > 0));
+    CHECK((filter(content, options) != content) == (dirty > 0));
+  }
+}
+
+void test_tombstones() {
+  TombstoneSet set;
+  set.insert("a \t甲", 10);
+  set.insert("a \t甲", 5);  // 同一键保留最大的 t
+  double t = 0;
+  CHECK(set.find("a \t甲", &t) && t == 10);
+  CHECK(!set.find("b \t乙", &t));
+  CHECK(set.deletes("a \t甲", 10));   // 删除不早于记录
+  CHECK(!set.deletes("a \t甲", 11));  // 删除之后重新输入
+  CHECK(!set.deletes("b \t乙", 0));
+
+  // 扩容后所有键仍能找到，未插入的键找不到
+  TombstoneSet many;
+  for (int i = 0; i < 5000; ++i) {
+    many.insert("k" + std::to_string(i), i);
+  }
+  CHECK_EQ(many.size(), 5000u);
+  bool all_found = true;
+  for (int i = 0; i < 5000; ++i) {
+    all_found = all_found && many.find("k" + std::to_string(i), &t) && t == i;
+    all_found = all_found && !many.find("missing" + std::to_string(i), &t);
+  }
+  CHECK(all_found);
+
+  TombstoneSet other;
+  other.insert("a \t甲", 20);
+  other.insert("c \t丙", 1);
+  set.merge(other);
+  CHECK(set.find("a \t甲", &t) && t == 20);
+  CHECK_EQ(set.size(), 2u);
+
+  // collect 只收集 c<=0 的词条
+  TombstoneSet collected;
+  collected.collect(kHeader + kBody);
+  CHECK_EQ(collected.size(), 2u);
+  CHECK(collected.find("b \t乙", &t) && t == 20);
+  CHECK(collected.find("c \t丙", &t) && t == 50);
+  CHECK(!collected.find("a \t甲", &t));
+
+  // 按词典区分
+  DictionaryTombstones dictionaries;
+  dictionaries[fs::path("dev1") / "a.userdb.txt"].insert("x \t戊", 1);
+  CHECK(dictionaries.find(fs::path("dev2") / "a.userdb.txt") != nullptr);
+  CHECK(dictionaries.find(fs::path("dev1") / "b.userdb.txt") == nullptr);
+  dictionaries[fs::path("dev1") / "c.userdb.txt"];
+  CHECK(dictionaries.find(fs::path("dev1") / "c.userdb.txt") == nullptr);
+
+  TombstonePredicate keep(collected);
+  CHECK(!keep("c \t丙\tc=3 d=1 t=30"));  // 其他副本在 t=50 删除
+  CHECK(keep("c \t丙\tc=3 d=1 t=60"));   // 删除之后重新输入
+  CHECK(!keep("a \t甲\tc=0 d=1 t=1"));
+  CHECK(keep("a \t甲\tc=1 d=1 t=1"));
+}
+
+void test_merge_files() {
+  TempDir dir;
+  // 两个设备的副本，各自按词条键排序
+  std::string primary = kHeader +
+                        "a \t甲\tc=2 d=1 t=10\n"
+                        "b \t乙\tc=3 d=1 t=10\n"
+                        "d \t丁\tc=1 d=1 t=10\n";
+  std::string other =
+      "# Rime user dictionary\n#@/db_name\ttest\n#@/tick\t90\n"
+      "a \t甲\tc=2 d=9 t=99\n"
+      "b \t乙\tc=0 d=1 t=50\n"
+      "c \t丙\tc=4 d=1 t=10\n";
+  write_file(dir / "primary.txt", primary);
+  write_file(dir / "other.txt", other);
+  std::vector<fs::path> inputs = {dir / "primary.txt", dir / "other.txt"};
+
+  auto merge = [&](const std::vector<fs::path>& files, CleanOptions options, FileFilterStats* stats = nullptr,
+                   StringList* words = nullptr, const TombstoneSet* tombstones = nullptr) {
+    StringList deleted;
+    CHECK(merge_userdb_files(files, dir / "out.txt", options, words ? *words : deleted, stats, tombstones));
+    return read_file(dir / "out.txt");
+  };
+
+  // 未指定规则时按 max_c 合并；c 并列时主输入优先，只保留主输入的文件头
+  FileFilterStats stats;
+  StringList words;
+  CHECK_EQ(merge(inputs, CleanOptions(), &stats, &words),
+           kHeader +
+               "a \t甲\tc=2 d=1 t=10\n"
+               "b \t乙\tc=3 d=1 t=10\n"
+               "c \t丙\tc=4 d=1 t=10\n"
+               "d \t丁\tc=1 d=1 t=10\n");
+  CHECK_EQ(stats.lines_merged, 1u);
+  CHECK_EQ(stats.lines_dropped, 1u);
+  CHECK_EQ(join(words), "乙;");
+
+  CHECK_EQ(merge({inputs[1], inputs[0]}, CleanOptions()),
+           "# Rime user dictionary\n#@/db_name\ttest\n#@/tick\t90\n"
+           "a \t甲\tc=2 d=9 t=99\n"
+           "b \t乙\tc=3 d=1 t=10\n"
+           "c \t丙\tc=4 d=1 t=10\n"
+           "d \t丁\tc=1 d=1 t=10\n");
+
+  CHECK_EQ(merge(inputs, with_rule(MergeRule::kMaxT)),
+           kHeader +
+               "a \t甲\tc=2 d=9 t=99\n"
+               "b \t乙\tc=3 d=1 t=10\n"
+               "c \t丙\tc=4 d=1 t=10\n"
+               "d \t丁\tc=1 d=1 t=10\n");
+
+  CHECK_EQ(merge(inputs, with_rule(MergeRule::kSumC)),
+           kHeader +
+               "a \t甲\tc=4 d=9 t=99\n"
+               "b \t乙\tc=3 d=1 t=10\n"
+               "c \t丙\tc=4 d=1 t=10\n"
+               "d \t丁\tc=1 d=1 t=10\n");
+
+  // 同一输入内连续的相同键也会合并
+  write_file(dir / "repeated.txt", kHeader + "a \t甲\tc=1 d=1 t=1\na \t甲\tc=7 d=1 t=2\n");
+  CHECK_EQ(merge({dir / "repeated.txt", inputs[1]}, CleanOptions()),
+           kHeader +
+               "a \t甲\tc=7 d=1 t=2\n"
+               "c \t丙\tc=4 d=1 t=10\n");
+
+  // 已删除词条：删除不早于记录时删除，之后重新输入的保留
+  TombstoneSet tombstones;
+  tombstones.insert("d \t丁", 20);
+  tombstones.insert("c \t丙", 5);
+  CHECK_EQ(merge(inputs, CleanOptions(), nullptr, nullptr, &tombstones),
+           kHeader +
+               "a \t甲\tc=2 d=1 t=10\n"
+               "b \t乙\tc=3 d=1 t=10\n"
+               "c \t丙\tc=4 d=1 t=10\n");
+
+  // 未排序的输入改用哈希去重：按首次出现的顺序写出，删除的词条不重复记录
+  write_file(dir / "unsorted.txt", kHeader +
+                                       "b \t乙\tc=3 d=1 t=10\n"
+                                       "a \t甲\tc=2 d=1 t=10\n"
+                                       "d \t丁\tc=1 d=1 t=10\n");
+  words = StringList();
+  CHECK_EQ(merge({dir / "unsorted.txt", inputs[1]}, CleanOptions(), &stats, &words),
+           kHeader +
+               "b \t乙\tc=3 d=1 t=10\n"
+               "a \t甲\tc=2 d=1 t=10\n"
+               "d \t丁\tc=1 d=1 t=10\n"
+               "c \t丙\tc=4 d=1 t=10\n");
+  CHECK_EQ(stats.lines_merged, 1u);
+  CHECK_EQ(join(words), "乙;");
+
+  // 非词条行原样写出（读到时立即写出，先于正在归并的词条），末行没有换行符
+  write_file(dir / "tail.txt", kHeader + "a \t甲\tc=1 d=1 t=1\nnot a record\nz \t己\tc=1 d=1 t=1");
+  CHECK_EQ(merge({dir / "tail.txt"}, CleanOptions()),
+           kHeader + "not a record\na \t甲\tc=1 d=1 t=1\nz \t己\tc=1 d=1 t=1\n");
+}
+
+}  // namespace
+
+int main() {
+  test_replace_c_value();
+  test_dedup_sink();
+  test_merge_rules();
+  test_c_values();
+  test_idle_prune();
+  test_no_trailing_newline();
+  test_oversized_lines();
+  test_deleted_word_journal();
+  test_staged_deletions();
+  test_snapshot_needs_clean();
+  test_tombstones();
+  test_merge_files();
+  if (failures) {
+    std::fprintf(stderr, "%d failures\n", failures);
+    return 1;
+  }
+  std::printf("OK\n");
+  return 0;
+}
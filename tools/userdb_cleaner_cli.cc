@@ -0,0 +1,467 @@
+// userdb_cleaner_cli.cc
+// 命令行清理工具：不启动 rime，对指定的用户目录运行与插件相同的清理流程
+//
+//   userdb_cleaner_cli --user-data-dir ~/.local/share/fcitx5/rime --dict luna_pinyin --merge max_c
+//   userdb_cleaner_cli --batch profiles.tsv --consolidate --results results.jsonl --quiet
+//   userdb_cleaner_cli --daemon /run/user/1000/userdb_cleaner.sock
+//   userdb_cleaner_cli --socket /run/user/1000/userdb_cleaner.sock --user-data-dir ~/.local/share/fcitx5/rime
+//   userdb_cleaner_cli --restore userdb_backups/manifests/device-1/luna_pinyin.userdb_backup.20240101-120000-000.manifest --output luna_pinyin.userdb.txt
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "userdb_batch.hpp"
+#include "userdb_clean_core.hpp"
+#include "userdb_daemon.hpp"
+#include "lib/chunk_store.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/**
+ * 读取 installation.yaml 中的顶层键值（sync_dir、installation_id），不存在时返回空串
+ */
+std::string read_installation_value(const fs::path& file, std::string_view key) {
+  std::ifstream in(file);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.size() <= key.size() || line.compare(0, key.size(), key) != 0 || line[key.size()] != ':') {
+      continue;
+    }
+    std::string value = line.substr(key.size() + 1);
+    size_t begin = value.find_first_not_of(" \t");
+    size_t end = value.find_last_not_of(" \t\r");
+    if (begin == std::string::npos) {
+      return "";
+    }
+    value = value.substr(begin, end - begin + 1);
+    if (value.size() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front()) {
+      value = value.substr(1, value.size() - 2);
+    }
+    return value;
+  }
+  return "";
+}
+
+/**
+ * 按与插件相同的目录约定补全租户：sync 目录取自 installation.yaml，本机设备目录以 installation_id 命名
+ * @return 失败时返回错误信息
+ */
+std::string resolve_tenant(const fs::path& user_data_dir, fs::path sync_dir, std::string installation_id,
+                           const userdb::CleanOptions& options, userdb::BatchTenant& tenant) {
+  if (!fs::is_directory(user_data_dir)) {
+    return "User data directory does not exist: " + user_data_dir.string();
+  }
+  fs::path installation = user_data_dir / "installation.yaml";
+  if (sync_dir.empty()) {
+    std::string configured = read_installation_value(installation, "sync_dir");
+    sync_dir = configured.empty() ? user_data_dir / "sync" : fs::path(configured);
+  }
+  if (installation_id.empty()) {
+    installation_id = read_installation_value(installation, "installation_id");
+  }
+  if (installation_id.empty() && options.consolidate_devices) {
+    return "--consolidate needs --installation-id or installation_id in installation.yaml: " + user_data_dir.string();
+  }
+  tenant.name = user_data_dir.string();
+  tenant.options = options;
+  if (tenant.options.backup_repo.empty()) {
+    tenant.options.backup_repo = (user_data_dir / "userdb_backups").string();
+  }
+  tenant.context.user_data_dir = user_data_dir;
+  tenant.context.sync_dir = sync_dir;
+  tenant.context.local_sync_dir = installation_id.empty() ? fs::path() : sync_dir / installation_id;
+  return "";
+}
+
+/**
+ * 读取批量清理清单：每行 user_data_dir[<TAB>sync_dir[<TAB>installation_id]]，空行与 # 开头的行忽略
+ */
+bool read_manifest(const fs::path& manifest, const userdb::CleanOptions& options,
+                   std::vector<userdb::BatchTenant>& tenants) {
+  std::ifstream in(manifest);
+  if (!in) {
+    std::cerr << "Failed to open manifest: " << manifest.string() << "\n";
+    return false;
+  }
+  std::string line;
+  size_t line_number = 0;
+  bool ok = true;
+  while (std::getline(in, line)) {
+    ++line_number;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::vector<std::string> fields;
+    std::stringstream columns(line);
+    std::string field;
+    while (std::getline(columns, field, '\t')) {
+      fields.push_back(field);
+    }
+    fields.resize(3);
+    userdb::BatchTenant tenant;
+    std::string error = resolve_tenant(fields[0], fields[1], fields[2], options, tenant);
+    if (!error.empty()) {
+      std::cerr << manifest.string() << ":" << line_number << ": " << error << "\n";
+      ok = false;
+      continue;
+    }
+    tenants.push_back(std::move(tenant));
+  }
+  return ok;
+}
+
+void print_usage() {
+  std::cerr <<
+      "Usage: userdb_cleaner_cli --user-data-dir DIR [options]\n"
+      "       userdb_cleaner_cli --batch MANIFEST [options]\n"
+      "       userdb_cleaner_cli --restore MANIFEST --output FILE [--backup-repo DIR]\n"
+      "  --user-data-dir DIR       rime user data directory (contains <dict>.userdb folders)\n"
+      "  --batch MANIFEST          clean every user_data_dir[<TAB>sync_dir[<TAB>installation_id]] line\n"
+      "                            of MANIFEST on one shared thread pool\n"
+      "  --threads N               batch worker threads (default: hardware concurrency)\n"
+      "  --results FILE            batch per-tenant JSON lines (default: stdout)\n"
+      "  --daemon SOCKET           serve submit / cancel / status requests on a Unix socket,\n"
+      "                            running one cleaning job at a time\n"
+      "  --socket SOCKET           send the cleaning job to the daemon instead of running it\n"
+      "  --status                  with --socket: list the daemon's jobs\n"
+      "  --cancel ID               with --socket: cancel a queued or running job\n"
+      "  --restore MANIFEST        rebuild the .userdb.txt saved by a chunked backup manifest\n"
+      "                            (repository: --backup-repo, default three levels above MANIFEST)\n"
+      "  --output FILE             with --restore: file to write, replaced only if every chunk verifies\n"
+      "  --checkpoint FILE         batch checkpoint: skip work finished by an interrupted run\n"
+      "                            (removed after every tenant succeeds)\n"
+      "  --lease-dir DIR           share the batch with other processes (any host) that use the same\n"
+      "                            manifest and DIR: each tenant is cleaned by whoever claims its lease\n"
+      "  --lease-seconds N         lease duration before another process may take over (default 600)\n"
+      "  --sync-dir DIR            sync directory (default: sync_dir in installation.yaml, else DIR/sync)\n"
+      "  --installation-id ID      local device directory under the sync directory\n"
+      "                            (default: installation_id in installation.yaml)\n"
+      "  --dict NAME[,NAME]        only clean these dictionaries (repeatable, default: all)\n"
+      "  --merge RULE              none / max_c / max_t / sum_c (default none)\n"
+      "  --backup-mode MODE        copy / compressed / chunked (default copy)\n"
+      "  --backup-generations N    timestamped backups to keep (default 5)\n"
+      "  --backup-repo DIR         chunked backup repository (default DIR/userdb_backups)\n"
+      "  --consolidate             merge device copies into the local device directory\n"
+      "  --propagate               propagate deletions across device copies\n"
+      "  --prune-idle-ticks N      drop entries idle for more than N ticks\n"
+      "  --binary-snapshot         maintain .userdb.snap next to each .userdb.txt\n"
+      "  --no-record               do not record deleted words in userdb_cleaner.txt\n"
+      "  --bounded-memory          clean with fixed-size buffers; deleted words are streamed to\n"
+      "                            userdb_cleaner.txt, merge / consolidate / propagate / snapshot are off\n"
+      "  --drop-page-cache         write back and evict cleaned files and backups from the page cache\n"
+      "  --no-durable-commit       replace files without syncing them to disk first\n"
+      "  --no-metrics              do not append userdb_cleaner_metrics.jsonl\n"
+      "  --trace                   write userdb_cleaner_trace.json in the sync directory\n"
+      "                            (batch: in the current directory)\n"
+      "  --verbose                 log per-entry detail (not rate limited)\n"
+      "  --log-rate N              per-category log rate limit per second (0 = unlimited, default 100)\n"
+      "  --quiet                   only log warnings and errors\n";
+}
+
+/**
+ * 租约持有者标识：主机名:进程号
+ */
+std::string lease_owner() {
+#if defined(_WIN32) || defined(_WIN64)
+  const char* host = std::getenv("COMPUTERNAME");
+  return std::string(host ? host : "localhost") + ":" + std::to_string(_getpid());
+#else
+  char host[256] = {0};
+  if (gethostname(host, sizeof(host) - 1) != 0) {
+    std::snprintf(host, sizeof(host), "localhost");
+  }
+  return std::string(host) + ":" + std::to_string(getpid());
+#endif
+}
+
+/**
+ * 按 chunked 备份的清单还原一个 .userdb.txt
+ * 清单位于 <仓库>/manifests/<设备目录>/ 下，未指定仓库时由清单路径推出
+ */
+int run_restore(const fs::path& manifest, const fs::path& output, fs::path repo) {
+  if (repo.empty()) {
+    repo = fs::absolute(manifest).parent_path().parent_path().parent_path();
+  }
+  if (!userdb::restore_chunked_backup(repo, manifest, output)) {
+    std::cerr << "Failed to restore " << manifest.string() << " from " << repo.string()
+              << ": manifest unreadable, chunk missing or corrupted, or output not writable\n";
+    return 1;
+  }
+  std::cerr << "Restored " << output.string() << " from " << manifest.string() << "\n";
+  return 0;
+}
+
+/**
+ * 批量清理清单中的所有租户，每个租户完成时输出一行 JSON 结果
+ */
+int run_batch(const fs::path& manifest, const userdb::CleanOptions& options, size_t threads,
+              const fs::path& results_file, const fs::path& checkpoint_file, const fs::path& lease_dir,
+              int lease_seconds) {
+  // 租户并发回收分块，共用一个仓库会删掉其他租户尚未写完清单的分块
+  if (!options.backup_repo.empty()) {
+    std::cerr << "--backup-repo cannot be used with --batch, each tenant uses DIR/userdb_backups\n";
+    return 2;
+  }
+  std::vector<userdb::BatchTenant> tenants;
+  if (!read_manifest(manifest, options, tenants)) {
+    return 2;
+  }
+  std::ofstream results_out;
+  if (!results_file.empty()) {
+    results_out.open(results_file, std::ios::app);
+    if (!results_out) {
+      std::cerr << "Failed to open results file: " << results_file.string() << "\n";
+      return 1;
+    }
+  }
+  std::ostream& results = results_file.empty() ? std::cout : results_out;
+
+  userdb::BatchOptions batch_options;
+  batch_options.threads = threads;
+  batch_options.checkpoint_file = checkpoint_file;
+  batch_options.lease_dir = lease_dir;
+  batch_options.lease_owner = lease_owner();
+  batch_options.lease_seconds = lease_seconds;
+  batch_options.log_verbose = options.log_verbose;
+  batch_options.log_rate_limit = options.log_rate_limit;
+  if (options.trace) {
+    batch_options.trace_file = "userdb_cleaner_trace.json";
+  }
+  userdb::BatchStats stats = userdb::run_batch_clean(tenants, batch_options, [&](const userdb::TenantResult& result) {
+    // 逐行写出，中断时已完成租户的结果不会留在缓冲区中
+    results << result.to_json() << std::endl;
+  });
+  results.flush();
+
+  std::cerr << "Processed " << stats.tenants << " tenants on " << stats.threads << " threads in " << stats.duration_ms
+            << " ms (" << stats.failed_tenants << " failed, " << stats.resumed_tenants << " resumed, "
+            << stats.skipped_tenants << " left to other processes, " << stats.steals << " tasks stolen)\n";
+  return stats.failed_tenants ? 1 : 0;
+}
+
+std::atomic<bool> stop_requested{false};
+
+void request_stop(int) { stop_requested.store(true); }
+
+int run_daemon(const fs::path& socket_path) {
+  std::signal(SIGINT, request_stop);
+  std::signal(SIGTERM, request_stop);
+  userdb::CleanDaemon daemon(socket_path);
+  std::string error;
+  if (!daemon.serve(stop_requested, &error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * 向守护进程发送一个请求并打印应答
+ */
+int run_client(const fs::path& socket_path, const std::string& request) {
+  std::string response;
+  std::string error;
+  if (!userdb::daemon_request(socket_path, request, &response, &error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  if (!response.empty()) {
+    std::cout << response << "\n";
+  }
+  return response.compare(0, 6, "error ") == 0 ? 1 : 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  userdb::CleanOptions options;
+  fs::path user_data_dir;
+  fs::path sync_dir;
+  std::string installation_id;
+  fs::path manifest;
+  fs::path results_file;
+  fs::path checkpoint_file;
+  fs::path lease_dir;
+  int lease_seconds = 600;
+  size_t threads = 0;
+  fs::path daemon_socket;
+  fs::path client_socket;
+  bool status = false;
+  std::string cancel_id;
+  fs::path restore_manifest;
+  fs::path restore_output;
+  bool quiet = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto value = [&]() -> const char* {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << "\n";
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+    bool ok = true;
+    if (arg == "--user-data-dir") {
+      user_data_dir = value();
+    } else if (arg == "--batch") {
+      manifest = value();
+    } else if (arg == "--threads") {
+      threads = std::strtoul(value(), nullptr, 10);
+    } else if (arg == "--results") {
+      results_file = value();
+    } else if (arg == "--daemon") {
+      daemon_socket = value();
+    } else if (arg == "--socket") {
+      client_socket = value();
+    } else if (arg == "--status") {
+      status = true;
+    } else if (arg == "--cancel") {
+      cancel_id = value();
+    } else if (arg == "--restore") {
+      restore_manifest = value();
+    } else if (arg == "--output") {
+      restore_output = value();
+    } else if (arg == "--lease-dir") {
+      lease_dir = value();
+    } else if (arg == "--lease-seconds") {
+      lease_seconds = std::atoi(value());
+      ok = lease_seconds > 0;
+    } else if (arg == "--checkpoint") {
+      checkpoint_file = value();
+    } else if (arg == "--sync-dir") {
+      sync_dir = value();
+    } else if (arg == "--installation-id") {
+      installation_id = value();
+    } else if (arg == "--dict") {
+      std::stringstream list(value());
+      std::string name;
+      while (std::getline(list, name, ',')) {
+        if (!name.empty()) options.cleanup_list.push_back(name);
+      }
+    } else if (arg == "--merge") {
+      ok = userdb::parse_merge_rule(value(), &options.merge_rule);
+    } else if (arg == "--backup-mode") {
+      ok = userdb::parse_backup_mode(value(), &options.backup_mode);
+    } else if (arg == "--backup-generations") {
+      options.backup_generations = std::atoi(value());
+      ok = options.backup_generations > 0;
+    } else if (arg == "--backup-repo") {
+      options.backup_repo = value();
+    } else if (arg == "--consolidate") {
+      options.consolidate_devices = true;
+    } else if (arg == "--propagate") {
+      options.propagate_deletions = true;
+    } else if (arg == "--prune-idle-ticks") {
+      options.prune_idle_ticks = std::strtoull(value(), nullptr, 10);
+    } else if (arg == "--binary-snapshot") {
+      options.binary_snapshot = true;
+    } else if (arg == "--no-record") {
+      options.record_deleted_words = false;
+    } else if (arg == "--bounded-memory") {
+      options.bounded_memory = true;
+    } else if (arg == "--drop-page-cache") {
+      options.drop_page_cache = true;
+    } else if (arg == "--no-durable-commit") {
+      options.durable_commit = false;
+    } else if (arg == "--no-metrics") {
+      options.record_metrics = false;
+    } else if (arg == "--trace") {
+      options.trace = true;
+    } else if (arg == "--verbose") {
+      options.log_verbose = true;
+    } else if (arg == "--log-rate") {
+      options.log_rate_limit = std::atoi(value());
+    } else if (arg == "--quiet") {
+      quiet = true;
+    } else if (arg == "--help" || arg == "-h") {
+      print_usage();
+      return 0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << "Invalid argument: " << arg << "\n";
+      print_usage();
+      return 2;
+    }
+  }
+  if (!client_socket.empty() && (status || !cancel_id.empty())) {
+    return run_client(client_socket, status ? "status" : "cancel " + cancel_id);
+  }
+  if (!restore_manifest.empty() || !restore_output.empty()) {
+    if (restore_manifest.empty() || restore_output.empty()) {
+      print_usage();
+      return 2;
+    }
+    return run_restore(restore_manifest, restore_output, options.backup_repo);
+  }
+  if (daemon_socket.empty() && user_data_dir.empty() == manifest.empty()) {
+    print_usage();
+    return 2;
+  }
+
+  if (quiet) {
+    userdb::clean_logger().set_sink([](userdb::LogLevel level, const std::string& message) {
+      if (level >= userdb::LogLevel::kWarning) {
+        std::cerr << (level == userdb::LogLevel::kError ? "E " : "W ") << message << "\n";
+      }
+    });
+  }
+
+  if (!daemon_socket.empty()) {
+    return run_daemon(daemon_socket);
+  }
+  if (!manifest.empty()) {
+    return run_batch(manifest, options, threads, results_file, checkpoint_file, lease_dir, lease_seconds);
+  }
+
+  userdb::BatchTenant tenant;
+  std::string error = resolve_tenant(user_data_dir, sync_dir, installation_id, options, tenant);
+  if (!error.empty()) {
+    std::cerr << error << "\n";
+    return fs::is_directory(user_data_dir) ? 2 : 1;
+  }
+  if (!client_socket.empty()) {
+    tenant.context.user_data_dir = fs::absolute(tenant.context.user_data_dir);
+    tenant.context.sync_dir = fs::absolute(tenant.context.sync_dir);
+    if (!tenant.context.local_sync_dir.empty()) {
+      tenant.context.local_sync_dir = fs::absolute(tenant.context.local_sync_dir);
+    }
+    tenant.options.backup_repo = fs::absolute(tenant.options.backup_repo).string();
+    return run_client(client_socket, userdb::encode_clean_job(tenant.options, tenant.context));
+  }
+
+  userdb::CleanMetrics metrics;
+  userdb::CleanResult result = userdb::run_clean_task(tenant.options, tenant.context, &metrics);
+  size_t failed = 0;
+  for (const auto& file : metrics.files()) {
+    if (!file.ok) ++failed;
+  }
+  std::cout << user_data_dir.string() << ": deleted " << result.deleted_count << " entries from "
+            << result.cleaned_files.size() << " dictionaries, removed " << result.folder_files_deleted
+            << " files from " << result.cleaned_folders.size() << " .userdb folders";
+  if (failed) {
+    std::cout << ", " << failed << " files failed";
+  }
+  std::cout << "\n";
+  return failed ? 1 : 0;
+}
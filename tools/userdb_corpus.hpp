@@ -0,0 +1,255 @@
+#ifndef USERDB_CORPUS_HPP_
+#define USERDB_CORPUS_HPP_
+
+// 合成 .userdb.txt 语料的生成逻辑，供语料生成器与基准测试共用
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace userdb_corpus {
+
+struct CorpusOptions {
+  uint64_t size = 1 << 20;          // 每个文件的目标大小（字节）
+  double invalid_fraction = 0.05;   // c <= 0 的词条比例
+  double duplicate_rate = 0.0;      // 紧随其后再出现一次相同词条的比例
+  double cjk_ratio = 0.9;           // 汉字词条比例，其余为 ASCII 词条
+  bool header = true;               // 是否写出 # 文件头
+  double device_overlap = 0.9;      // 多设备时每个词条出现在某台设备上的概率
+  uint64_t seed = 1;
+};
+
+// 常见拼音音节，启动时按字节序排序
+inline std::vector<std::string> make_syllables() {
+  std::vector<std::string> syllables = {
+      "a", "ai", "an", "ang", "ba", "bai", "ban", "bao", "bei", "ben", "bi", "bian", "biao", "bie",
+      "bu", "ca", "cai", "can", "ce", "chang", "chao", "che", "chen", "cheng", "chi", "chu", "chuan",
+      "ci", "cong", "da", "dai", "dan", "dang", "dao", "de", "deng", "di", "dian", "ding", "dong",
+      "du", "duan", "dui", "duo", "er", "fa", "fan", "fang", "fei", "fen", "feng", "fu", "gai", "gan",
+      "gang", "gao", "ge", "gei", "gen", "gong", "gou", "gu", "guan", "guang", "gui", "guo", "hai",
+      "han", "hao", "he", "hen", "hong", "hou", "hu", "hua", "huan", "hui", "huo", "ji", "jia",
+      "jian", "jiang", "jiao", "jie", "jin", "jing", "jiu", "ju", "jue", "kai", "kan", "kao", "ke",
+      "kong", "kuai", "la", "lai", "lao", "le", "lei", "li", "lian", "liang", "lin", "ling", "liu",
+      "long", "lu", "lv", "ma", "mai", "man", "mei", "men", "mi", "mian", "min", "ming", "mo", "mu",
+      "na", "nan", "nei", "neng", "ni", "nian", "nin", "niu", "nv", "pa", "pai", "pan", "pao", "pi",
+      "pian", "ping", "qi", "qian", "qiang", "qing", "qiu", "qu", "quan", "que", "ran", "ren", "ri",
+      "rong", "ru", "san", "se", "shan", "shang", "shao", "she", "shen", "sheng", "shi", "shou",
+      "shu", "shuo", "si", "song", "su", "suan", "sui", "ta", "tai", "tan", "tang", "te", "ti",
+      "tian", "tiao", "ting", "tong", "tou", "tu", "wai", "wan", "wang", "wei", "wen", "wo", "wu",
+      "xi", "xia", "xian", "xiang", "xiao", "xie", "xin", "xing", "xiu", "xu", "xue", "ya", "yan",
+      "yang", "yao", "ye", "yi", "yin", "ying", "yong", "you", "yu", "yuan", "yue", "yun", "za",
+      "zai", "zao", "ze", "zhan", "zhang", "zhao", "zhe", "zhen", "zheng", "zhi", "zhong", "zhou",
+      "zhu", "zhuan", "zi", "zong", "zou", "zu", "zui", "zuo",
+  };
+  std::sort(syllables.begin(), syllables.end());
+  return syllables;
+}
+
+inline void append_utf8(std::string& out, uint32_t cp) {
+  out += static_cast<char>(0xE0 | (cp >> 12));
+  out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+  out += static_cast<char>(0x80 | (cp & 0x3F));
+}
+
+inline uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+/**
+ * 按字节序递增地生成编码
+ * 编码由 1~4 个音节组成，对应 (S+1) 进制的 4 位数（0 表示空位，空位之后只能是空位）。
+ * 音节已排序且空格小于任何字母，因此数值递增时编码（含末尾空格）也按字节序递增。
+ */
+class CodeSequence {
+ public:
+  CodeSequence(const std::vector<std::string>& syllables, uint64_t expected_codes, uint64_t seed)
+      : syllables_(syllables), radix_(syllables.size() + 1), rng_(seed) {
+    uint64_t space = radix_ * radix_ * radix_ * radix_;
+    uint64_t mean_gap = std::max<uint64_t>(1, space / std::max<uint64_t>(1, expected_codes));
+    gap_ = std::uniform_int_distribution<uint64_t>(1, 2 * mean_gap - 1);
+    space_ = space;
+  }
+
+  /**
+   * 生成下一个编码及各音节下标，编码空间用尽时返回 false
+   */
+  bool next(std::string& code, std::vector<size_t>& digits) {
+    while (true) {
+      value_ += gap_(rng_);
+      if (value_ >= space_) {
+        return false;
+      }
+      uint64_t v = value_;
+      size_t d[4];
+      for (int i = 3; i >= 0; --i) {
+        d[i] = static_cast<size_t>(v % radix_);
+        v /= radix_;
+      }
+      if (d[0] == 0) continue;
+      bool valid = true;
+      for (int i = 1; i < 3; ++i) {
+        if (d[i] == 0 && d[i + 1] != 0) valid = false;
+      }
+      if (!valid) continue;
+      code.clear();
+      digits.clear();
+      for (size_t digit : d) {
+        if (digit == 0) break;
+        code += syllables_[digit - 1];
+        code += ' ';
+        digits.push_back(digit - 1);
+      }
+      return true;
+    }
+  }
+
+ private:
+  const std::vector<std::string>& syllables_;
+  uint64_t radix_;
+  uint64_t space_ = 0;
+  uint64_t value_ = 0;
+  std::mt19937_64 rng_;
+  std::uniform_int_distribution<uint64_t> gap_;
+};
+
+/**
+ * 为编码生成若干同音词条，按字节序排序（ASCII 词条排在汉字之前）
+ */
+inline void make_words(const std::vector<size_t>& digits, const std::vector<std::string>& syllables,
+                       double cjk_ratio, std::mt19937_64& rng, std::vector<std::string>& words) {
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  words.clear();
+  size_t count = 1 + rng() % 3;
+  uint64_t base = 0;
+  for (size_t digit : digits) {
+    base = base * 1000 + digit;
+  }
+  for (size_t k = 0; k < count; ++k) {
+    std::string word;
+    if (unit(rng) < cjk_ratio) {
+      // 每个音节对应一个基本汉字区（U+4E00..U+9FA5）中的字，同音词取不同的字
+      for (size_t i = 0; i < digits.size(); ++i) {
+        append_utf8(word, 0x4E00 + static_cast<uint32_t>(mix(base * 31 + i * 7 + k) % 20902));
+      }
+    } else {
+      for (size_t digit : digits) {
+        word += syllables[digit];
+      }
+      if (k > 0) {
+        word += std::to_string(k);
+      }
+    }
+    words.push_back(std::move(word));
+  }
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+}
+
+inline void append_record(std::string& out, const std::string& code, const std::string& word,
+                          double invalid_fraction, uint64_t tick, std::mt19937_64& rng) {
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  int c;
+  if (unit(rng) < invalid_fraction) {
+    c = -static_cast<int>(rng() % 3);  // 0 或负数表示已删除
+  } else {
+    // 使用次数大多很小，少数高频词较大
+    c = 1 + static_cast<int>(std::min(200.0, -std::log(1.0 - unit(rng)) * 4.0));
+  }
+  char attrs[96];
+  int length = std::snprintf(attrs, sizeof(attrs), "\tc=%d d=%g t=%llu\n", c, unit(rng) * 2.0,
+                             static_cast<unsigned long long>(tick ? rng() % (tick + 1) : 0));
+  out += code;
+  out += '\t';
+  out += word;
+  out.append(attrs, static_cast<size_t>(length));
+}
+
+struct CorpusStats {
+  uint64_t bytes = 0;
+  uint64_t records = 0;
+};
+
+/**
+ * 生成一组设备副本：各副本共享编码序列，词条以 device_overlap 的概率出现在每台设备上
+ */
+inline bool generate(const std::vector<std::filesystem::path>& outputs, const std::string& db_name,
+                     const CorpusOptions& options, uint64_t dict_seed, CorpusStats& stats) {
+  static const std::vector<std::string> syllables = make_syllables();
+  const uint64_t expected_records = std::max<uint64_t>(1, options.size / 40);
+  const uint64_t tick = expected_records * 4;
+
+  std::vector<std::ofstream> files;
+  std::vector<std::string> buffers(outputs.size());
+  std::vector<std::mt19937_64> device_rngs;
+  std::vector<uint64_t> sizes(outputs.size(), 0);
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    files.emplace_back(outputs[i], std::ios::binary | std::ios::trunc);
+    if (!files.back().is_open()) {
+      std::cerr << "Failed to open " << outputs[i].string() << "\n";
+      return false;
+    }
+    device_rngs.emplace_back(mix(dict_seed * 131 + i + 1));
+    if (options.header) {
+      buffers[i] = "# Rime user dictionary\n#@/db_name\t" + db_name +
+                   "\n#@/db_type\tuserdb\n#@/rime_version\t1.11.2\n#@/tick\t" + std::to_string(tick) +
+                   "\n#@/user_id\tdevice-" + std::to_string(i + 1) + "\n";
+    }
+  }
+
+  CodeSequence codes(syllables, expected_records, dict_seed);
+  std::mt19937_64 word_rng(mix(dict_seed));
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::string code;
+  std::vector<size_t> digits;
+  std::vector<std::string> words;
+  bool done = false;
+  while (!done && codes.next(code, digits)) {
+    make_words(digits, syllables, options.cjk_ratio, word_rng, words);
+    for (const auto& word : words) {
+      for (size_t i = 0; i < outputs.size(); ++i) {
+        auto& rng = device_rngs[i];
+        if (outputs.size() > 1 && unit(rng) >= options.device_overlap) continue;
+        append_record(buffers[i], code, word, options.invalid_fraction, tick, rng);
+        ++stats.records;
+        if (unit(rng) < options.duplicate_rate) {
+          append_record(buffers[i], code, word, options.invalid_fraction, tick, rng);
+          ++stats.records;
+        }
+        if (buffers[i].size() >= (1 << 20)) {
+          files[i].write(buffers[i].data(), static_cast<std::streamsize>(buffers[i].size()));
+          sizes[i] += buffers[i].size();
+          buffers[i].clear();
+        }
+      }
+    }
+    done = true;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      done = done && sizes[i] + buffers[i].size() >= options.size;
+    }
+  }
+
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    files[i].write(buffers[i].data(), static_cast<std::streamsize>(buffers[i].size()));
+    sizes[i] += buffers[i].size();
+    stats.bytes += sizes[i];
+    files[i].flush();
+    if (!files[i]) {
+      std::cerr << "Failed to write " << outputs[i].string() << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace userdb_corpus
+
+#endif